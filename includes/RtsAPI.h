@@ -280,6 +280,18 @@ typedef struct _RTSStats {
     // The maximum time elapsed during the post-mark pause phase of the
     // concurrent nonmoving GC.
   Time nonmoving_gc_max_elapsed_ns;
+
+  // ----------------------------------
+  // Software transactional memory
+
+    // The number of top-level transactions that committed
+  uint64_t stm_commits;
+    // The number of times a top-level transaction failed to commit and
+    // was re-run
+  uint64_t stm_aborts;
+    // The number of transaction attempts that ran serialised
+    // (see +RTS --stm-escalate-after)
+  uint64_t stm_serialised;
 } RTSStats;
 
 void getRTSStats (RTSStats *s);
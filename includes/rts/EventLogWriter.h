@@ -39,6 +39,41 @@ typedef struct {
  */
 extern const EventLogWriter FileEventLogWriter;
 
+/*
+ * An EventLogWriter which writes eventlogs to a file
+ * `program.eventlog.lz`, compressing each block of events separately.
+ */
+extern const EventLogWriter CompressedFileEventLogWriter;
+
+/*
+ * Decompress an eventlog written by CompressedFileEventLogWriter into an
+ * ordinary eventlog. Returns true on success.
+ */
+bool decompressEventLogFile(const char *in_path, const char *out_path);
+
+#if !defined(mingw32_HOST_OS)
+/*
+ * An EventLogWriter which writes eventlogs into a ring buffer in the shared
+ * memory-mapped file `program.eventlog.ring`, for live monitoring.
+ */
+extern const EventLogWriter RingEventLogWriter;
+
+/*
+ * Reading such a ring buffer from another process. readEventLogRing returns
+ * the next chunk of the eventlog, or NULL if there is nothing new yet. The
+ * chunks read so far always form a valid eventlog: the first chunk, and the
+ * first after the reader has been overrun by the writer, is the eventlog
+ * header, and every other chunk is a block of events. After an overrun the
+ * reader continues with the oldest block still in the ring. The returned
+ * memory is valid until the next call.
+ */
+typedef struct EventLogRingReader_ EventLogRingReader;
+
+EventLogRingReader *openEventLogRing(const char *path);
+const void *readEventLogRing(EventLogRingReader *reader, size_t *len);
+void closeEventLogRing(EventLogRingReader *reader);
+#endif
+
 enum EventLogStatus {
   /* The runtime system wasn't compiled with eventlog support. */
   EVENTLOG_NOT_SUPPORTED,
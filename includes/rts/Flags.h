@@ -55,8 +55,14 @@ typedef struct _GC_FLAGS {
     bool         useNonmoving; // default = false
     bool         nonmovingSelectorOpt; // Do selector optimization in the
                                        // non-moving heap, default = false
+    uint32_t     nonmovingMarkThreads; // Number of threads taking part in
+                                       // the non-moving mark, default = 1
+    bool         nonmovingLazySweep; // Let allocation sweep non-moving
+                                     // segments, default = false
     uint32_t     generations;
     bool squeezeUpdFrames;
+    bool scavPrefetch;          /* prefetch pointer fields ahead of
+                                 * evacuating them while scavenging */
 
     bool compact;		/* True <=> "compact all the time" */
     double  compactThreshold;
@@ -72,6 +78,10 @@ typedef struct _GC_FLAGS {
     Time    longGCSync;         /* units: TIME_RESOLUTION */
 
     StgWord heapBase;           /* address to ask the OS for memory */
+    bool hugePages;             /* back the heap with 2MB huge pages */
+    uint32_t returnMemoryRate;  /* in *mblocks*, 0 = never return memory */
+    uint32_t returnMemoryDelay; /* major GCs a surplus must last before
+                                 * it is returned */
 
     StgWord allocLimitGrace;    /* units: *blocks*
                                  * After an AllocationLimitExceeded
@@ -178,6 +188,14 @@ typedef struct _TRACE_FLAGS {
     bool sparks_full;    /* trace spark events 100% accurately */
     bool user;           /* trace user events (emitted from Haskell code) */
     char *trace_output;  /* output filename for eventlog */
+    uint32_t async_buffers; /* spare buffers per capability for the
+                               asynchronous eventlog writer, 0: write
+                               synchronously */
+    bool compress;       /* compress the eventlog */
+    StgWord64 ring_size; /* size of the eventlog ring buffer in bytes,
+                            0: don't use one */
+    uint32_t sched_sample_period; /* post 1 in n scheduler events */
+    uint32_t spark_sample_period; /* post 1 in n spark events */
 } TRACE_FLAGS;
 
 /* See Note [Synchronization of flags and base APIs] */
@@ -226,6 +244,12 @@ typedef struct _MISC_FLAGS {
     bool linkerAlwaysPic;        /* Assume the object code is always PIC */
     StgWord linkerMemBase;       /* address to ask the OS for memory
                                   * for the linker, NULL ==> off */
+    uint32_t stmEscalateAborts;  /* run an STM transaction serialised after
+                                  * this many failed commits, 0 ==> never.
+                                  * See Note [STM contention management] */
+    uint32_t stmIndexAfter;      /* index a TRec once a lookup has scanned
+                                  * this many entries, 0 ==> never.
+                                  * See Note [TRec indexes] */
 } MISC_FLAGS;
 
 /* See Note [Synchronization of flags and base APIs] */
@@ -255,6 +279,12 @@ typedef struct _PAR_FLAGS {
                                   * GC (default: use all nNodes). */
 
   bool           setAffinity;    /* force thread affinity with CPUs */
+  bool           randomSparkSteal;
+                                 /* steal sparks in batches, from random
+                                  * victims on the same node first */
+  bool           workRequests;
+                                 /* only give threads to capabilities
+                                  * that ask for them */
 } PAR_FLAGS;
 
 /* See Note [Synchronization of flags and base APIs] */
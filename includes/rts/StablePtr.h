@@ -16,6 +16,12 @@
 EXTERN_INLINE StgPtr deRefStablePtr (StgStablePtr stable_ptr);
 StgStablePtr getStablePtr  (StgPtr p);
 
+/* Bulk versions of getStablePtr and freeStablePtr: sps[i] is made to
+   point to ps[i], and the n stable pointers in sps are freed,
+   respectively.  Cheaper than n separate calls. */
+void getStablePtrs  (StgPtr ps[], StgStablePtr sps[], uint32_t n);
+void freeStablePtrs (StgStablePtr sps[], uint32_t n);
+
 /* -----------------------------------------------------------------------------
    PRIVATE from here.
    -------------------------------------------------------------------------- */
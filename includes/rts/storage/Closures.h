@@ -371,6 +371,8 @@ struct StgTRecHeader_ {
   StgHeader                  header;
   struct StgTRecHeader_     *enclosing_trec;
   StgTRecChunk              *current_chunk;
+  StgArrBytes               *index;  /* hash index over the entries, see
+                                        Note [TRec indexes] in STM.c */
   TRecState                  state;
 };
 
@@ -21,6 +21,7 @@ extern void * getMBlockOnNode(uint32_t node);
 extern void * getMBlocksOnNode(uint32_t node, uint32_t n);
 extern void freeMBlocks(void *addr, uint32_t n);
 extern void releaseFreeMemory(void);
+extern StgWord64 getHeapHugePageBytes(void);
 extern void freeAllMBlocks(void);
 
 extern void *getFirstMBlock(void **state);
@@ -173,6 +173,19 @@ typedef struct StgTSO_ {
      */
     StgWord32  tot_stack_size;
 
+    /*
+     * The number of times in a row that this thread has failed to commit
+     * an STM transaction.  See Note [STM contention management] in STM.c.
+     */
+    StgWord32  stm_aborts;
+
+    /*
+     * The position of this thread in the heap of threads blocked in
+     * threadDelay, if it is there.  See Note [The sleeping heap] in
+     * posix/Select.c.
+     */
+    StgWord32  sleep_index;
+
 #if defined(TICKY_TICKY)
     /* TICKY-specific stuff would go here. */
 #endif
@@ -290,13 +303,21 @@ void dirty_STACK (Capability *cap, StgStack *stack);
         BlockedOnMVar          the MVAR             the MVAR's queue
 
         BlockedOnSTM           END_TSO_QUEUE        STM wait queue(s)
-        BlockedOnSTM           STM_AWOKEN           run queue
+        BlockedOnSTM           STM_AWOKEN           STM wait queue(s), with a
+                                                    MSG_TRY_WAKEUP on the way
+                                                    (see Note [Batched STM
+                                                    wakeups] in STM.c)
 
         BlockedOnMsgThrowTo    MessageThrowTo *     TSO->blocked_exception
 
-        BlockedOnRead          NULL                 blocked_queue
-        BlockedOnWrite         NULL                 blocked_queue
-        BlockedOnDelay         NULL                 blocked_queue
+        BlockedOnRead          NULL                 blocked_queue, or the fd's
+                                                    queue (see Note [awaitEvent
+                                                    with epoll] in Select.c)
+        BlockedOnWrite         NULL                 ditto
+        BlockedOnDelay         NULL                 blocked_queue (win32), or
+                                                    the sleeping heap (see Note
+                                                    [The sleeping heap] in
+                                                    Select.c)
 
       tso->link == END_TSO_QUEUE, if the thread is currently running.
 
@@ -18,4 +18,31 @@
  */
 RTS_PRIVATE void awaitEvent(bool wait);  /* In posix/Select.c or
                                           * win32/AwaitEvent.c */
+
+#if !defined(mingw32_HOST_OS)
+/* Threads blocked on file descriptors, in posix/Select.c.
+ * See Note [awaitEvent with epoll] there.
+ */
+
+/* Called by waitRead# and waitWrite# to block the current thread */
+RTS_PRIVATE void blockOnFd (StgTSO *tso);
+
+/* Take a thread blocked on an fd off its queue */
+RTS_PRIVATE void removeThreadBlockedOnFd (Capability *cap, StgTSO *tso);
+
+/* Threads blocked in threadDelay, in posix/Select.c.
+ * See Note [The sleeping heap] there.
+ */
+
+/* Called by delay# once tso->block_info.target is set */
+RTS_PRIVATE void insertSleepingThread (StgTSO *tso);
+
+RTS_PRIVATE void removeSleepingThread (StgTSO *tso);
+
+/* Mark the threads blocked on fds and in threadDelay */
+RTS_PRIVATE void markAwaitEvent (evac_fn evac, void *user);
+
+/* Called in the child of forkProcess, once it has deleted all threads */
+RTS_PRIVATE void resetAwaitEventAfterFork (void);
+#endif
 #endif
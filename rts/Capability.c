@@ -92,6 +92,101 @@ globalWorkToDo (void)
 #endif
 
 #if defined(THREADED_RTS)
+/* Note [Spark stealing]
+ * ~~~~~~~~~~~~~~~~~~~~~
+ * A capability that has run out of sparks steals them from the others.
+ * Visiting the victims in the fixed order 0..n-1 makes all the idle
+ * capabilities hit the same few pools, and the cache lines holding their
+ * top indices, whenever sparks are produced unevenly.  And a thief that
+ * succeeds gets just one spark, so it is soon looking for work again.
+ *
+ * So unless -qs is given, findSpark
+ *
+ *  - visits the other capabilities starting from a random one, drawn from
+ *    a per-capability xorshift generator, so that thieves spread out;
+ *
+ *  - visits the capabilities on its own NUMA node before the others, since
+ *    sparks stolen from there are cheaper to evaluate.  Without --numa
+ *    there is just one node.  The RTS knows nothing finer about the cache
+ *    topology, e.g. which cores share an L3.
+ *
+ *  - takes up to half of the victim's pool.  The first spark is run at
+ *    once; the others are pushed onto the thief's own pool, where they are
+ *    run later or stolen in turn by other capabilities.
+ *
+ * The batch is taken one stealWSDeque_() at a time.  Moving top past
+ * several elements with a single CAS would race with popWSDeque(), which
+ * takes the bottom element without a CAS unless it is the last one.  The
+ * batch is also limited to the free space in the thief's pool.  Only the
+ * thief pushes onto its pool, so every stolen spark fits.
+ *
+ * Moving a spark between pools leaves the spark counters alone (see
+ * checkSparkCountInvariant); it is counted as converted when it is run.
+ */
+
+// Steal a spark from robbed's pool. If batch is set, move up to half of what
+// is left in it onto our own pool too. Sets *retry if we lost a race with
+// another thief and robbed still has sparks.
+static StgClosure *
+stealSparks (Capability *cap, Capability *robbed, bool batch, bool *retry)
+{
+    StgClosure *spark;
+
+    if (emptySparkPoolCap(robbed)) // nothing to steal here
+        return NULL;
+
+    spark = tryStealSpark(robbed->sparks);
+    while (spark != NULL && fizzledSpark(spark)) {
+        cap->spark_stats.fizzled++;
+        traceEventSparkFizzle(cap);
+        spark = tryStealSpark(robbed->sparks);
+    }
+    if (spark == NULL) {
+        if (!emptySparkPoolCap(robbed)) {
+            // we conflicted with another thread while trying to steal;
+            // try again later.
+            *retry = true;
+        }
+        return NULL;
+    }
+
+    if (batch) {
+        long room = cap->sparks->size - sparkPoolSize(cap->sparks);
+        long n = stg_min(sparkPoolSize(robbed->sparks) / 2, room);
+        StgClosure *s;
+
+        for (; n > 0; n--) {
+            s = tryStealSpark(robbed->sparks);
+            if (s == NULL) {
+                break;
+            }
+            if (fizzledSpark(s)) {
+                cap->spark_stats.fizzled++;
+                traceEventSparkFizzle(cap);
+                continue;
+            }
+            if (!pushWSDeque(cap->sparks, s)) {
+                barf("stealSparks: no room for stolen spark");
+            }
+        }
+    }
+
+    cap->spark_stats.converted++;
+    traceEventSparkSteal(cap, robbed->no);
+    return spark;
+}
+
+static uint32_t
+stealRandom (Capability *cap)
+{
+    uint32_t x = cap->steal_rng;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    cap->steal_rng = x;
+    return x;
+}
+
 StgClosure *
 findSpark (Capability *cap)
 {
@@ -140,35 +235,39 @@ findSpark (Capability *cap)
                  "cap %d: Trying to steal work from other capabilities",
                  cap->no);
 
-      /* visit cap.s 0..n-1 in sequence until a theft succeeds. We could
-      start at a random place instead of 0 as well.  */
-      for ( i=0 ; i < n_capabilities ; i++ ) {
-          robbed = capabilities[i];
-          if (cap == robbed)  // ourselves...
-              continue;
-
-          if (emptySparkPoolCap(robbed)) // nothing to steal here
-              continue;
-
-          spark = tryStealSpark(robbed->sparks);
-          while (spark != NULL && fizzledSpark(spark)) {
-              cap->spark_stats.fizzled++;
-              traceEventSparkFizzle(cap);
-              spark = tryStealSpark(robbed->sparks);
-          }
-          if (spark == NULL && !emptySparkPoolCap(robbed)) {
-              // we conflicted with another thread while trying to steal;
-              // try again later.
-              retry = true;
+      if (!RtsFlags.ParFlags.randomSparkSteal) {
+          /* -qs: visit cap.s 0..n-1 in sequence until a theft succeeds,
+             stealing one spark at a time. */
+          for ( i=0 ; i < n_capabilities ; i++ ) {
+              robbed = capabilities[i];
+              if (cap == robbed)  // ourselves...
+                  continue;
+
+              spark = stealSparks(cap, robbed, false, &retry);
+              if (spark != NULL) {
+                  return spark;
+              }
+              // otherwise: no success, try next one
           }
+          continue;
+      }
 
-          if (spark != NULL) {
-              cap->spark_stats.converted++;
-              traceEventSparkSteal(cap, robbed->no);
-
-              return spark;
+      // See Note [Spark stealing]: our own node first, then the others,
+      // each from a random starting point.
+      uint32_t start = stealRandom(cap) % n_capabilities;
+      for (uint32_t pass = 0; pass < (n_numa_nodes > 1 ? 2 : 1); pass++) {
+          for (uint32_t k = 0; k < n_capabilities; k++) {
+              robbed = capabilities[(start + k) % n_capabilities];
+              if (cap == robbed)  // ourselves...
+                  continue;
+              if ((robbed->node == cap->node) != (pass == 0))
+                  continue;
+
+              spark = stealSparks(cap, robbed, true, &retry);
+              if (spark != NULL) {
+                  return spark;
+              }
           }
-          // otherwise: no success, try next one
       }
   } while (retry);
 
@@ -281,6 +380,8 @@ initCapability (Capability *cap, uint32_t i)
     cap->spark_stats.converted  = 0;
     cap->spark_stats.gcd        = 0;
     cap->spark_stats.fizzled    = 0;
+    cap->steal_rng              = i + 1;
+    cap->work_requested         = false;
 #if !defined(mingw32_HOST_OS)
     cap->io_manager_control_wr_fd = -1;
 #endif
@@ -313,10 +414,18 @@ initCapability (Capability *cap, uint32_t i)
     cap->free_trec_chunks = END_STM_CHUNK_LIST;
     cap->free_trec_headers = NO_TREC;
     cap->transaction_tokens = 0;
+    cap->stm_backoff_rng = i + 1;
+    cap->stm_commits = 0;
+    cap->stm_aborts = 0;
+    cap->stm_serialised = 0;
     cap->context_switch = 0;
     cap->interrupt = 0;
     cap->pinned_object_block = NULL;
     cap->pinned_object_blocks = NULL;
+    initBlockCache(&cap->block_cache);
+#if defined(THREADED_RTS)
+    initStablePtrCache(&cap->sp_cache);
+#endif
 
 #if defined(PROFILING)
     cap->r.rCCCS = CCS_SYSTEM;
@@ -1251,6 +1360,7 @@ freeCapability (Capability *cap)
     stgFree(cap->saved_mut_lists);
 #if defined(THREADED_RTS)
     freeSparkPool(cap->sparks);
+    flushStablePtrCache(&cap->sp_cache);
 #endif
     traceCapsetRemoveCap(CAPSET_OSPROCESS_DEFAULT, cap->no);
     traceCapsetRemoveCap(CAPSET_CLOCKDOMAIN_DEFAULT, cap->no);
@@ -24,6 +24,8 @@
 #include "Task.h"
 #include "Sparks.h"
 #include "sm/NonMovingMark.h" // for MarkQueue
+#include "sm/BlockAlloc.h" // for BlockCache
+#include "StablePtr.h" // for StablePtrCache
 
 #include "BeginPrivate.h"
 
@@ -93,6 +95,10 @@ struct Capability_ {
     // full pinned object blocks allocated since the last GC
     bdescr *pinned_object_blocks;
 
+    // small block groups cached in front of the block allocator.
+    // See Note [Per-capability block caches] in BlockAlloc.c.
+    BlockCache block_cache;
+
     // per-capability weak pointer list associated with nursery (older
     // lists stored in generation object)
     StgWeak *weak_ptr_list_hd;
@@ -154,6 +160,18 @@ struct Capability_ {
 
     // Stats on spark creation/conversion
     SparkCounters spark_stats;
+
+    // State for picking victims to steal sparks from.
+    // See Note [Spark stealing] in Capability.c.
+    uint32_t steal_rng;
+
+    // True if this capability has asked for threads with -qp.
+    // See Note [Work requests] in Schedule.c.
+    bool work_requested;
+
+    // free stable pointer table entries owned by this capability.
+    // See Note [Per-capability stable pointer caches] in StablePtr.c.
+    StablePtrCache sp_cache;
 #if !defined(mingw32_HOST_OS)
     // IO manager for this cap
     int io_manager_control_wr_fd;
@@ -165,6 +183,13 @@ struct Capability_ {
     StgTRecChunk *free_trec_chunks;
     StgTRecHeader *free_trec_headers;
     uint32_t transaction_tokens;
+
+    // STM contention management and statistics.
+    // See Note [STM contention management] in STM.c.
+    uint32_t stm_backoff_rng;
+    StgWord64 stm_commits;
+    StgWord64 stm_aborts;
+    StgWord64 stm_serialised;
 } // typedef Capability is defined in RtsAPI.h
   // We never want a Capability to overlap a cache line with anything
   // else, so round it up to a cache line size:
@@ -421,7 +446,7 @@ recordMutableCap (const StgClosure *p, Capability *cap, uint32_t gen)
     bd = cap->mut_lists[gen];
     if (RELAXED_LOAD(&bd->free) >= bd->start + BLOCK_SIZE_W) {
         bdescr *new_bd;
-        new_bd = allocBlockOnNode_lock(cap->node);
+        new_bd = allocGroupCached(&cap->block_cache, cap->node, 1);
         new_bd->link = bd;
         new_bd->free = new_bd->start;
         bd = new_bd;
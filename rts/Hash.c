@@ -3,9 +3,8 @@
  * (c) The AQUA Project, Glasgow University, 1995-1998
  * (c) The GHC Team, 1999
  *
- * Dynamically expanding linear hash tables, as described in
- * Per-\AAke Larson, ``Dynamic Hash Tables,'' CACM 31(4), April 1988,
- * pp. 446 -- 457.
+ * Dynamically expanding hash tables, using open addressing with linear
+ * probing and Robin Hood insertion. See Note [Open addressing hash tables].
  * -------------------------------------------------------------------------- */
 
 #include "PosixSource.h"
@@ -30,63 +29,80 @@
 
 #include <string.h>
 
-#define HSEGSIZE    1024    /* Size of a single hash table segment */
-                            /* Also the minimum size of a hash table */
-#define HDIRSIZE    1024    /* Size of the segment directory */
-                            /* Maximum hash table size is HSEGSIZE * HDIRSIZE */
-#define HLOAD       5       /* Maximum average load of a single hash bucket */
-
-#define HCHUNK      (1024 * sizeof(W_) / sizeof(HashList))
-                            /* Number of HashList cells to allocate in one go */
-
+/* Note [Open addressing hash tables]
+   ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+   A HashTable is a single power-of-two sized array of (key, data) slots,
+   probed linearly from the slot the hash function picks (the key's home
+   slot). Alongside it is an array with a 16-bit word per slot, holding
+   zero for an empty slot or one more than the distance of the slot's entry
+   from its home slot. Lookups therefore touch consecutive slots of a flat array
+   rather than chasing a chain of separately allocated cells, and only call
+   the comparison function (which may be strcmp) on entries whose distance
+   shows that they have the same home slot as the key.
+
+   Insertion uses Robin Hood hashing: an entry being inserted takes the slot
+   of any entry it passes which is closer to its own home slot, and that
+   entry is inserted further along instead. This keeps all entries close to
+   their home slots, so that a lookup can stop as soon as it reaches an entry
+   closer to its home slot than the key would be at that point. Removal
+   shifts the following entries of the cluster back by one slot, so no
+   tombstones are needed.
+
+   The table doubles in size when it becomes HLOAD_NUM/HLOAD_DEN full, or
+   when an entry would end up further than HMAX_DIST slots from its home.
+   It never shrinks.
+
+   The table may hold several entries with the same key, as the old one
+   could: an insertion does not replace an existing entry. Entries with the
+   same key all have the same home slot, so they are adjacent in probe
+   order, and we keep them newest first: an insertion which meets an entry
+   with the same key takes its slot and reinserts the older entry. Hence
+   lookupHashTable finds the most recently inserted entry, and
+   removeHashTable with NULL data removes it.
+
+   The hash functions return a slot index for the table's current size. The
+   word hash uses Fibonacci (multiplicative) hashing, taking the top bits of
+   the product, because keys are very often pointers whose low bits are all
+   zero and whose high bits vary little; with linear probing, using the low
+   bits directly makes long clusters.
+*/
+
+#define HMIN_SIZE   64      /* Initial (and minimum) number of slots */
+#define HLOAD_NUM   3       /* Expand when more than HLOAD_NUM/HLOAD_DEN */
+#define HLOAD_DEN   4       /* of the slots are full */
+#define HMAX_DIST   0xffff  /* Largest value in the distance array */
+
+#if SIZEOF_VOID_P == 8
+#define HASH_MULTIPLIER ((StgWord)0x9E3779B97F4A7C15ULL)
+#else
+#define HASH_MULTIPLIER ((StgWord)0x9E3779B9UL)
+#endif
 
-/* Linked list of (key, data) pairs for separate chaining */
-typedef struct hashlist {
+/* A (key, data) pair, stored directly in the table */
+typedef struct {
     StgWord key;
     const void *data;
-    struct hashlist *next;  /* Next cell in bucket chain (same hash value) */
-} HashList;
-
-typedef struct chunklist {
-  HashList *chunk;
-  struct chunklist *next;
-} HashListChunk;
+} HashEntry;
 
 struct hashtable {
-    int split;              /* Next bucket to split when expanding */
-    int max;                /* Max bucket of smaller table */
-    int mask1;              /* Mask for doing the mod of h_1 (smaller table) */
-    int mask2;              /* Mask for doing the mod of h_2 (larger table) */
-    int kcount;             /* Number of keys */
-    int bcount;             /* Number of buckets */
-    HashList **dir[HDIRSIZE];   /* Directory of segments */
-    HashList *freeList;         /* free list of HashLists */
-    HashListChunk *chunks;
+    uint32_t mask;              /* Number of slots - 1 */
+    uint32_t shift;             /* Bits to drop from a word hash */
+    int kcount;                 /* Number of keys */
+    HashEntry *entries;         /* The slots */
+    uint16_t *dist;              /* For each slot, 0 if it is empty, otherwise
+                                 * 1 + its distance from its home slot */
     HashFunction *hash;         /* hash function */
     CompareFunction *compare;   /* key comparison function */
 };
 
 /* -----------------------------------------------------------------------------
- * Hash first using the smaller table.  If the bucket is less than the
- * next bucket to be split, re-hash using the larger table.
+ * Hash functions: return the home slot of a key.
  * -------------------------------------------------------------------------- */
 
 int
 hashWord(const HashTable *table, StgWord key)
 {
-    int bucket;
-
-    /* Strip the boring zero bits */
-    key /= sizeof(StgWord);
-
-    /* Mod the size of the hash table (a power of 2) */
-    bucket = key & table->mask1;
-
-    if (bucket < table->split) {
-        /* Mod the size of the expanded hash table (also a power of 2) */
-        bucket = key & table->mask2;
-    }
-    return bucket;
+    return (int)((key * HASH_MULTIPLIER) >> table->shift);
 }
 
 int
@@ -100,14 +116,7 @@ hashStr(const HashTable *table, StgWord w)
 #endif
 
     /* Mod the size of the hash table (a power of 2) */
-    int bucket = h & table->mask1;
-
-    if (bucket < table->split) {
-        /* Mod the size of the expanded hash table (also a power of 2) */
-        bucket = h & table->mask2;
-    }
-
-    return bucket;
+    return (int)(h & table->mask);
 }
 
 static int
@@ -124,99 +133,154 @@ compareStr(StgWord key1, StgWord key2)
 
 
 /* -----------------------------------------------------------------------------
- * Allocate a new segment of the dynamically growing hash table.
+ * Allocate the slots for a table of the given size (a power of 2), all
+ * empty. The entries and the distances share one allocation.
  * -------------------------------------------------------------------------- */
 
 static void
-allocSegment(HashTable *table, int segment)
+allocSlots(HashTable *table, uint32_t size)
+{
+    table->entries = stgMallocBytes(size * (sizeof(HashEntry)
+                                            + sizeof(uint16_t)),
+                                    "allocSlots");
+    table->dist = (uint16_t *)(table->entries + size);
+    memset(table->dist, 0, size * sizeof(uint16_t));
+
+    table->mask = size - 1;
+    table->shift = sizeof(StgWord) * 8;
+    while (size > 1) {
+        table->shift--;
+        size >>= 1;
+    }
+}
+
+/* -----------------------------------------------------------------------------
+ * Check whether a key with the given home slot can be inserted while
+ * keeping every entry within HMAX_DIST slots of its home slot. The entries
+ * which an insertion moves all stay between the key's home slot and the
+ * first empty slot after it, so it is enough to check how far that empty
+ * slot is from their homes.
+ * -------------------------------------------------------------------------- */
+
+static bool
+roomForKey(const HashTable *table, uint32_t home)
 {
-    table->dir[segment] = stgMallocBytes(HSEGSIZE * sizeof(HashList *),
-                                         "allocSegment");
+    const uint32_t mask = table->mask;
+    const uint16_t *dist = table->dist;
+    uint32_t i = home;
+    uint32_t k;
+    int worst = 1;  /* max over the cluster of dist[i] - k */
+
+    for (k = 0; dist[i] != 0; k++, i = (i + 1) & mask) {
+        if ((int)dist[i] - (int)k > worst) {
+            worst = (int)dist[i] - (int)k;
+        }
+    }
+    return worst + (int)k <= HMAX_DIST;
 }
 
+/* -----------------------------------------------------------------------------
+ * Robin Hood insertion, once roomForKey has said that there is room. If
+ * newest_first is set, an entry with the same key as one already in the
+ * table is placed in front of it, otherwise behind it.
+ * -------------------------------------------------------------------------- */
+
+static void
+insertEntry(HashTable *table, uint32_t home, StgWord key, const void *data,
+            bool newest_first)
+{
+    const uint32_t mask = table->mask;
+    HashEntry *entries = table->entries;
+    uint16_t *dist = table->dist;
+    CompareFunction *cmp = table->compare;
+    HashEntry ins = { .key = key, .data = data };
+    uint32_t i = home;
+    uint32_t d = 1;
+
+    for (;;) {
+        uint32_t di = dist[i];
+        if (di == 0) {
+            entries[i] = ins;
+            dist[i] = d;
+            return;
+        }
+        if (di < d || (di == d && newest_first && cmp(entries[i].key, ins.key))) {
+            HashEntry tmp = entries[i];
+            entries[i] = ins;
+            dist[i] = d;
+            ins = tmp;
+            d = di;
+        }
+        i = (i + 1) & mask;
+        d++;
+        ASSERT(d <= HMAX_DIST);
+    }
+}
 
 /* -----------------------------------------------------------------------------
- * Expand the larger hash table by one bucket, and split one bucket
- * from the smaller table into two parts.  Only the bucket referenced
- * by @table->split@ is affected by the expansion.
+ * Double the number of slots (or more, if some probe sequence would still
+ * be too long) and reinsert every entry.
  * -------------------------------------------------------------------------- */
 
 static void
 expand(HashTable *table)
 {
-    int oldsegment;
-    int oldindex;
-    int newbucket;
-    int newsegment;
-    int newindex;
-    HashList *hl;
-    HashList *next;
-    HashList *old, *new;
-
-    if (table->split + table->max >= HDIRSIZE * HSEGSIZE)
-        /* Wow!  That's big.  Too big, so don't expand. */
-        return;
-
-    /* Calculate indices of bucket to split */
-    oldsegment = table->split / HSEGSIZE;
-    oldindex = table->split % HSEGSIZE;
-
-    newbucket = table->max + table->split;
-
-    /* And the indices of the new bucket */
-    newsegment = newbucket / HSEGSIZE;
-    newindex = newbucket % HSEGSIZE;
-
-    if (newindex == 0)
-        allocSegment(table, newsegment);
-
-    if (++table->split == table->max) {
-        table->split = 0;
-        table->max *= 2;
-        table->mask1 = table->mask2;
-        table->mask2 = table->mask2 << 1 | 1;
-    }
-    table->bcount++;
-
-    /* Split the bucket, paying no attention to the original order */
-
-    old = new = NULL;
-    for (hl = table->dir[oldsegment][oldindex]; hl != NULL; hl = next) {
-        next = hl->next;
-        if (table->hash(table, hl->key) == newbucket) {
-            hl->next = new;
-            new = hl;
-        } else {
-            hl->next = old;
-            old = hl;
+    HashEntry *old_entries = table->entries;
+    uint16_t *old_dist = table->dist;
+    uint32_t old_size = table->mask + 1;
+    uint32_t size = old_size * 2;
+    uint32_t start, n;
+
+    // Visit the old slots in probe order, starting just after an empty
+    // slot so that no cluster is split by wrapping around the end. Entries
+    // with the same key are visited newest first, and inserting each
+    // behind the ones before keeps them in that order.
+    for (start = 0; old_dist[start] != 0; start++) {}
+
+retry:
+    allocSlots(table, size);
+
+    for (n = 1; n <= old_size; n++) {
+        uint32_t i = (start + n) & (old_size - 1);
+        if (old_dist[i] != 0) {
+            uint32_t home = table->hash(table, old_entries[i].key);
+            if (!roomForKey(table, home)) {
+                stgFree(table->entries);
+                size *= 2;
+                if (size == 0) {
+                    barf("expand: hash table too large");
+                }
+                goto retry;
+            }
+            insertEntry(table, home, old_entries[i].key, old_entries[i].data,
+                        false);
         }
     }
-    table->dir[oldsegment][oldindex] = old;
-    table->dir[newsegment][newindex] = new;
 
-    return;
+    stgFree(old_entries);
 }
 
 void *
 lookupHashTable(const HashTable *table, StgWord key)
 {
-    int bucket;
-    int segment;
-    int index;
-    HashList *hl;
-
-    bucket = table->hash(table, key);
-    segment = bucket / HSEGSIZE;
-    index = bucket % HSEGSIZE;
-
+    const uint32_t mask = table->mask;
+    const HashEntry *entries = table->entries;
+    const uint16_t *dist = table->dist;
     CompareFunction *cmp = table->compare;
-    for (hl = table->dir[segment][index]; hl != NULL; hl = hl->next) {
-        if (cmp(hl->key, key))
-            return (void *) hl->data;
+    uint32_t i = table->hash(table, key);
+    uint32_t d;
+
+    for (d = 1; ; d++) {
+        uint32_t di = dist[i];
+        if (di < d) {
+            /* It's not there */
+            return NULL;
+        }
+        if (di == d && cmp(entries[i].key, key)) {
+            return (void *) entries[i].data;
+        }
+        i = (i + 1) & mask;
     }
-
-    /* It's not there */
-    return NULL;
 }
 
 // Puts up to szKeys keys of the hash table into the given array. Returns the
@@ -225,120 +289,68 @@ lookupHashTable(const HashTable *table, StgWord key)
 // If the table is modified concurrently, the function behavior is undefined.
 //
 int keysHashTable(HashTable *table, StgWord keys[], int szKeys) {
-    int segment, index;
     int k = 0;
-    HashList *hl;
-
 
-    /* The last bucket with something in it is table->max + table->split - 1 */
-    segment = (table->max + table->split - 1) / HSEGSIZE;
-    index = (table->max + table->split - 1) % HSEGSIZE;
-
-    while (segment >= 0 && k < szKeys) {
-        while (index >= 0 && k < szKeys) {
-            hl = table->dir[segment][index];
-            while (hl && k < szKeys) {
-                keys[k] = hl->key;
-                k += 1;
-                hl = hl->next;
-            }
-            index--;
+    for (uint32_t i = 0; i <= table->mask && k < szKeys; i++) {
+        if (table->dist[i] != 0) {
+            keys[k] = table->entries[i].key;
+            k += 1;
         }
-        segment--;
-        index = HSEGSIZE - 1;
     }
     return k;
 }
 
-/* -----------------------------------------------------------------------------
- * We allocate the hashlist cells in large chunks to cut down on malloc
- * overhead.  Although we keep a free list of hashlist cells, we make
- * no effort to actually return the space to the malloc arena.
- * -------------------------------------------------------------------------- */
-
-static HashList *
-allocHashList (HashTable *table)
-{
-    HashList *hl, *p;
-    HashListChunk *cl;
-
-    if ((hl = table->freeList) != NULL) {
-        table->freeList = hl->next;
-    } else {
-        hl = stgMallocBytes(HCHUNK * sizeof(HashList), "allocHashList");
-        cl = stgMallocBytes(sizeof (*cl), "allocHashList: chunkList");
-        cl->chunk = hl;
-        cl->next = table->chunks;
-        table->chunks = cl;
-
-        table->freeList = hl + 1;
-        for (p = table->freeList; p < hl + HCHUNK - 1; p++)
-            p->next = p + 1;
-        p->next = NULL;
-    }
-    return hl;
-}
-
-static void
-freeHashList (HashTable *table, HashList *hl)
-{
-    hl->next = table->freeList;
-    table->freeList = hl;
-}
-
 void
 insertHashTable(HashTable *table, StgWord key, const void *data)
 {
-    int bucket;
-    int segment;
-    int index;
-    HashList *hl;
+    uint32_t home;
 
     // Disable this assert; sometimes it's useful to be able to
     // overwrite entries in the hash table.
     // ASSERT(lookupHashTable(table, key) == NULL);
 
-    /* When the average load gets too high, we expand the table */
-    if (++table->kcount >= HLOAD * table->bcount)
+    /* When the load gets too high, or some probe sequence would get too
+     * long, we expand the table */
+    if ((StgWord)(table->kcount + 1) * HLOAD_DEN
+            > (StgWord)(table->mask + 1) * HLOAD_NUM) {
         expand(table);
+    }
+    home = table->hash(table, key);
+    while (!roomForKey(table, home)) {
+        expand(table);
+        home = table->hash(table, key);
+    }
 
-    bucket = table->hash(table, key);
-    segment = bucket / HSEGSIZE;
-    index = bucket % HSEGSIZE;
-
-    hl = allocHashList(table);
-
-    hl->key = key;
-    hl->data = data;
-    hl->next = table->dir[segment][index];
-    table->dir[segment][index] = hl;
-
+    insertEntry(table, home, key, data, true);
+    table->kcount++;
 }
 
 void *
 removeHashTable(HashTable *table, StgWord key, const void *data)
 {
-    int bucket;
-    int segment;
-    int index;
-    HashList *hl;
-    HashList *prev = NULL;
-
-    bucket = table->hash(table, key);
-    segment = bucket / HSEGSIZE;
-    index = bucket % HSEGSIZE;
-
-    for (hl = table->dir[segment][index]; hl != NULL; hl = hl->next) {
-        if (table->compare(hl->key,key) && (data == NULL || hl->data == data)) {
-            if (prev == NULL)
-                table->dir[segment][index] = hl->next;
-            else
-                prev->next = hl->next;
-            freeHashList(table,hl);
+    const uint32_t mask = table->mask;
+    HashEntry *entries = table->entries;
+    uint16_t *dist = table->dist;
+    uint32_t i = table->hash(table, key);
+    uint32_t d;
+
+    for (d = 1; dist[i] >= d; d++, i = (i + 1) & mask) {
+        if (dist[i] == d && table->compare(entries[i].key, key)
+            && (data == NULL || entries[i].data == data)) {
+            void *removed = (void *) entries[i].data;
+            uint32_t next = (i + 1) & mask;
+
+            /* Shift the rest of the cluster back by one slot */
+            while (dist[next] > 1) {
+                entries[i] = entries[next];
+                dist[i] = dist[next] - 1;
+                i = next;
+                next = (next + 1) & mask;
+            }
+            dist[i] = 0;
             table->kcount--;
-            return (void *) hl->data;
+            return removed;
         }
-        prev = hl;
     }
 
     /* It's not there */
@@ -355,34 +367,14 @@ removeHashTable(HashTable *table, StgWord key, const void *data)
 void
 freeHashTable(HashTable *table, void (*freeDataFun)(void *) )
 {
-    long segment;
-    long index;
-    HashList *hl;
-    HashList *next;
-    HashListChunk *cl, *cl_next;
-
-    /* The last bucket with something in it is table->max + table->split - 1 */
-    segment = (table->max + table->split - 1) / HSEGSIZE;
-    index = (table->max + table->split - 1) % HSEGSIZE;
-
-    while (segment >= 0) {
-        while (index >= 0) {
-            for (hl = table->dir[segment][index]; hl != NULL; hl = next) {
-                next = hl->next;
-                if (freeDataFun != NULL)
-                    (*freeDataFun)((void *) hl->data);
+    if (freeDataFun != NULL) {
+        for (uint32_t i = 0; i <= table->mask; i++) {
+            if (table->dist[i] != 0) {
+                (*freeDataFun)((void *) table->entries[i].data);
             }
-            index--;
         }
-        stgFree(table->dir[segment]);
-        segment--;
-        index = HSEGSIZE - 1;
-    }
-    for (cl = table->chunks; cl != NULL; cl = cl_next) {
-        cl_next = cl->next;
-        stgFree(cl->chunk);
-        stgFree(cl);
     }
+    stgFree(table->entries);
     stgFree(table);
 }
 
@@ -393,73 +385,39 @@ freeHashTable(HashTable *table, void (*freeDataFun)(void *) )
 void
 mapHashTable(HashTable *table, void *data, MapHashFn fn)
 {
-    long segment;
-    long index;
-    HashList *hl;
-
-    /* The last bucket with something in it is table->max + table->split - 1 */
-    segment = (table->max + table->split - 1) / HSEGSIZE;
-    index = (table->max + table->split - 1) % HSEGSIZE;
-
-    while (segment >= 0) {
-        while (index >= 0) {
-            for (hl = table->dir[segment][index]; hl != NULL; hl = hl->next) {
-                fn(data, hl->key, hl->data);
-            }
-            index--;
+    for (uint32_t i = 0; i <= table->mask; i++) {
+        if (table->dist[i] != 0) {
+            fn(data, table->entries[i].key, table->entries[i].data);
         }
-        segment--;
-        index = HSEGSIZE - 1;
     }
 }
 
 void
 iterHashTable(HashTable *table, void *data, IterHashFn fn)
 {
-    /* The last bucket with something in it is table->max + table->split - 1 */
-    long segment = (table->max + table->split - 1) / HSEGSIZE;
-    long index = (table->max + table->split - 1) % HSEGSIZE;
-
-    while (segment >= 0) {
-        while (index >= 0) {
-            for (HashList *hl = table->dir[segment][index]; hl != NULL; hl = hl->next) {
-                if (!fn(data, hl->key, hl->data)) {
-                    return;
-                }
+    for (uint32_t i = 0; i <= table->mask; i++) {
+        if (table->dist[i] != 0) {
+            if (!fn(data, table->entries[i].key, table->entries[i].data)) {
+                return;
             }
-            index--;
         }
-        segment--;
-        index = HSEGSIZE - 1;
     }
 }
 
 /* -----------------------------------------------------------------------------
- * When we initialize a hash table, we set up the first segment as well,
- * initializing all of the first segment's hash buckets to NULL.
+ * When we initialize a hash table, we allocate HMIN_SIZE empty slots.
  * -------------------------------------------------------------------------- */
 
 HashTable *
 allocHashTable_(HashFunction *hash, CompareFunction *compare)
 {
     HashTable *table;
-    HashList **hb;
 
     table = stgMallocBytes(sizeof(HashTable),"allocHashTable");
 
-    allocSegment(table, 0);
-
-    for (hb = table->dir[0]; hb < table->dir[0] + HSEGSIZE; hb++)
-        *hb = NULL;
+    allocSlots(table, HMIN_SIZE);
 
-    table->split = 0;
-    table->max = HSEGSIZE;
-    table->mask1 = HSEGSIZE - 1;
-    table->mask2 = 2 * HSEGSIZE - 1;
     table->kcount = 0;
-    table->bcount = HSEGSIZE;
-    table->freeList = NULL;
-    table->chunks = NULL;
     table->hash = hash;
     table->compare = compare;
 
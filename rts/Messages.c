@@ -23,10 +23,20 @@
 
 void sendMessage(Capability *from_cap, Capability *to_cap, Message *msg)
 {
+    sendMessages(from_cap, to_cap, msg, msg);
+}
+
+// Send the messages first..last, which are linked through their link
+// fields, taking to_cap's lock and waking it up only once for all of them.
+void sendMessages(Capability *from_cap, Capability *to_cap,
+                  Message *first, Message *last)
+{
+    Message *msg;
+
     ACQUIRE_LOCK(&to_cap->lock);
 
+    for (msg = first; ; msg = msg->link) {
 #if defined(DEBUG)
-    {
         const StgInfoTable *i = msg->header.info;
         if (i != &stg_MSG_THROWTO_info &&
             i != &stg_MSG_BLACKHOLE_info &&
@@ -35,13 +45,13 @@ void sendMessage(Capability *from_cap, Capability *to_cap, Message *msg)
             i != &stg_WHITEHOLE_info) {
             barf("sendMessage: %p", i);
         }
-    }
 #endif
+        recordClosureMutated(from_cap,(StgClosure*)msg);
+        if (msg == last) break;
+    }
 
-    msg->link = to_cap->inbox;
-    RELAXED_STORE(&to_cap->inbox, msg);
-
-    recordClosureMutated(from_cap,(StgClosure*)msg);
+    last->link = to_cap->inbox;
+    RELAXED_STORE(&to_cap->inbox, first);
 
     if (to_cap->running_task == NULL) {
         to_cap->running_task = myTask();
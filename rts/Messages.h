@@ -16,6 +16,8 @@ StgTSO * blackHoleOwner (StgClosure *bh);
 #if defined(THREADED_RTS)
 void executeMessage (Capability *cap, Message *m);
 void sendMessage    (Capability *from_cap, Capability *to_cap, Message *msg);
+void sendMessages   (Capability *from_cap, Capability *to_cap,
+                     Message *first, Message *last);
 #endif
 
 #include "Capability.h"
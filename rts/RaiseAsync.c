@@ -19,6 +19,7 @@
 #include "sm/Sanity.h"
 #include "Profiling.h"
 #include "Messages.h"
+#include "AwaitEvent.h"
 #if defined(mingw32_HOST_OS)
 #include "win32/IOManager.h"
 #endif
@@ -705,8 +706,10 @@ removeFromQueues(Capability *cap, StgTSO *tso)
   case BlockedOnWrite:
 #if defined(mingw32_HOST_OS)
   case BlockedOnDoProc:
-#endif
       removeThreadFromDeQueue(cap, &blocked_queue_hd, &blocked_queue_tl, tso);
+#else
+      removeThreadBlockedOnFd(cap, tso);
+#endif
 #if defined(mingw32_HOST_OS)
       /* (Cooperatively) signal that the worker thread should abort
        * the request.
@@ -716,7 +719,9 @@ removeFromQueues(Capability *cap, StgTSO *tso)
       goto done;
 
   case BlockedOnDelay:
-        removeThreadFromQueue(cap, &sleeping_queue, tso);
+#if !defined(mingw32_HOST_OS)
+        removeSleepingThread(tso);
+#endif
         goto done;
 #endif
 
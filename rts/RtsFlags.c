@@ -110,6 +110,8 @@ static bool read_heap_profiling_flag(const char *arg);
 
 #if defined(TRACING)
 static void read_trace_flags(const char *arg);
+static uint32_t read_sample_period(const char *arg, uint32_t offset,
+                                   bool *error);
 #endif
 
 static void errorUsage (void) GNU_ATTRIBUTE(__noreturn__);
@@ -158,8 +160,11 @@ void initRtsFlagsDefaults(void)
     RtsFlags.GcFlags.oldGenFactor       = 2;
     RtsFlags.GcFlags.useNonmoving       = false;
     RtsFlags.GcFlags.nonmovingSelectorOpt = false;
+    RtsFlags.GcFlags.nonmovingMarkThreads = 1;
+    RtsFlags.GcFlags.nonmovingLazySweep = false;
     RtsFlags.GcFlags.generations        = 2;
     RtsFlags.GcFlags.squeezeUpdFrames   = true;
+    RtsFlags.GcFlags.scavPrefetch       = false;
     RtsFlags.GcFlags.compact            = false;
     RtsFlags.GcFlags.compactThreshold   = 30.0;
     RtsFlags.GcFlags.sweep              = false;
@@ -171,6 +176,9 @@ void initRtsFlagsDefaults(void)
     RtsFlags.GcFlags.doIdleGC           = false;
 #endif
     RtsFlags.GcFlags.heapBase           = 0;   /* means don't care */
+    RtsFlags.GcFlags.hugePages          = false;
+    RtsFlags.GcFlags.returnMemoryRate   = 0;
+    RtsFlags.GcFlags.returnMemoryDelay  = 2;
     RtsFlags.GcFlags.allocLimitGrace    = (100*1024) / BLOCK_SIZE;
     RtsFlags.GcFlags.numa               = false;
     RtsFlags.GcFlags.numaMask           = 1;
@@ -229,6 +237,11 @@ void initRtsFlagsDefaults(void)
     RtsFlags.TraceFlags.sparks_full   = false;
     RtsFlags.TraceFlags.user          = false;
     RtsFlags.TraceFlags.trace_output  = NULL;
+    RtsFlags.TraceFlags.async_buffers = 0;
+    RtsFlags.TraceFlags.compress      = false;
+    RtsFlags.TraceFlags.ring_size     = 0;
+    RtsFlags.TraceFlags.sched_sample_period = 1;
+    RtsFlags.TraceFlags.spark_sample_period = 1;
 #endif
 
 #if defined(PROFILING)
@@ -248,6 +261,8 @@ void initRtsFlagsDefaults(void)
     RtsFlags.MiscFlags.internalCounters        = false;
     RtsFlags.MiscFlags.linkerAlwaysPic         = DEFAULT_LINKER_ALWAYS_PIC;
     RtsFlags.MiscFlags.linkerMemBase           = 0;
+    RtsFlags.MiscFlags.stmEscalateAborts       = 0;
+    RtsFlags.MiscFlags.stmIndexAfter           = 64;
 
 #if defined(THREADED_RTS)
     RtsFlags.ParFlags.nCapabilities     = 1;
@@ -259,6 +274,8 @@ void initRtsFlagsDefaults(void)
     RtsFlags.ParFlags.parGcNoSyncWithIdle   = 0;
     RtsFlags.ParFlags.parGcThreads      = 0; /* defaults to -N */
     RtsFlags.ParFlags.setAffinity       = 0;
+    RtsFlags.ParFlags.randomSparkSteal  = true;
+    RtsFlags.ParFlags.workRequests          = false;
 #endif
 
 #if defined(THREADED_RTS)
@@ -291,6 +308,17 @@ usage_text[] = {
 "            manage the oldest generation.",
 "  --copying-gc",
 "            Selects the copying garbage collector to manage all generations.",
+"  --gc-prefetch",
+"            Prefetch the objects which the copying garbage collector is",
+"            about to evacuate while scavenging",
+#if defined(THREADED_RTS)
+"  --nonmoving-mark-threads=<n>",
+"            Use <n> threads to mark and sweep the non-moving heap",
+"            (default: 1)",
+"  --nonmoving-lazy-sweep",
+"            Let allocation sweep non-moving segments which the collector",
+"            has not swept yet",
+#endif
 "",
 "  -K<size>  Sets the maximum stack size (default: 80% of the heap)",
 "            Egs: -K32k -K512k -K8M",
@@ -311,6 +339,15 @@ usage_text[] = {
 "  -xb<addr> Sets the address from which a suitable start for the heap memory",
 "            will be searched from. This is useful if the default address",
 "            clashes with some third-party library.",
+"  --return-memory-rate=<size>",
+"            Return surplus heap memory to the OS, at most <size> at a time",
+"            after each GC and while idle (default: never return memory)",
+"  --return-memory-delay=<n>",
+"            Only return memory which has been surplus for <n> consecutive",
+"            major GCs (default: 2)",
+"  --huge-pages",
+"            Reserve the heap in 2MB-aligned runs and ask the OS to back",
+"            it with transparent huge pages",
 "  -xn       Use the non-moving collector for the old generation.",
 "  -m<n>     Minimum % of heap which must be available (default 3%)",
 "  -G<n>     Number of generations (default: 2)",
@@ -375,6 +412,22 @@ usage_text[] = {
 #if defined(TRACING)
 "",
 "  -ol<file>  Send binary eventlog to <file> (default: <program>.eventlog)",
+"  --eventlog-compress",
+"             Compress the eventlog (default file: <program>.eventlog.lz)",
+"  --eventlog-sample-sched=<n>",
+"             Log only about 1 in <n> scheduler events (default: 1)",
+"  --eventlog-sample-sparks=<n>",
+"             Log only about 1 in <n> spark events (default: 1)",
+#  if !defined(mingw32_HOST_OS)
+"  --eventlog-ring=<size>",
+"             Write the eventlog into a shared ring buffer of <size> bytes",
+"             for live monitoring (default file: <program>.eventlog.ring)",
+#  endif
+#  if defined(THREADED_RTS)
+"  --eventlog-async-buffers=<n>",
+"             Write the eventlog from a background thread, with <n> spare",
+"             buffers per capability (default: 0, write synchronously)",
+#  endif
 "  -l[flags]  Log events to a file",
 #  if defined(DEBUG)
 "  -v[flags]  Log events to stderr",
@@ -403,6 +456,12 @@ usage_text[] = {
 "  -C<secs>  Context-switch interval in seconds.",
 "            0 or no argument means switch as often as possible.",
 "            Default: 0.02 sec.",
+"  --stm-escalate-after=<n>",
+"            Run an STM transaction serialised after it has failed to",
+"            commit <n> times in a row (default: 0, never)",
+"  --stm-index-after=<n>",
+"            Index the entries of an STM transaction once looking up a TVar",
+"            has scanned <n> of them (default: 64, 0 means never)",
 "  -V<secs>  Master tick interval in seconds (0 == disable timer).",
 "            This sets the resolution for -C and the heap profile timer -i,",
 "            and is the frequency of time profile samples.",
@@ -448,6 +507,8 @@ usage_text[] = {
 "  -qn<n>    Use <n> threads for parallel GC (defaults to value of -N)",
 "  -qa       Use the OS to set thread affinity (experimental)",
 "  -qm       Don't automatically migrate threads between CPUs",
+"  -qs       Steal sparks one at a time, visiting capabilities in order",
+"  -qp       Give threads only to idle capabilities that ask for work",
 "  -qi<n>    If a processor has been idle for the last <n> GCs, do not",
 "            wake it up for a non-load-balancing parallel GC.",
 "            (0 disables,  default: 0)",
@@ -928,6 +989,36 @@ error = true;
                       OPTION_UNSAFE;
                       RtsFlags.MiscFlags.disableDelayedOsMemoryReturn = true;
                   }
+                  else if (!strncmp("return-memory-rate=",
+                                    &rts_argv[arg][2], 19)) {
+                      OPTION_UNSAFE;
+                      RtsFlags.GcFlags.returnMemoryRate = (uint32_t)
+                          ((decodeSize(rts_argv[arg], 21, 0, HS_WORD_MAX)
+                            + MBLOCK_SIZE - 1) / MBLOCK_SIZE);
+                  }
+                  else if (!strncmp("return-memory-delay=",
+                                    &rts_argv[arg][2], 20)) {
+                      OPTION_UNSAFE;
+                      int delay = strtol(rts_argv[arg]+22, (char **) NULL, 10);
+                      if (delay <= 0) {
+                          errorBelch("%s: delay must be at least 1",
+                                     rts_argv[arg]);
+                          error = true;
+                      } else {
+                          RtsFlags.GcFlags.returnMemoryDelay = delay;
+                      }
+                  }
+                  else if (strequal("huge-pages",
+                               &rts_argv[arg][2])) {
+                      OPTION_UNSAFE;
+#if defined(USE_LARGE_ADDRESS_SPACE)
+                      RtsFlags.GcFlags.hugePages = true;
+#else
+                      errorBelch("%s: huge pages are not supported on this platform",
+                                 rts_argv[arg]);
+                      error = true;
+#endif
+                  }
                   else if (strequal("internal-counters",
                                     &rts_argv[arg][2])) {
                       OPTION_SAFE;
@@ -949,7 +1040,104 @@ error = true;
                       OPTION_SAFE;
                       RtsFlags.GcFlags.useNonmoving = true;
                   }
+                  else if (strequal("eventlog-compress",
+                               &rts_argv[arg][2])) {
+                      OPTION_SAFE;
+                      TRACING_BUILD_ONLY(
+                          RtsFlags.TraceFlags.compress = true;
+                      );
+                  }
+                  else if (!strncmp("eventlog-sample-sched=",
+                                    &rts_argv[arg][2], 22)) {
+                      OPTION_SAFE;
+                      TRACING_BUILD_ONLY(
+                          RtsFlags.TraceFlags.sched_sample_period =
+                              read_sample_period(rts_argv[arg], 24, &error);
+                      );
+                  }
+                  else if (!strncmp("eventlog-sample-sparks=",
+                                    &rts_argv[arg][2], 23)) {
+                      OPTION_SAFE;
+                      TRACING_BUILD_ONLY(
+                          RtsFlags.TraceFlags.spark_sample_period =
+                              read_sample_period(rts_argv[arg], 25, &error);
+                      );
+                  }
+                  else if (!strncmp("eventlog-ring=",
+                                    &rts_argv[arg][2], 14)) {
+                      OPTION_SAFE;
+#if defined(mingw32_HOST_OS)
+                      errorBelch("%s: not supported on Windows", rts_argv[arg]);
+                      error = true;
+#else
+                      TRACING_BUILD_ONLY(
+                          RtsFlags.TraceFlags.ring_size =
+                              decodeSize(rts_argv[arg], 16, 4 * 1024 * 1024,
+                                         (StgWord64)1 << 40);
+                      );
+#endif
+                  }
+                  else if (!strncmp("stm-escalate-after=",
+                                    &rts_argv[arg][2], 19)) {
+                      OPTION_SAFE;
+                      int n = strtol(rts_argv[arg]+21, (char **) NULL, 10);
+                      if (n < 0) {
+                          errorBelch("%s: number of failed commits must not be negative",
+                                     rts_argv[arg]);
+                          error = true;
+                      } else {
+                          RtsFlags.MiscFlags.stmEscalateAborts = n;
+                      }
+                  }
+                  else if (!strncmp("stm-index-after=",
+                                    &rts_argv[arg][2], 16)) {
+                      OPTION_SAFE;
+                      int n = strtol(rts_argv[arg]+18, (char **) NULL, 10);
+                      if (n < 0) {
+                          errorBelch("%s: number of entries must not be negative",
+                                     rts_argv[arg]);
+                          error = true;
+                      } else {
+                          RtsFlags.MiscFlags.stmIndexAfter = n;
+                      }
+                  }
+                  else if (strequal("gc-prefetch",
+                               &rts_argv[arg][2])) {
+                      OPTION_SAFE;
+                      RtsFlags.GcFlags.scavPrefetch = true;
+                  }
 #if defined(THREADED_RTS)
+                  else if (!strncmp("nonmoving-mark-threads=",
+                                    &rts_argv[arg][2], 23)) {
+                      OPTION_SAFE;
+                      int threads = strtol(rts_argv[arg]+25, (char **) NULL, 10);
+                      if (threads <= 0) {
+                          errorBelch("%s: number of mark threads must be at least 1",
+                                     rts_argv[arg]);
+                          error = true;
+                      } else {
+                          RtsFlags.GcFlags.nonmovingMarkThreads = threads;
+                      }
+                  }
+                  else if (strequal("nonmoving-lazy-sweep",
+                               &rts_argv[arg][2])) {
+                      OPTION_SAFE;
+                      RtsFlags.GcFlags.nonmovingLazySweep = true;
+                  }
+                  else if (!strncmp("eventlog-async-buffers=",
+                                    &rts_argv[arg][2], 23)) {
+                      OPTION_SAFE;
+                      TRACING_BUILD_ONLY(
+                          int n = strtol(rts_argv[arg]+25, (char **) NULL, 10);
+                          if (n < 0) {
+                              errorBelch("%s: number of buffers must not be negative",
+                                         rts_argv[arg]);
+                              error = true;
+                          } else {
+                              RtsFlags.TraceFlags.async_buffers = n;
+                          }
+                      );
+                  }
                   else if (!strncmp("numa", &rts_argv[arg][2], 4)) {
                       if (!osBuiltWithNumaSupport()) {
                           errorBelch("%s: This GHC build was compiled without NUMA support.",
@@ -1455,6 +1643,12 @@ error = true;
                     case 'm':
                         RtsFlags.ParFlags.migrate = false;
                         break;
+                    case 's':
+                        RtsFlags.ParFlags.randomSparkSteal = false;
+                        break;
+                    case 'p':
+                        RtsFlags.ParFlags.workRequests = true;
+                        break;
                     case 'w':
                         // -qw was removed; accepted for backwards compat
                         break;
@@ -2122,6 +2316,19 @@ static bool read_heap_profiling_flag(const char *arg)
 #endif
 
 #if defined(TRACING)
+static uint32_t read_sample_period(const char *arg, uint32_t offset,
+                                   bool *error)
+{
+    long n = strtol(arg + offset, (char **) NULL, 10);
+    if (n < 1 || n > 1000000) {
+        errorBelch("%s: the sampling period must be between 1 and 1000000",
+                   arg);
+        *error = true;
+        return 1;
+    }
+    return (uint32_t)n;
+}
+
 static void read_trace_flags(const char *arg)
 {
     const char *c;
@@ -653,6 +653,8 @@
       SymI_HasProto(freeFullProgArgv)                                   \
       SymI_HasProto(getProcessElapsedTime)                              \
       SymI_HasProto(getStablePtr)                                       \
+      SymI_HasProto(getStablePtrs)                                      \
+      SymI_HasProto(freeStablePtrs)                                     \
       SymI_HasProto(registerForeignExports)                             \
       SymI_HasProto(hs_init)                                            \
       SymI_HasProto(hs_init_with_rtsopts)                               \
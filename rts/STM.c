@@ -86,6 +86,7 @@
 #include "PosixSource.h"
 #include "Rts.h"
 
+#include "Messages.h"
 #include "RtsUtils.h"
 #include "Schedule.h"
 #include "STM.h"
@@ -95,6 +96,7 @@
 #include "SMPClosureOps.h"
 
 #include <stdio.h>
+#include <string.h>
 
 // ACQ_ASSERT is used for assertions which are only required for
 // THREADED_RTS builds with fine-grained locking.
@@ -345,32 +347,72 @@ static void park_tso(StgTSO *tso) {
   TRACE("park_tso on tso=%p", tso);
 }
 
-static void unpark_tso(Capability *cap, StgTSO *tso) {
+/* Note [Batched STM wakeups]
+ * ~~~~~~~~~~~~~~~~~~~~~~~~~~~
+ * A commit wakes up every thread on the watch queue of each TVar that it
+ * updates.  When many threads are blocked in retry on the same TVar, or a
+ * thread waits on several TVars that are updated together, we used to send
+ * a wakeup for every (TVar, thread) pair, and again on every later commit
+ * until the thread had run and taken itself off the watch queues (#15626).
+ *
+ * Now a parked thread has tso->block_info.closure == END_TSO_QUEUE (see
+ * park_tso), and the first commit to wake it swings that to STM_AWOKEN with
+ * a CAS.  Later commits see STM_AWOKEN and leave the thread alone.  This is
+ * safe because the thread can only park again while holding the locks on
+ * all the TVars it waits for (stmWait, stmReWait), so a commit that skipped
+ * it must have updated its TVar before it re-validates.  tryWakeupThread
+ * sets STM_AWOKEN itself, so nothing changes on the receiving side.
+ *
+ * Threads on our own capability are woken straight away.  For the others
+ * we build one MSG_TRY_WAKEUP per thread but keep them in a list until the
+ * commit has released its TVars, then hand all the messages for each
+ * capability over with a single sendMessages, which takes the target's
+ * lock and interrupts it once rather than once per thread.
+ *
+ * The watch queue entries of the woken threads go back to the free list of
+ * the capability they run on when they take themselves off the queues, and
+ * are reused from there by the next stmWait on that capability.
+ */
+
+static void unpark_tso(Capability *cap, StgTSO *tso,
+                       Message **pending USED_IF_THREADS) {
     // We will continue unparking threads while they remain on one of the wait
     // queues: it's up to the thread itself to remove it from the wait queues
     // if it decides to do so when it is scheduled.
 
-    // Only the capability that owns this TSO may unblock it. We can
-    // call tryWakeupThread() which will either unblock it directly if
-    // it belongs to this cap, or send a message to the owning cap
-    // otherwise.
-
-    // TODO: This sends multiple messages if we write to the same TVar multiple
-    // times and the owning cap hasn't yet woken up the thread and removed it
-    // from the TVar's watch list. We tried to optimise this in D4961, but that
-    // patch was incorrect and broke other things, see #15544 comment:17. See
-    // #15626 for the tracking ticket.
-
     // Safety Note: we hold the TVar lock at this point, so we know
     // that this thread is definitely still blocked, since the first
     // thing a thread will do when it runs is remove itself from the
     // TVar watch queues, and to do that it would need to lock the
     // TVar.
 
+    // Don't wake the thread if another commit already has.
+    // See Note [Batched STM wakeups].
+    if (cas((StgVolatilePtr)&tso->block_info.closure,
+            (StgWord)END_TSO_QUEUE,
+            (StgWord)&stg_STM_AWOKEN_closure) != (StgWord)END_TSO_QUEUE) {
+        TRACE("unpark_tso on tso=%p: already awoken", tso);
+        return;
+    }
+
+    // Only the capability that owns this TSO may unblock it.
+#if defined(THREADED_RTS)
+    if (tso->cap != cap) {
+        MessageWakeup *msg;
+        traceEventThreadWakeup(cap, tso, tso->cap->no);
+        msg = (MessageWakeup *)allocate(cap, sizeofW(MessageWakeup));
+        SET_HDR(msg, &stg_MSG_TRY_WAKEUP_info, CCS_SYSTEM);
+        msg->tso = tso;
+        msg->link = *pending;
+        *pending = (Message *)msg;
+        return;
+    }
+#endif
+
     tryWakeupThread(cap,tso);
 }
 
-static void unpark_waiters_on(Capability *cap, StgTVar *s) {
+static void unpark_waiters_on(Capability *cap, StgTVar *s, Message **pending) {
   StgTVarWatchQueue *q;
   StgTVarWatchQueue *trail;
   TRACE("unpark_waiters_on tvar=%p", s);
@@ -384,10 +426,37 @@ static void unpark_waiters_on(Capability *cap, StgTVar *s) {
   for (;
        q != END_STM_WATCH_QUEUE;
        q = q -> prev_queue_entry) {
-      unpark_tso(cap, (StgTSO *)(q -> closure));
+      unpark_tso(cap, (StgTSO *)(q -> closure), pending);
   }
 }
 
+// Send the wakeups collected by unpark_tso, one batch per capability
+static void send_wakeups(Capability *cap USED_IF_THREADS,
+                         Message *pending USED_IF_THREADS) {
+#if defined(THREADED_RTS)
+  while (pending != NULL) {
+    Capability *to = ((MessageWakeup *)pending) -> tso -> cap;
+    Message *first = NULL, *last = NULL, *rest = NULL, *next;
+    for (Message *m = pending; m != NULL; m = next) {
+      next = m -> link;
+      if (((MessageWakeup *)m) -> tso -> cap == to) {
+        if (first == NULL) {
+          last = m;
+        }
+        m -> link = first;
+        first = m;
+      } else {
+        m -> link = rest;
+        rest = m;
+      }
+    }
+    TRACE("sending wakeups to cap %d", to -> no);
+    sendMessages(cap, to, first, last);
+    pending = rest;
+  }
+#endif
+}
+
 /*......................................................................*/
 
 // Helper functions for downstream allocation and initialization
@@ -418,6 +487,7 @@ static StgTRecHeader *new_stg_trec_header(Capability *cap,
 
   result -> enclosing_trec = enclosing_trec;
   result -> current_chunk = new_stg_trec_chunk(cap);
+  result -> index = NO_TREC_INDEX;
 
   if (enclosing_trec == NO_TREC) {
     result -> state = TREC_ACTIVE;
@@ -487,6 +557,7 @@ static StgTRecHeader *alloc_stg_trec_header(Capability *cap,
     cap -> free_trec_headers = result -> enclosing_trec;
     result -> enclosing_trec = enclosing_trec;
     result -> current_chunk -> next_entry_idx = 0;
+    result -> index = NO_TREC_INDEX;
     if (enclosing_trec == NO_TREC) {
       result -> state = TREC_ACTIVE;
     } else {
@@ -508,6 +579,8 @@ static void free_stg_trec_header(Capability *cap,
     chunk = prev_chunk;
   }
   trec -> current_chunk -> prev_chunk = END_STM_CHUNK_LIST;
+  // Don't keep a large index alive while the header is on the free list
+  trec -> index = NO_TREC_INDEX;
   trec -> enclosing_trec = cap -> free_trec_headers;
   cap -> free_trec_headers = trec;
 #endif
@@ -618,6 +691,173 @@ static TRecEntry *get_new_entry(Capability *cap,
 
 /*......................................................................*/
 
+/* Note [TRec indexes]
+ * ~~~~~~~~~~~~~~~~~~~
+ * Looking up the entry for a TVar in a TRec means walking its chunks, so a
+ * transaction that touches n TVars takes O(n^2) time.  To avoid this, once a
+ * lookup has scanned +RTS --stm-index-after entries (64 by default) without
+ * finding its TVar, we build a hash index over the TRec's entries and use it
+ * for every later lookup in that TRec.
+ *
+ * The index is an ARR_WORDS pointed to by trec->index (NO_TREC_INDEX if
+ * there is none) holding a TRecIndex: an open-addressing table of pointers
+ * to the entries, hashed on the address of their TVar and kept at most half
+ * full.  Entries are never removed from a TRec and are only added at the end
+ * of its current chunk, so rather than hooking every place that adds an
+ * entry, the index remembers how far into the chunk list it has got and
+ * catches up at the start of each lookup.
+ *
+ * The table holds addresses of heap objects that the GC does not know
+ * about, so a GC invalidates it.  Each index records the stm_gc_epoch it was
+ * built in; markSTM bumps the epoch at every GC and a lookup in an index
+ * from an older epoch rebuilds it, reusing the array if it is big enough.
+ *
+ * A TRec header going back on its capability's free list drops its index,
+ * so that the free list doesn't keep a large array alive.
+ */
+
+#define TREC_INDEX_MIN_SLOTS 256
+
+typedef struct {
+  StgWord gc_epoch;         // stm_gc_epoch when the index was built
+  StgTRecChunk *chunk;      // entries before (chunk, idx) are in the table
+  StgWord idx;
+  StgWord n_entries;
+  StgWord mask;             // number of slots - 1
+  TRecEntry *slots[];
+} TRecIndex;
+
+static StgWord stm_gc_epoch = 0;
+
+static TRecIndex *trec_index(StgTRecHeader *trec) {
+  return (TRecIndex *)trec -> index -> payload;
+}
+
+static StgWord hash_tvar(StgTVar *tvar) {
+  StgWord h = (StgWord)tvar >> 3;
+  h ^= h >> 17;
+  h *= 0x9e3779b1;
+  h ^= h >> 15;
+  return h;
+}
+
+// The number of entries of trec that have not been added to ix yet
+static StgWord unindexed_entries(TRecIndex *ix, StgTRecHeader *trec) {
+  StgTRecChunk *c = trec -> current_chunk;
+  StgWord limit = c -> next_entry_idx;
+  StgWord n = 0;
+  while (c != END_STM_CHUNK_LIST) {
+    if (c == ix -> chunk) {
+      return n + limit - ix -> idx;
+    }
+    n += limit;
+    c = c -> prev_chunk;
+    limit = TREC_CHUNK_NUM_ENTRIES;
+  }
+  return n;
+}
+
+static void catch_up_index(TRecIndex *ix, StgTRecHeader *trec) {
+  StgTRecChunk *c = trec -> current_chunk;
+  StgWord limit = c -> next_entry_idx;
+  while (c != END_STM_CHUNK_LIST) {
+    StgWord start = (c == ix -> chunk) ? ix -> idx : 0;
+    for (StgWord i = start; i < limit; i++) {
+      TRecEntry *e = &c -> entries[i];
+      StgWord j = hash_tvar(e -> tvar) & ix -> mask;
+      while (ix -> slots[j] != NULL) {
+        j = (j + 1) & ix -> mask;
+      }
+      ix -> slots[j] = e;
+      ix -> n_entries ++;
+    }
+    if (c == ix -> chunk) {
+      break;
+    }
+    c = c -> prev_chunk;
+    limit = TREC_CHUNK_NUM_ENTRIES;
+  }
+  ix -> chunk = trec -> current_chunk;
+  ix -> idx = trec -> current_chunk -> next_entry_idx;
+}
+
+static TRecIndex *build_index(Capability *cap, StgTRecHeader *trec) {
+  TRecIndex *ix;
+  StgWord n_entries = 0;
+  StgWord n_slots = TREC_INDEX_MIN_SLOTS;
+
+  for (StgTRecChunk *c = trec -> current_chunk;
+       c != END_STM_CHUNK_LIST;
+       c = c -> prev_chunk) {
+    n_entries += (c == trec -> current_chunk)
+      ? c -> next_entry_idx : TREC_CHUNK_NUM_ENTRIES;
+  }
+  // leave room for the index to grow to twice its size before rebuilding
+  while (n_slots < 4 * n_entries) {
+    n_slots *= 2;
+  }
+
+  if (trec -> index != NO_TREC_INDEX && trec_index(trec) -> mask + 1 >= n_slots) {
+    ix = trec_index(trec);
+    n_slots = ix -> mask + 1;
+  } else {
+    StgWord words = sizeofW(TRecIndex) + n_slots;
+    StgArrBytes *arr;
+    arr = (StgArrBytes *)allocate(cap, sizeofW(StgArrBytes) + words);
+    SET_HDR(arr, &stg_ARR_WORDS_info, CCS_SYSTEM);
+    arr -> bytes = words * sizeof(W_);
+    trec -> index = arr;
+    ix = trec_index(trec);
+    ix -> mask = n_slots - 1;
+  }
+  TRACE("%p : indexing %" FMT_Word " entries in %" FMT_Word " slots",
+        trec, n_entries, n_slots);
+
+  memset(ix -> slots, 0, n_slots * sizeof(TRecEntry *));
+  ix -> gc_epoch = stm_gc_epoch;
+  ix -> chunk = END_STM_CHUNK_LIST;
+  ix -> idx = 0;
+  ix -> n_entries = 0;
+  catch_up_index(ix, trec);
+  return ix;
+}
+
+// Find the entry for tvar in trec, ignoring any enclosing transactions
+static TRecEntry *find_entry(Capability *cap, StgTRecHeader *trec, StgTVar *tvar) {
+  TRecEntry *result = NULL;
+
+  if (trec -> index != NO_TREC_INDEX) {
+    TRecIndex *ix = trec_index(trec);
+    if (ix -> gc_epoch != stm_gc_epoch ||
+        2 * (ix -> n_entries + unindexed_entries(ix, trec)) > ix -> mask + 1) {
+      ix = build_index(cap, trec);
+    } else {
+      catch_up_index(ix, trec);
+    }
+    StgWord j = hash_tvar(tvar) & ix -> mask;
+    while ((result = ix -> slots[j]) != NULL && result -> tvar != tvar) {
+      j = (j + 1) & ix -> mask;
+    }
+    return result;
+  }
+
+  StgWord scanned = 0;
+  FOR_EACH_ENTRY(trec, e, {
+    if (e -> tvar == tvar) {
+      result = e;
+      BREAK_FOR_EACH;
+    }
+    scanned ++;
+  });
+  uint32_t index_after = RtsFlags.MiscFlags.stmIndexAfter;
+  if (result == NULL && index_after != 0 && scanned >= index_after) {
+    build_index(cap, trec);
+  }
+  return result;
+}
+
+/*......................................................................*/
+
 static void merge_update_into(Capability *cap,
                               StgTRecHeader *t,
                               StgTVar *tvar,
@@ -625,24 +865,16 @@ static void merge_update_into(Capability *cap,
                               StgClosure *new_value)
 {
   // Look for an entry in this trec
-  bool found = false;
-  FOR_EACH_ENTRY(t, e, {
-    StgTVar *s;
-    s = e -> tvar;
-    if (s == tvar) {
-      found = true;
-      if (e -> expected_value != expected_value) {
-        // Must abort if the two entries start from different values
-        TRACE("%p : update entries inconsistent at %p (%p vs %p)",
-              t, tvar, e -> expected_value, expected_value);
-        t -> state = TREC_CONDEMNED;
-      }
-      e -> new_value = new_value;
-      BREAK_FOR_EACH;
+  TRecEntry *e = find_entry(cap, t, tvar);
+  if (e != NULL) {
+    if (e -> expected_value != expected_value) {
+      // Must abort if the two entries start from different values
+      TRACE("%p : update entries inconsistent at %p (%p vs %p)",
+            t, tvar, e -> expected_value, expected_value);
+      t -> state = TREC_CONDEMNED;
     }
-  });
-
-  if (!found) {
+    e -> new_value = new_value;
+  } else {
     // No entry so far in this trec
     TRecEntry *ne;
     ne = get_new_entry(cap, t);
@@ -685,18 +917,16 @@ static void merge_read_into(Capability *cap,
   //
   for (t = trec; !found && t != NO_TREC; t = t -> enclosing_trec)
   {
-    FOR_EACH_ENTRY(t, e, {
-      if (e -> tvar == tvar) {
-        found = true;
-        if (e -> expected_value != expected_value) {
-            // Must abort if the two entries start from different values
-            TRACE("%p : read entries inconsistent at %p (%p vs %p)",
-                  t, tvar, e -> expected_value, expected_value);
-            t -> state = TREC_CONDEMNED;
-        }
-        BREAK_FOR_EACH;
+    TRecEntry *e = find_entry(cap, t, tvar);
+    if (e != NULL) {
+      found = true;
+      if (e -> expected_value != expected_value) {
+          // Must abort if the two entries start from different values
+          TRACE("%p : read entries inconsistent at %p (%p vs %p)",
+                t, tvar, e -> expected_value, expected_value);
+          t -> state = TREC_CONDEMNED;
       }
-    });
+    }
   }
 
   if (!found) {
@@ -899,18 +1129,17 @@ void stmPreGCHook (Capability *cap) {
 
 static volatile StgInt64 max_commits = 0;
 
-static volatile StgWord token_locked = false;
-
 static StgInt64 getMaxCommits(void) {
   return RELAXED_LOAD(&max_commits);
 }
 
+// All that check_read_only needs is that max_commits never lags behind the
+// tokens handed out, so a single atomic add is enough; there is no need to
+// serialise the capabilities taking batches.
 static void getTokenBatch(Capability *cap) {
-  while (cas((void *)&token_locked, false, true) == true) { /* nothing */ }
-  NONATOMIC_ADD(&max_commits, TOKEN_BATCH_SIZE);
-  TRACE("%p : cap got token batch, max_commits=%" FMT_Int64, cap, RELAXED_LOAD(&max_commits));
+  StgInt64 new_max STG_UNUSED = SEQ_CST_ADD(&max_commits, TOKEN_BATCH_SIZE);
+  TRACE("%p : cap got token batch, max_commits=%" FMT_Int64, cap, new_max);
   cap -> transaction_tokens = TOKEN_BATCH_SIZE;
-  RELEASE_STORE(&token_locked, false);
 }
 
 static void getToken(Capability *cap) {
@@ -931,6 +1160,134 @@ static void getToken(Capability *cap STG_UNUSED) {
 
 /*......................................................................*/
 
+/* Note [STM contention management]
+ * ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+ * When a top-level transaction fails to commit, the atomically frame simply
+ * runs it again.  Under heavy contention this can go wrong in two ways:
+ * transactions that conflict with each other keep re-running in lock step,
+ * and a long transaction can be starved forever by a stream of short ones
+ * that commit to the TVars it has read.
+ *
+ * We deal with the first by backing off before the re-run: a transaction
+ * that has failed to commit n times in a row spins for a random number of
+ * iterations below STM_BACKOFF_UNIT << min(n - 1, STM_BACKOFF_MAX_SHIFT).
+ * The randomness comes from a per-capability xorshift generator.  We only
+ * back off in the threaded RTS with more than one capability: otherwise
+ * nobody can make progress while we spin.
+ *
+ * We deal with the second by counting the consecutive failed commits of each
+ * thread in tso->stm_aborts.  Once the count reaches the limit given by
+ * +RTS --stm-escalate-after=<n>, stmStartTransaction tries to make the next
+ * attempt *serialised* by installing its TRec in stm_serial_trec.  While
+ * stm_serial_trec is set, every other top-level transaction that updates a
+ * TVar fails its commit (after validating, so it still counts as a failed
+ * attempt and backs off), so nothing can invalidate the serialised
+ * transaction except commits that were already past that check when it
+ * started.  Read-only transactions cannot invalidate it, so they commit as
+ * usual.  If it nevertheless fails, it gives up the token and takes it again
+ * for its next attempt.
+ *
+ * The token is released when the serialised transaction commits, fails to
+ * commit, aborts (e.g. because of an exception) or blocks in retry, so it
+ * cannot outlive the transaction.  stm_serial_trec points into the heap, so
+ * it is a GC root: see markSTM, called by markScheduler.
+ *
+ * The counts of commits, failed commits and serialised attempts are kept
+ * per capability and summed up by getRTSStats.
+ */
+
+#define STM_BACKOFF_UNIT 64
+#define STM_BACKOFF_MAX_SHIFT 10
+
+static StgTRecHeader *stm_serial_trec = NO_TREC;
+
+void markSTM(evac_fn evac, void *user) {
+  // The GC may move TVars and TRec entries; see Note [TRec indexes]
+  stm_gc_epoch ++;
+
+  if (stm_serial_trec != NO_TREC) {
+    evac(user, (StgClosure **)(void *)&stm_serial_trec);
+  }
+}
+
+// true if some other transaction is currently running serialised
+static bool serialised_elsewhere(StgTRecHeader *trec) {
+  StgTRecHeader *serial = ACQUIRE_LOAD(&stm_serial_trec);
+  return serial != NO_TREC && serial != trec;
+}
+
+// true if the transaction updates no TVar, so that committing it can't
+// invalidate any other transaction
+static bool trec_is_read_only(StgTRecHeader *trec) {
+  bool read_only = true;
+  FOR_EACH_ENTRY(trec, e, {
+    if (e -> new_value != e -> expected_value) {
+      read_only = false;
+      BREAK_FOR_EACH;
+    }
+  });
+  return read_only;
+}
+
+static void try_serialise(Capability *cap, StgTRecHeader *trec) {
+  uint32_t limit = RtsFlags.MiscFlags.stmEscalateAborts;
+  if (limit != 0 && cap->r.rCurrentTSO->stm_aborts >= limit &&
+      cas((StgVolatilePtr)&stm_serial_trec,
+          (StgWord)NO_TREC, (StgWord)trec) == (StgWord)NO_TREC) {
+    TRACE("%p : running serialised after %d failed commits",
+          trec, cap->r.rCurrentTSO->stm_aborts);
+    cap->stm_serialised++;
+  }
+}
+
+static void end_serialised(StgTRecHeader *trec) {
+  if (RELAXED_LOAD(&stm_serial_trec) == trec) {
+    RELEASE_STORE(&stm_serial_trec, NO_TREC);
+  }
+}
+
+#if defined(THREADED_RTS)
+static void backoff(Capability *cap, uint32_t aborts) {
+  if (n_capabilities == 1) {
+    return;
+  }
+  uint32_t x = cap->stm_backoff_rng;
+  x ^= x << 13;
+  x ^= x >> 17;
+  x ^= x << 5;
+  cap->stm_backoff_rng = x;
+
+  uint32_t shift = stg_min(aborts - 1, STM_BACKOFF_MAX_SHIFT);
+  uint32_t spins = x & ((STM_BACKOFF_UNIT << shift) - 1);
+  for (uint32_t i = 0; i < spins; i++) {
+    busy_wait_nop();
+  }
+}
+#else
+static void backoff(Capability *cap STG_UNUSED, uint32_t aborts STG_UNUSED) {
+  // Nothing
+}
+#endif
+
+// Called at the end of each attempt to commit a top-level transaction
+static void end_attempt(Capability *cap, StgTRecHeader *trec, bool committed) {
+  StgTSO *tso = cap->r.rCurrentTSO;
+
+  end_serialised(trec);
+  if (committed) {
+    cap->stm_commits++;
+    tso->stm_aborts = 0;
+  } else {
+    cap->stm_aborts++;
+    if (tso->stm_aborts < UINT32_MAX) {
+      tso->stm_aborts++;
+    }
+    backoff(cap, tso->stm_aborts);
+  }
+}
+
+/*......................................................................*/
+
 StgTRecHeader *stmStartTransaction(Capability *cap,
                                    StgTRecHeader *outer) {
   StgTRecHeader *t;
@@ -941,6 +1298,9 @@ StgTRecHeader *stmStartTransaction(Capability *cap,
   getToken(cap);
 
   t = alloc_stg_trec_header(cap, outer);
+  if (outer == NO_TREC) {
+    try_serialise(cap, t);
+  }
   TRACE("%p : stmStartTransaction()=%p", outer, t);
   return t;
 }
@@ -983,6 +1343,10 @@ void stmAbortTransaction(Capability *cap,
   trec -> state = TREC_ABORTED;
   unlock_stm(trec);
 
+  if (et == NO_TREC) {
+    end_serialised(trec);
+  }
+
   TRACE("%p : stmAbortTransaction done", trec);
 }
 
@@ -1054,22 +1418,18 @@ StgBool stmValidateNestOfTransactions(Capability *cap, StgTRecHeader *trec) {
 
 /*......................................................................*/
 
-static TRecEntry *get_entry_for(StgTRecHeader *trec, StgTVar *tvar, StgTRecHeader **in) {
+static TRecEntry *get_entry_for(Capability *cap, StgTRecHeader *trec,
+                                StgTVar *tvar, StgTRecHeader **in) {
   TRecEntry *result = NULL;
 
   TRACE("%p : get_entry_for TVar %p", trec, tvar);
   ASSERT(trec != NO_TREC);
 
   do {
-    FOR_EACH_ENTRY(trec, e, {
-      if (e -> tvar == tvar) {
-        result = e;
-        if (in != NULL) {
-          *in = trec;
-        }
-        BREAK_FOR_EACH;
-      }
-    });
+    result = find_entry(cap, trec, tvar);
+    if (result != NULL && in != NULL) {
+      *in = trec;
+    }
     trec = trec -> enclosing_trec;
   } while (result == NULL && trec != NO_TREC);
 
@@ -1113,12 +1473,20 @@ StgBool stmCommitTransaction(Capability *cap, StgTRecHeader *trec) {
       }
     }
 
+    if (result && serialised_elsewhere(trec) && !trec_is_read_only(trec)) {
+      // Another transaction is running serialised: let it commit first.
+      // See Note [STM contention management].
+      TRACE("%p : another transaction is running serialised", trec);
+      result = false;
+    }
+
     if (result) {
       // We now know that all of the read-only locations held their expected values
       // at the end of the call to validate_and_acquire_ownership.  This forms the
       // linearization point of the commit.
 
       // Make the updates required by the transaction.
+      Message *pending_wakeups = NULL;
       FOR_EACH_ENTRY(trec, e, {
         StgTVar *s;
         s = e -> tvar;
@@ -1128,7 +1496,7 @@ StgBool stmCommitTransaction(Capability *cap, StgTRecHeader *trec) {
 
           ACQ_ASSERT(tvar_is_locked(s, trec));
           TRACE("%p : writing %p to %p, waking waiters", trec, e -> new_value, s);
-          unpark_waiters_on(cap,s);
+          unpark_waiters_on(cap, s, &pending_wakeups);
           IF_STM_FG_LOCKS({
             // We have locked the TVar therefore nonatomic addition is sufficient
             NONATOMIC_ADD(&s->num_updates, 1);
@@ -1137,6 +1505,7 @@ StgBool stmCommitTransaction(Capability *cap, StgTRecHeader *trec) {
         }
         ACQ_ASSERT(!tvar_is_locked(s, trec));
       });
+      send_wakeups(cap, pending_wakeups);
     } else {
         revert_ownership(cap, trec, false);
     }
@@ -1144,6 +1513,8 @@ StgBool stmCommitTransaction(Capability *cap, StgTRecHeader *trec) {
 
   unlock_stm(trec);
 
+  end_attempt(cap, trec, result);
+
   free_stg_trec_header(cap, trec);
 
   TRACE("%p : stmCommitTransaction()=%d", trec, result);
@@ -1211,6 +1582,11 @@ StgBool stmWait(Capability *cap, StgTSO *tso, StgTRecHeader *trec) {
   ASSERT((trec -> state == TREC_ACTIVE) ||
          (trec -> state == TREC_CONDEMNED));
 
+  // A transaction that blocks is not being starved, so don't hold on to
+  // the serialisation token while we sleep.
+  end_serialised(trec);
+  tso->stm_aborts = 0;
+
   lock_stm(trec);
   bool result = validate_and_acquire_ownership(cap, trec, true, true);
   if (result) {
@@ -1313,7 +1689,7 @@ StgClosure *stmReadTVar(Capability *cap,
   ASSERT(trec -> state == TREC_ACTIVE ||
          trec -> state == TREC_CONDEMNED);
 
-  entry = get_entry_for(trec, tvar, &entry_in);
+  entry = get_entry_for(cap, trec, tvar, &entry_in);
 
   if (entry != NULL) {
     if (entry_in == trec) {
@@ -1355,7 +1731,7 @@ void stmWriteTVar(Capability *cap,
   ASSERT(trec -> state == TREC_ACTIVE ||
          trec -> state == TREC_CONDEMNED);
 
-  entry = get_entry_for(trec, tvar, &entry_in);
+  entry = get_entry_for(cap, trec, tvar, &entry_in);
 
   if (entry != NULL) {
     if (entry_in == trec) {
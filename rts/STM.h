@@ -48,6 +48,7 @@
 */
 
 void stmPreGCHook(Capability *cap);
+void markSTM(evac_fn evac, void *user);
 
 /*----------------------------------------------------------------------
 
@@ -200,6 +201,7 @@ void stmWriteTVar(Capability *cap,
 #define END_STM_CHUNK_LIST ((StgTRecChunk *)(void *)&stg_END_STM_CHUNK_LIST_closure)
 
 #define NO_TREC ((StgTRecHeader *)(void *)&stg_NO_TREC_closure)
+#define NO_TREC_INDEX ((StgArrBytes *)(void *)&stg_NO_TREC_closure)
 
 /*----------------------------------------------------------------------*/
 
@@ -73,7 +73,6 @@
 // Blocked/sleeping threads
 StgTSO *blocked_queue_hd = NULL;
 StgTSO *blocked_queue_tl = NULL;
-StgTSO *sleeping_queue = NULL;    // perhaps replace with a hash table?
 #endif
 
 // Bytes allocated since the last time a HeapOverflow exception was thrown by
@@ -124,6 +123,13 @@ static Condition sync_finished_cond;
 static Mutex sync_finished_mutex;
 #endif
 
+/* The number of capabilities that have asked for work with -qp.
+ * See Note [Work requests].
+ */
+#if defined(THREADED_RTS)
+static volatile StgWord n_work_requests = 0;
+#endif
+
 
 /* -----------------------------------------------------------------------------
  * static function prototypes
@@ -651,6 +657,102 @@ shouldYieldCapability (Capability *cap, Task *task, bool didGcLast)
                                      : peekRunQueue(cap)->bound != task->incall)));
 }
 
+/* Note [Work requests]
+ * ~~~~~~~~~~~~~~~~~~~~
+ * By default a capability with more than one runnable thread tries to grab
+ * every other capability, each time round the scheduler loop, looking for
+ * idle ones to push threads to (schedulePushWork).  With +RTS -qp threads
+ * are still pushed by the busy capability, but only on request: the idle
+ * capabilities ask for work, and the busy ones don't go looking otherwise:
+ *
+ *  - a capability whose run queue is empty when it gets to scheduleYield
+ *    sets cap->work_requested, and counts itself in n_work_requests;
+ *
+ *  - a busy capability does nothing more than read n_work_requests until
+ *    it is non-zero.  Then it grabs only the capabilities that have asked,
+ *    those on its own NUMA node first, and clears their requests;
+ *
+ *  - it gives away threads from the end of its run queue.  Those are the
+ *    ones made runnable most recently, e.g. new threads, which have had the
+ *    least time to build up a working set in this capability's caches.
+ *
+ * Threads that are bound to the current Task or TSO_LOCKED never move, as
+ * before.
+ *
+ * This is push-on-request, not work stealing: an idle capability never
+ * takes threads from another's run queue itself.  The run queue is a plain
+ * doubly-linked list owned by its capability, and messages to a thread
+ * (throwTo, wakeups) are sent to the capability in tso->cap, so a thread may
+ * only move while both capabilities are held.  Letting thieves dequeue
+ * directly would need a concurrent run queue and a way to retarget messages
+ * already in flight to the thread's old capability.  What -qp saves is the
+ * busy capability trying to grab every other capability, whether or not it
+ * is idle, each time round the scheduler loop.
+ *
+ * A disabled capability never asks for work, and setNumCapabilities
+ * withdraws the request of a capability that it disables, or else
+ * n_work_requests would stay non-zero.
+ *
+ * cap->work_requested is only written by the Task holding cap, so only
+ * n_work_requests needs atomic updates.  Both are hints: a capability that
+ * asked for work may have found some since, and the usual checks in
+ * schedulePushWork catch that.
+ */
+
+#if defined(THREADED_RTS)
+static void
+requestWork (Capability *cap)
+{
+    if (!cap->work_requested) {
+        RELAXED_STORE(&cap->work_requested, true);
+        atomic_inc(&n_work_requests, 1);
+    }
+}
+
+static void
+withdrawWorkRequest (Capability *cap)
+{
+    if (cap->work_requested) {
+        RELAXED_STORE(&cap->work_requested, false);
+        atomic_dec(&n_work_requests);
+    }
+}
+
+// With -qp: grab up to n_wanted capabilities that have asked for work,
+// those on our own NUMA node first.  See Note [Work requests].
+static uint32_t
+grabRequestingCapabilities (Capability *cap, Task *task,
+                            Capability *free_caps[], uint32_t n_wanted)
+{
+    Capability *cap0;
+    uint32_t i, pass, n_free_caps = 0;
+
+    for (pass = 0; pass < (n_numa_nodes > 1 ? 2 : 1); pass++) {
+        for (i = (cap->no + 1) % n_capabilities;
+             n_free_caps < n_wanted && i != cap->no;
+             i = (i + 1) % n_capabilities) {
+            cap0 = capabilities[i];
+            if ((cap0->node == cap->node) != (pass == 0)
+                || !RELAXED_LOAD(&cap0->work_requested)
+                || cap0->disabled
+                || !tryGrabCapability(cap0,task)) {
+                continue;
+            }
+            withdrawWorkRequest(cap0);
+            if (!emptyRunQueue(cap0)
+                || RELAXED_LOAD(&cap0->n_returning_tasks) != 0
+                || !emptyInbox(cap0)) {
+                // it has found some work since it asked
+                releaseCapability(cap0);
+            } else {
+                free_caps[n_free_caps++] = cap0;
+            }
+        }
+    }
+    return n_free_caps;
+}
+#endif
+
 // This is the single place where a Task goes to sleep.  There are
 // two reasons it might need to sleep:
 //    - there are no threads to run
@@ -667,6 +769,16 @@ scheduleYield (Capability **pcap, Task *task)
     Capability *cap = *pcap;
     bool didGcLast = false;
 
+    if (RtsFlags.ParFlags.workRequests) {
+        // a disabled capability mustn't ask: nobody would give it work, and
+        // busy capabilities would keep looking
+        if (emptyRunQueue(cap) && !cap->disabled) {
+            requestWork(cap);
+        } else {
+            withdrawWorkRequest(cap);
+        }
+    }
+
     // if we have work, and we don't need to give up the Capability, continue.
     //
     if (!shouldYieldCapability(cap,task,false) &&
@@ -723,21 +835,30 @@ schedulePushWork(Capability *cap USED_IF_THREADS,
     n_wanted_caps = sparkPoolSizeCap(cap) + spare_threads;
     if (n_wanted_caps == 0) return;
 
-    // First grab as many free Capabilities as we can.  ToDo: we should use
-    // capabilities on the same NUMA node preferably, but not exclusively.
-    for (i = (cap->no + 1) % n_capabilities, n_free_caps=0;
-         n_free_caps < n_wanted_caps && i != cap->no;
-         i = (i + 1) % n_capabilities) {
-        cap0 = capabilities[i];
-        if (cap != cap0 && !cap0->disabled && tryGrabCapability(cap0,task)) {
-            if (!emptyRunQueue(cap0)
-                || RELAXED_LOAD(&cap0->n_returning_tasks) != 0
-                || !emptyInbox(cap0)) {
-                // it already has some work, we just grabbed it at
-                // the wrong moment.  Or maybe it's deadlocked!
-                releaseCapability(cap0);
-            } else {
-                free_caps[n_free_caps++] = cap0;
+    if (RtsFlags.ParFlags.workRequests) {
+        // only give work to capabilities that asked for it.
+        // See Note [Work requests].
+        if (RELAXED_LOAD(&n_work_requests) == 0) return;
+        n_free_caps =
+            grabRequestingCapabilities(cap, task, free_caps, n_wanted_caps);
+    } else {
+        // First grab as many free Capabilities as we can.  ToDo: we should
+        // use capabilities on the same NUMA node preferably, but not
+        // exclusively (-qp does).
+        for (i = (cap->no + 1) % n_capabilities, n_free_caps=0;
+             n_free_caps < n_wanted_caps && i != cap->no;
+             i = (i + 1) % n_capabilities) {
+            cap0 = capabilities[i];
+            if (cap != cap0 && !cap0->disabled && tryGrabCapability(cap0,task)) {
+                if (!emptyRunQueue(cap0)
+                    || RELAXED_LOAD(&cap0->n_returning_tasks) != 0
+                    || !emptyInbox(cap0)) {
+                    // it already has some work, we just grabbed it at
+                    // the wrong moment.  Or maybe it's deadlocked!
+                    releaseCapability(cap0);
+                } else {
+                    free_caps[n_free_caps++] = cap0;
+                }
             }
         }
     }
@@ -758,6 +879,9 @@ schedulePushWork(Capability *cap USED_IF_THREADS,
     //     working set in the cache on this CPU/Capability.
     //
     //   - giving low priority to moving long-lived threads
+    //
+    // -qp does a little of this, by moving the threads at the end of the
+    // run queue first.
 
     if (n_free_caps > 0) {
         StgTSO *prev, *t, *next;
@@ -783,6 +907,36 @@ schedulePushWork(Capability *cap USED_IF_THREADS,
         // prev = the previous thread on this cap's run queue
         prev = END_TSO_QUEUE;
 
+        if (RtsFlags.ParFlags.workRequests) {
+            // Walk back from the end of the run queue, migrating threads
+            // until we have only keep_threads left, and skipping the ones
+            // that cannot be migrated.
+            for (t = cap->run_queue_tl, i = 0;
+                 t != END_TSO_QUEUE && cap->n_run_queue > keep_threads;
+                 t = prev)
+            {
+                prev = t->block_info.prev;
+
+                if (t->bound == task->incall || tsoLocked(t)) {
+                    if (keep_threads > 0) keep_threads--;
+                    continue;
+                }
+
+                removeFromRunQueue(cap, t);
+                appendToRunQueue(free_caps[i],t);
+                traceEventMigrateThread (cap, t, free_caps[i]->no);
+
+                // See Note [Benign data race due to work-pushing].
+                if (t->bound) {
+                    t->bound->task->cap = free_caps[i];
+                }
+                t->cap = free_caps[i];
+                i++; // move on to the next free_cap
+                if (i == n_free_caps) i = 0;
+            }
+            goto release;
+        }
+
         // We're going to walk through the run queue, migrating threads to other
         // capabilities until we have only keep_threads left.  We might
         // encounter a thread that cannot be migrated, in which case we add it
@@ -838,6 +992,7 @@ schedulePushWork(Capability *cap USED_IF_THREADS,
         }
         cap->n_run_queue = n;
 
+    release:
         IF_DEBUG(sanity, checkRunQueue(cap));
 
         // release the capabilities
@@ -891,7 +1046,7 @@ scheduleCheckBlockedThreads(Capability *cap USED_IF_NOT_THREADS)
     // run queue is empty, and there are no other tasks running, we
     // can wait indefinitely for something to happen.
     //
-    if ( !emptyQueue(blocked_queue_hd) || !emptyQueue(sleeping_queue) )
+    if ( !EMPTY_BLOCKED_QUEUE() || !EMPTY_SLEEPING_QUEUE() )
     {
         awaitEvent (emptyRunQueue(cap));
     }
@@ -1151,7 +1306,7 @@ scheduleHandleHeapOverflow( Capability *cap, StgTSO *t )
                                                // nursery has only one
                                                // block.
 
-            bd = allocGroupOnNode_lock(cap->node,blocks);
+            bd = allocGroupCached(&cap->block_cache, cap->node, blocks);
             cap->r.rNursery->n_blocks += blocks;
 
             // link the new group after CurrentNursery
@@ -1856,6 +2011,7 @@ delete_threads_and_gc:
     }
 
     traceSparkCounters(cap);
+    traceSchedCounters(cap);
 
     switch (SEQ_CST_LOAD(&recent_activity)) {
     case ACTIVITY_INACTIVE:
@@ -1976,6 +2132,11 @@ delete_threads_and_gc:
     }
 #endif
 
+    // Trickle some free memory back to the OS now that the other
+    // capabilities are running again.
+    // See Note [Incremental memory return] in BlockAlloc.c
+    returnSomeMemoryToOS();
+
     return;
 }
 
@@ -2016,7 +2177,7 @@ forkProcess(HsStablePtr *entry
     ACQUIRE_LOCK(&sched_mutex);
     ACQUIRE_LOCK(&sm_mutex);
     ACQUIRE_LOCK(&stable_ptr_mutex);
-    ACQUIRE_LOCK(&stable_name_mutex);
+    stableNameLockAll();
 
     for (i=0; i < n_capabilities; i++) {
         ACQUIRE_LOCK(&capabilities[i]->lock);
@@ -2044,7 +2205,7 @@ forkProcess(HsStablePtr *entry
         RELEASE_LOCK(&sched_mutex);
         RELEASE_LOCK(&sm_mutex);
         RELEASE_LOCK(&stable_ptr_mutex);
-        RELEASE_LOCK(&stable_name_mutex);
+        stableNameUnlockAll();
         RELEASE_LOCK(&task->lock);
 
 #if defined(THREADED_RTS)
@@ -2072,7 +2233,7 @@ forkProcess(HsStablePtr *entry
         initMutex(&sched_mutex);
         initMutex(&sm_mutex);
         initMutex(&stable_ptr_mutex);
-        initMutex(&stable_name_mutex);
+        initStableNameLocks();
         initMutex(&task->lock);
 
         for (i=0; i < n_capabilities; i++) {
@@ -2111,6 +2272,11 @@ forkProcess(HsStablePtr *entry
 
         discardTasksExcept(task);
 
+#if !defined(THREADED_RTS)
+        // the epoll instance is shared with the parent; make our own.
+        resetAwaitEventAfterFork();
+#endif
+
         for (i=0; i < n_capabilities; i++) {
             cap = capabilities[i];
 
@@ -2267,6 +2433,11 @@ setNumCapabilities (uint32_t new_n_capabilities USED_IF_THREADS)
         //
         for (n = new_n_capabilities; n < enabled_capabilities; n++) {
             capabilities[n]->disabled = true;
+            // we hold all the capabilities, so we may clear this.
+            // See Note [Work requests].
+            withdrawWorkRequest(capabilities[n]);
+            // See Note [Per-capability stable pointer caches].
+            flushStablePtrCache(&capabilities[n]->sp_cache);
             traceCapDisable(capabilities[n]);
         }
         enabled_capabilities = new_n_capabilities;
@@ -2355,8 +2526,8 @@ deleteAllThreads ()
     // being GC'd, and we don't want the "main thread has been GC'd" panic.
 
 #if !defined(THREADED_RTS)
-    ASSERT(blocked_queue_hd == END_TSO_QUEUE);
-    ASSERT(sleeping_queue == END_TSO_QUEUE);
+    ASSERT(EMPTY_BLOCKED_QUEUE());
+    ASSERT(EMPTY_SLEEPING_QUEUE());
 #endif
 }
 
@@ -2679,7 +2850,6 @@ initScheduler(void)
 #if !defined(THREADED_RTS)
   blocked_queue_hd  = END_TSO_QUEUE;
   blocked_queue_tl  = END_TSO_QUEUE;
-  sleeping_queue    = END_TSO_QUEUE;
 #endif
 
   sched_state    = SCHED_RUNNING;
@@ -2765,14 +2935,16 @@ freeScheduler( void )
 #endif
 }
 
-void markScheduler (evac_fn evac USED_IF_NOT_THREADS,
-                    void *user USED_IF_NOT_THREADS)
+void markScheduler (evac_fn evac, void *user)
 {
 #if !defined(THREADED_RTS)
     evac(user, (StgClosure **)(void *)&blocked_queue_hd);
     evac(user, (StgClosure **)(void *)&blocked_queue_tl);
-    evac(user, (StgClosure **)(void *)&sleeping_queue);
+#if !defined(mingw32_HOST_OS)
+    markAwaitEvent(evac, user);
+#endif
 #endif
+    markSTM(evac, user);
 }
 
 /* -----------------------------------------------------------------------------
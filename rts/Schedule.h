@@ -106,7 +106,14 @@ extern volatile StgWord recent_activity;
  */
 #if !defined(THREADED_RTS)
 extern  StgTSO *blocked_queue_hd, *blocked_queue_tl;
-extern  StgTSO *sleeping_queue;
+#if !defined(mingw32_HOST_OS)
+// Threads blocked on fds watched with epoll, which are not on
+// blocked_queue. See Note [awaitEvent with epoll] in posix/Select.c.
+extern  StgWord n_epoll_waiters;
+// Threads blocked in threadDelay.
+// See Note [The sleeping heap] in posix/Select.c.
+extern  uint32_t n_sleeping_threads;
+#endif
 #endif
 
 extern bool heap_overflow;
@@ -247,8 +254,15 @@ truncateRunQueue(Capability *cap)
 }
 
 #if !defined(THREADED_RTS)
+#if defined(mingw32_HOST_OS)
 #define EMPTY_BLOCKED_QUEUE()  (emptyQueue(blocked_queue_hd))
-#define EMPTY_SLEEPING_QUEUE() (emptyQueue(sleeping_queue))
+// threadDelay uses blocked_queue on Windows
+#define EMPTY_SLEEPING_QUEUE() (true)
+#else
+#define EMPTY_BLOCKED_QUEUE()  (emptyQueue(blocked_queue_hd) \
+                                && n_epoll_waiters == 0)
+#define EMPTY_SLEEPING_QUEUE() (n_sleeping_threads == 0)
+#endif
 #endif
 
 INLINE_HEADER bool
@@ -16,9 +16,55 @@
 #include "RtsUtils.h"
 #include "Trace.h"
 #include "StableName.h"
+#include "sm/HeapAlloc.h"
 
 #include <string.h>
 
+/* Note [Stable name table concurrency]
+   ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+   The map from objects to stable names is split into SN_SHARDS hash
+   tables, picked by the address of the object, each protected by its own
+   lock. Looking up the stable name of an object which already has one,
+   the common case for programs which memoise on StableNames, only takes
+   the lock of that object's shard, so capabilities rarely contend.
+
+   Allocating a new entry in stable_name_table still takes
+   stable_name_mutex, which protects the free list and the table itself.
+   lookupStableName drops the shard lock before taking stable_name_mutex
+   and then retakes it, so the lock order is always stable_name_mutex
+   before any shard lock, as in the GC and the nonmoving sweep.
+
+   A lookup that only holds a shard lock may still read stable_name_table,
+   and stg_makeStableNamezh reads it after lookupStableName returns, so
+   enlargeStableNameTable cannot free the old table while another thread
+   might be using it. Instead it copies the entries to a new table and
+   keeps the old one on retired_tables until the next GC, when no mutator
+   can be looking at it. setStableNameObject stores the StableName object
+   under stable_name_mutex, so the store cannot go to a table that is
+   being copied and be lost.
+
+   Outside GC, each entry in use has old == addr, and the shard of old
+   maps old to the entry (unless addr is NULL because the object died, in
+   which case it is in no shard). The GC keeps this invariant by rehashing
+   only the entries whose objects moved (see updateStableNameTable).
+*/
+
+/* Note [Incremental stable name table GC]
+   ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+   A minor GC cannot move or free an object in the oldest generation. So
+   an entry whose object and StableName object are both in the oldest
+   generation (or static, or dead) cannot change in a minor GC, and
+   gcStableNameTable and updateStableNameTable can skip it.
+
+   young_sns lists the entries which may not be like that: every entry
+   allocated since the last major GC, and those which a major GC left
+   with an object in a younger generation. Minor GCs only visit those, and
+   drop the entries which have since been promoted to the oldest
+   generation or freed. Major GCs visit the whole table and rebuild the
+   list. An entry may appear on the list more than once (if it is freed
+   and reused before the next GC); visiting it twice is harmless.
+*/
+
 snEntry *stable_name_table = NULL;
 static snEntry *stable_name_free = NULL;
 unsigned int SNT_size = 0;
@@ -31,12 +77,41 @@ Mutex stable_name_mutex;
 static void enlargeStableNameTable(void);
 
 /*
- * This hash table maps Haskell objects to stable names, so that every
+ * These hash tables map Haskell objects to stable names, so that every
  * call to lookupStableName on a given object will return the same
- * stable name.
+ * stable name. See Note [Stable name table concurrency].
  */
 
-static HashTable *addrToStableHash = NULL;
+#define SN_SHARDS 16    /* must be a power of two */
+
+typedef struct {
+#if defined(THREADED_RTS)
+    Mutex lock;
+#endif
+    HashTable *addrToStableHash;
+} snShard;
+
+static snShard sn_shards[SN_SHARDS];
+
+/* Tables replaced by enlargeStableNameTable, freed at the next GC */
+typedef struct retiredTable_ {
+    snEntry *table;
+    struct retiredTable_ *link;
+} retiredTable;
+
+static retiredTable *retired_tables = NULL;
+
+/* Entries which minor GCs must visit.
+ * See Note [Incremental stable name table GC] */
+static StgWord *young_sns = NULL;
+static uint32_t n_young_sns = 0;
+static uint32_t young_sns_size = 0;
+
+STATIC_INLINE snShard *
+snShardOf(StgPtr p)
+{
+    return &sn_shards[((W_)p / sizeof(W_)) & (SN_SHARDS - 1)];
+}
 
 void
 stableNameLock(void)
@@ -51,6 +126,55 @@ stableNameUnlock(void)
     RELEASE_LOCK(&stable_name_mutex);
 }
 
+// Take every lock protecting the stable name table, e.g. before forking.
+void
+stableNameLockAll(void)
+{
+    stableNameLock();
+#if defined(THREADED_RTS)
+    for (int i = 0; i < SN_SHARDS; i++) {
+        ACQUIRE_LOCK(&sn_shards[i].lock);
+    }
+#endif
+}
+
+void
+stableNameUnlockAll(void)
+{
+#if defined(THREADED_RTS)
+    for (int i = 0; i < SN_SHARDS; i++) {
+        RELEASE_LOCK(&sn_shards[i].lock);
+    }
+#endif
+    stableNameUnlock();
+}
+
+#if defined(THREADED_RTS)
+// In the child of a fork, the locks may have been held by threads which
+// no longer exist.
+void
+initStableNameLocks(void)
+{
+    initMutex(&stable_name_mutex);
+    for (int i = 0; i < SN_SHARDS; i++) {
+        initMutex(&sn_shards[i].lock);
+    }
+}
+#endif
+
+static void
+addYoungStableName(StgWord sn)
+{
+    if (n_young_sns == young_sns_size) {
+        young_sns_size = young_sns_size == 0 ? INIT_SNT_SIZE
+                                             : young_sns_size * 2;
+        young_sns = stgReallocBytes(young_sns,
+                                    young_sns_size * sizeof(StgWord),
+                                    "addYoungStableName");
+    }
+    young_sns[n_young_sns++] = sn;
+}
+
 /* -----------------------------------------------------------------------------
  * Initialising the table
  * -------------------------------------------------------------------------- */
@@ -80,10 +204,12 @@ initStableNameTable(void)
      * return NULL if an entry isn't found in the hash table.
      */
     initSnEntryFreeList(stable_name_table + 1,INIT_SNT_SIZE-1,NULL);
-    addrToStableHash = allocHashTable();
+    for (int i = 0; i < SN_SHARDS; i++) {
+        sn_shards[i].addrToStableHash = allocHashTable();
+    }
 
 #if defined(THREADED_RTS)
-    initMutex(&stable_name_mutex);
+    initStableNameLocks();
 #endif
 }
 
@@ -91,21 +217,48 @@ initStableNameTable(void)
  * Enlarging the tables
  * -------------------------------------------------------------------------- */
 
+// Called with stable_name_mutex held. Other threads may still be reading
+// the old table, so we retire it rather than freeing it.
+// See Note [Stable name table concurrency].
 static void
 enlargeStableNameTable(void)
 {
     uint32_t old_SNT_size = SNT_size;
+    snEntry *old_table = stable_name_table;
+    snEntry *new_table;
+    retiredTable *retired;
+
+    // The free list is empty, so no entry points into the old table.
+    ASSERT(stable_name_free == NULL);
 
     // 2nd and subsequent times
     SNT_size *= 2;
-    stable_name_table =
-        stgReallocBytes(stable_name_table,
-                        SNT_size * sizeof(snEntry),
-                        "enlargeStableNameTable");
+    new_table = stgMallocBytes(SNT_size * sizeof(snEntry),
+                               "enlargeStableNameTable");
+    memcpy(new_table, old_table, old_SNT_size * sizeof(snEntry));
+
+    retired = stgMallocBytes(sizeof(retiredTable), "enlargeStableNameTable");
+    retired->table = old_table;
+    retired->link = retired_tables;
+    retired_tables = retired;
+
+    RELEASE_STORE(&stable_name_table, new_table);
 
     initSnEntryFreeList(stable_name_table + old_SNT_size, old_SNT_size, NULL);
 }
 
+static void
+freeRetiredStableNameTables(void)
+{
+    retiredTable *next;
+
+    for (; retired_tables != NULL; retired_tables = next) {
+        next = retired_tables->link;
+        stgFree(retired_tables->table);
+        stgFree(retired_tables);
+    }
+}
+
 
 /* -----------------------------------------------------------------------------
  * Freeing entries and tables
@@ -114,29 +267,74 @@ enlargeStableNameTable(void)
 void
 exitStableNameTable(void)
 {
-    if (addrToStableHash)
-        freeHashTable(addrToStableHash, NULL);
-    addrToStableHash = NULL;
+    for (int i = 0; i < SN_SHARDS; i++) {
+        if (sn_shards[i].addrToStableHash)
+            freeHashTable(sn_shards[i].addrToStableHash, NULL);
+        sn_shards[i].addrToStableHash = NULL;
+#if defined(THREADED_RTS)
+        closeMutex(&sn_shards[i].lock);
+#endif
+    }
 
     if (stable_name_table)
         stgFree(stable_name_table);
     stable_name_table = NULL;
+    freeRetiredStableNameTables();
     SNT_size = 0;
 
+    if (young_sns)
+        stgFree(young_sns);
+    young_sns = NULL;
+    n_young_sns = young_sns_size = 0;
+
 #if defined(THREADED_RTS)
     closeMutex(&stable_name_mutex);
 #endif
 }
 
+/* Remove the mapping from p to sn from p's shard. The caller holds
+ * stable_name_mutex, and either the shard lock or (in the GC) all of
+ * them. */
+static void
+removeStableNameHash(StgPtr p, StgWord sn)
+{
+    removeHashTable(snShardOf(p)->addrToStableHash, (W_)p, (void *)sn);
+}
+
+/* Remove an entry from its shard, taking the shard lock. The caller holds
+ * stable_name_mutex. */
+static void
+unhashSnEntry(snEntry *sn)
+{
+  if (sn->old != NULL) {
+#if defined(THREADED_RTS)
+      Mutex *lock = &snShardOf(sn->old)->lock;
+#endif
+      ACQUIRE_LOCK(lock);
+      removeStableNameHash(sn->old, sn - stable_name_table);
+      RELEASE_LOCK(lock);
+      sn->old = NULL;
+  }
+}
+
 void
 freeSnEntry(snEntry *sn)
 {
   ASSERT(sn->sn_obj == NULL);
-  removeHashTable(addrToStableHash, (W_)sn->old, NULL);
+  unhashSnEntry(sn);
   sn->addr = (P_)stable_name_free;
   stable_name_free = sn;
 }
 
+/* The object of an entry has died, outside of the copying GC (i.e. in the
+ * nonmoving sweep). Called with stable_name_mutex held. */
+void
+clearSnEntryAddr(snEntry *sn)
+{
+  unhashSnEntry(sn);
+  sn->addr = NULL;
+}
+
 /* -----------------------------------------------------------------------------
  * Looking up
  * -------------------------------------------------------------------------- */
@@ -177,11 +375,7 @@ removeIndirections (StgClosure* p)
 StgWord
 lookupStableName (StgPtr p)
 {
-  stableNameLock();
-
-  if (stable_name_free == NULL) {
-    enlargeStableNameTable();
-  }
+  initStableNameTable();
 
   /* removing indirections increases the likelihood
    * of finding a match in the stable name hash table.
@@ -191,38 +385,65 @@ lookupStableName (StgPtr p)
   // register the untagged pointer.  This just makes things simpler.
   p = (StgPtr)UNTAG_CLOSURE((StgClosure*)p);
 
-  StgWord sn = (StgWord)lookupHashTable(addrToStableHash,(W_)p);
+  snShard *shard = snShardOf(p);
+
+  // Fast path: the object already has a stable name, so we only need the
+  // shard lock. See Note [Stable name table concurrency].
+  ACQUIRE_LOCK(&shard->lock);
+  StgWord sn = (StgWord)lookupHashTable(shard->addrToStableHash,(W_)p);
+  RELEASE_LOCK(&shard->lock);
+
+  if (sn != 0) {
+    debugTrace(DEBUG_stable, "cached stable name %ld at %p",sn,p);
+    return sn;
+  }
+
+  // Slow path: take stable_name_mutex (before the shard lock), and look
+  // again in case another thread made a stable name for p meanwhile.
+  stableNameLock();
+  ACQUIRE_LOCK(&shard->lock);
+
+  sn = (StgWord)lookupHashTable(shard->addrToStableHash,(W_)p);
 
   if (sn != 0) {
     ASSERT(stable_name_table[sn].addr == p);
     debugTrace(DEBUG_stable, "cached stable name %ld at %p",sn,p);
+    RELEASE_LOCK(&shard->lock);
     stableNameUnlock();
     return sn;
   }
 
+  if (stable_name_free == NULL) {
+    enlargeStableNameTable();
+  }
+
   sn = stable_name_free - stable_name_table;
   stable_name_free  = (snEntry*)(stable_name_free->addr);
   stable_name_table[sn].addr = p;
+  stable_name_table[sn].old = p;
   stable_name_table[sn].sn_obj = NULL;
   /* debugTrace(DEBUG_stable, "new stable name %d at %p\n",sn,p); */
 
   /* add the new stable name to the hash table */
-  insertHashTable(addrToStableHash, (W_)p, (void *)sn);
+  insertHashTable(shard->addrToStableHash, (W_)p, (void *)sn);
+  addYoungStableName(sn);
 
+  RELEASE_LOCK(&shard->lock);
   stableNameUnlock();
 
   return sn;
 }
 
-/* -----------------------------------------------------------------------------
- * Remember old stable name addresses
- * -------------------------------------------------------------------------- */
-
+/* Store the StableName object of a new entry, see
+ * Note [Stable name table concurrency]. Called by stg_makeStableNamezh. */
 void
-rememberOldStableNameAddresses(void)
+setStableNameObject (StgWord sn, StgClosure *sn_obj)
 {
-    /* TODO: Only if !full GC */
-    FOR_EACH_STABLE_NAME(p, p->old = p->addr;);
+  stableNameLock();
+  // Make the StableName# object visible to other threads only once it is
+  // completely visible. See Note [Heap memory barriers] in SMP.h.
+  RELEASE_STORE(&stable_name_table[sn].sn_obj, sn_obj);
+  stableNameUnlock();
 }
 
 /* -----------------------------------------------------------------------------
@@ -260,35 +481,49 @@ threadStableNameTable( evac_fn evac, void *user )
  * refer to the entry.
  * -------------------------------------------------------------------------- */
 
+static void
+gcStableNameEntry( snEntry *p )
+{
+    // FOR_EACH_STABLE_NAME traverses free entries too, and young_sns may
+    // refer to entries which have since been freed, so check sn_obj
+    if (p->sn_obj != NULL) {
+        // Update the pointer to the StableName object, if there is one
+        p->sn_obj = isAlive(p->sn_obj);
+        if (p->sn_obj == NULL) {
+            // StableName object died
+            debugTrace(DEBUG_stable, "GC'd StableName %ld (addr=%p)",
+                       (long)(p - stable_name_table), p->addr);
+            freeSnEntry(p);
+        } else if (p->addr != NULL) {
+            // sn_obj is alive, update pointee
+            p->addr = (StgPtr)isAlive((StgClosure *)p->addr);
+            if (p->addr == NULL) {
+                // Pointee died
+                debugTrace(DEBUG_stable, "GC'd pointee %ld",
+                           (long)(p - stable_name_table));
+            }
+        }
+    }
+}
+
 void
 gcStableNameTable( void )
 {
     // We must take the stable name lock lest we race with the nonmoving
     // collector (namely nonmovingSweepStableNameTable).
     stableNameLock();
-    FOR_EACH_STABLE_NAME(
-        p, {
-            // FOR_EACH_STABLE_NAME traverses free entries too, so
-            // check sn_obj
-            if (p->sn_obj != NULL) {
-                // Update the pointer to the StableName object, if there is one
-                p->sn_obj = isAlive(p->sn_obj);
-                if (p->sn_obj == NULL) {
-                    // StableName object died
-                    debugTrace(DEBUG_stable, "GC'd StableName %ld (addr=%p)",
-                               (long)(p - stable_name_table), p->addr);
-                    freeSnEntry(p);
-                } else if (p->addr != NULL) {
-                    // sn_obj is alive, update pointee
-                    p->addr = (StgPtr)isAlive((StgClosure *)p->addr);
-                    if (p->addr == NULL) {
-                        // Pointee died
-                        debugTrace(DEBUG_stable, "GC'd pointee %ld",
-                                   (long)(p - stable_name_table));
-                    }
-                }
-            }
-        });
+
+    // No mutator can be looking at an old table now.
+    freeRetiredStableNameTables();
+
+    // See Note [Incremental stable name table GC]
+    if (major_gc) {
+        FOR_EACH_STABLE_NAME(p, gcStableNameEntry(p););
+    } else {
+        for (uint32_t i = 0; i < n_young_sns; i++) {
+            gcStableNameEntry(&stable_name_table[young_sns[i]]);
+        }
+    }
     stableNameUnlock();
 }
 
@@ -296,37 +531,81 @@ gcStableNameTable( void )
  * Update the StableName hash table
  *
  * The boolean argument 'full' indicates that a major collection is
- * being done, so we might as well throw away the hash table and build
- * a new one.  For a minor collection, we just re-hash the elements
- * that changed.
+ * being done, so we look at every entry. For a minor collection, we
+ * only look at the entries which the collection could have changed.
+ * Either way, we only re-hash the entries whose objects moved.
  * -------------------------------------------------------------------------- */
 
+// Is p out of reach of minor collections?
+// See Note [Incremental stable name table GC]
+static bool
+isOldStableNameObject( StgPtr p )
+{
+    bdescr *bd;
+
+    if (p == NULL || !HEAP_ALLOCED_GC(p)) {
+        return true;
+    }
+    bd = Bdescr(p);
+    if (bd->flags & BF_NONMOVING) {
+        return true;
+    }
+    // Be conservative about objects in compact regions, which need not be
+    // in the first block of their block group.
+    return bd->gen == oldest_gen && !(bd->flags & BF_COMPACT);
+}
+
+// Called with stable_name_mutex and every shard lock held.
+static void
+updateStableNameEntry( snEntry *p )
+{
+    StgWord sn = p - stable_name_table;
+
+    if (p->addr != p->old) {
+        /* Movement happened: */
+        if (p->old != NULL) {
+            removeStableNameHash(p->old, sn);
+        }
+        if (p->addr != NULL) {
+            // Target still alive, Re-hash this stable name
+            insertHashTable(snShardOf(p->addr)->addrToStableHash,
+                            (W_)p->addr, (void *)sn);
+        }
+        p->old = p->addr;
+    }
+}
+
 void
 updateStableNameTable(bool full)
 {
-    if (full && addrToStableHash != NULL && 0 != keyCountHashTable(addrToStableHash)) {
-        freeHashTable(addrToStableHash,NULL);
-        addrToStableHash = allocHashTable();
-    }
+    stableNameLockAll();
 
-    if(full) {
+    if (full) {
+        n_young_sns = 0;
         FOR_EACH_STABLE_NAME(
             p, {
-                if (p->addr != NULL) {
-                    // Target still alive, Re-hash this stable name
-                    insertHashTable(addrToStableHash, (W_)p->addr, (void *)(p - stable_name_table));
+                if (p->sn_obj != NULL) {
+                    updateStableNameEntry(p);
+                    if (!isOldStableNameObject(p->addr) ||
+                        !isOldStableNameObject((StgPtr)p->sn_obj)) {
+                        addYoungStableName(p - stable_name_table);
+                    }
                 }
             });
     } else {
-        FOR_EACH_STABLE_NAME(
-            p, {
-                if (p->addr != p->old) {
-                    removeHashTable(addrToStableHash, (W_)p->old, NULL);
-                    /* Movement happened: */
-                    if (p->addr != NULL) {
-                        insertHashTable(addrToStableHash, (W_)p->addr, (void *)(p - stable_name_table));
-                    }
+        uint32_t n = 0;
+        for (uint32_t i = 0; i < n_young_sns; i++) {
+            snEntry *p = &stable_name_table[young_sns[i]];
+            if (p->sn_obj != NULL) {
+                updateStableNameEntry(p);
+                if (!isOldStableNameObject(p->addr) ||
+                    !isOldStableNameObject((StgPtr)p->sn_obj)) {
+                    young_sns[n++] = young_sns[i];
                 }
-            });
+            }
+        }
+        n_young_sns = n;
     }
+
+    stableNameUnlockAll();
 }
@@ -12,10 +12,10 @@
 
 void    initStableNameTable   ( void );
 void    freeSnEntry           ( snEntry *sn );
+void    clearSnEntryAddr      ( snEntry *sn );
 void    exitStableNameTable   ( void );
 StgWord lookupStableName      ( StgPtr p );
-
-void    rememberOldStableNameAddresses ( void );
+void    setStableNameObject   ( StgWord sn, StgClosure *sn_obj );
 
 void    threadStableNameTable ( evac_fn evac, void *user );
 void    gcStableNameTable     ( void );
@@ -23,6 +23,11 @@ void    updateStableNameTable ( bool full );
 
 void    stableNameLock            ( void );
 void    stableNameUnlock          ( void );
+void    stableNameLockAll         ( void );
+void    stableNameUnlockAll       ( void );
+#if defined(THREADED_RTS)
+void    initStableNameLocks       ( void );
+#endif
 
 extern unsigned int SNT_size;
 
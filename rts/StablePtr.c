@@ -16,6 +16,8 @@
 #include "RtsUtils.h"
 #include "Trace.h"
 #include "StablePtr.h"
+#include "Capability.h"
+#include "Task.h"
 
 #include <string.h>
 
@@ -112,6 +114,11 @@ static uint32_t n_old_SPTs = 0;
 
 #if defined(THREADED_RTS)
 Mutex stable_ptr_mutex;
+
+/* Odd while enlargeStablePtrTable is copying the table; see Note
+ * [Per-capability stable pointer caches].
+ */
+static StgWord spt_epoch = 0;
 #endif
 
 static void enlargeStablePtrTable(void);
@@ -183,6 +190,10 @@ enlargeStablePtrTable(void)
     new_stable_ptr_table =
         stgMallocBytes(SPT_size * sizeof(spEntry),
                        "enlargeStablePtrTable");
+#if defined(THREADED_RTS)
+    SEQ_CST_ADD(&spt_epoch, 1);
+    SEQ_CST_FENCE();
+#endif
     memcpy(new_stable_ptr_table,
            stable_ptr_table,
            old_SPT_size * sizeof(spEntry));
@@ -195,6 +206,9 @@ enlargeStablePtrTable(void)
      * that the new table is visible to others.
      */
     RELEASE_STORE(&stable_ptr_table, new_stable_ptr_table);
+#if defined(THREADED_RTS)
+    SEQ_CST_ADD(&spt_epoch, 1);
+#endif
 
     initSpEntryFreeList(stable_ptr_table + old_SPT_size, old_SPT_size, NULL);
 }
@@ -259,30 +273,218 @@ freeStablePtrUnsafe(StgStablePtr sp)
     freeSpEntry(&stable_ptr_table[(StgWord)sp]);
 }
 
+/* -----------------------------------------------------------------------------
+ * Per-capability caches of free entries
+ * -------------------------------------------------------------------------- */
+
+/* Note [Per-capability stable pointer caches]
+ * ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+ * Allocating and freeing a stable pointer used to take stable_ptr_mutex every
+ * time, which is contended when many capabilities create and free stable
+ * pointers at once (e.g. a program making lots of FFI callbacks).
+ *
+ * In the threaded RTS each capability therefore keeps a small cache of free
+ * table entries (cap->sp_cache), held as indices into the table.  When the
+ * calling OS thread owns a capability, getStablePtr takes an entry from its
+ * cache and freeStablePtr puts the entry back, without taking the lock.  An
+ * empty cache is refilled with SP_CACHE_BATCH entries from the global free
+ * list, and a full one spills SP_CACHE_BATCH entries back to it, each under a
+ * single acquisition of stable_ptr_mutex.  getStablePtrs and freeStablePtrs
+ * go through the cache too, and serve requests larger than a batch directly
+ * from the global free list under one acquisition.  Callers that do not own a
+ * capability (foreign threads, or a Haskell thread in a safe foreign call) use
+ * the global free list as before.
+ *
+ * Cached entries have addr == NULL, so FOR_EACH_STABLE_PTR treats them as
+ * free, and being indices they survive enlargement of the table.  Hence the
+ * GC does not need to know about the caches at all.  A cache is flushed back
+ * to the global free list when setNumCapabilities disables its capability,
+ * and when the capability is freed at exit, so that no entries are stranded.
+ *
+ * The one subtlety is that the owner of a cache writes the addr field of its
+ * entries without holding stable_ptr_mutex, while another thread may be
+ * copying the table in enlargeStablePtrTable: a write landing in the old
+ * table after it has been copied would be lost.  enlargeStablePtrTable keeps
+ * spt_epoch odd for the duration of the copy.  setSpEntryUnlocked reads an even
+ * epoch, writes the entry in the table current at that point, and retries if
+ * the epoch has changed since.  The SEQ_CST fences on both sides guarantee that
+ * either the copy sees the write or the writer sees the new epoch.
+ */
+
+void
+initStablePtrCache(StablePtrCache *cache)
+{
+    cache->n_free = 0;
+}
+
+// Return all the entries in a cache to the global free list.  The caller
+// must own the cache's capability, or hold all capabilities.
 void
-freeStablePtr(StgStablePtr sp)
+flushStablePtrCache(StablePtrCache *cache)
+{
+    if (cache->n_free == 0) return;
+    stablePtrLock();
+    while (cache->n_free > 0) {
+        freeSpEntry(&stable_ptr_table[cache->free[--cache->n_free]]);
+    }
+    stablePtrUnlock();
+}
+
+// Must be holding stable_ptr_mutex
+static void
+getStablePtrsLocked(StgPtr ps[], StgStablePtr sps[], uint32_t n)
+{
+    for (uint32_t i = 0; i < n; i++) {
+        if (!stable_ptr_free) enlargeStablePtrTable();
+        StgWord sp = stable_ptr_free - stable_ptr_table;
+        stable_ptr_free = (spEntry*)(stable_ptr_free->addr);
+        RELAXED_STORE(&stable_ptr_table[sp].addr, ps[i]);
+        sps[i] = (StgStablePtr)sp;
+    }
+}
+
+// Must be holding stable_ptr_mutex
+static void
+freeStablePtrsLocked(StgStablePtr sps[], uint32_t n)
+{
+    for (uint32_t i = 0; i < n; i++) {
+        freeStablePtrUnsafe(sps[i]);
+    }
+}
+
+#if defined(THREADED_RTS)
+
+// The capability owned by the calling OS thread, or NULL if it has none.
+static Capability *
+myStablePtrCap(void)
+{
+    Task *task = myTask();
+    if (task == NULL || task->cap == NULL) return NULL;
+    if (RELAXED_LOAD(&task->cap->running_task) != task) return NULL;
+    return task->cap;
+}
+
+// Set the addr field of an entry owned by the calling capability's cache,
+// without holding stable_ptr_mutex.
+static void
+setSpEntryUnlocked(StgWord sp, StgPtr p)
+{
+    for (;;) {
+        StgWord epoch = ACQUIRE_LOAD(&spt_epoch);
+        if (epoch & 1) {
+            busy_wait_nop();
+            continue;
+        }
+        spEntry *spt = ACQUIRE_LOAD(&stable_ptr_table);
+        RELEASE_STORE(&spt[sp].addr, p);
+        SEQ_CST_FENCE();
+        if (RELAXED_LOAD(&spt_epoch) == epoch) return;
+    }
+}
+
+// Must be holding stable_ptr_mutex
+static void
+refillStablePtrCache(StablePtrCache *cache)
+{
+    while (cache->n_free < SP_CACHE_BATCH) {
+        if (!stable_ptr_free) enlargeStablePtrTable();
+        spEntry *sp = stable_ptr_free;
+        stable_ptr_free = (spEntry*)(sp->addr);
+        RELAXED_STORE(&sp->addr, NULL);
+        cache->free[cache->n_free++] = sp - stable_ptr_table;
+    }
+}
+
+// Must be holding stable_ptr_mutex
+static void
+spillStablePtrCache(StablePtrCache *cache)
+{
+    while (cache->n_free > SP_CACHE_SIZE - SP_CACHE_BATCH) {
+        freeSpEntry(&stable_ptr_table[cache->free[--cache->n_free]]);
+    }
+}
+
+#endif /* THREADED_RTS */
+
+void
+freeStablePtrs(StgStablePtr sps[], uint32_t n)
 {
+#if defined(THREADED_RTS)
+    Capability *cap = myStablePtrCap();
+    if (cap != NULL) {
+        StablePtrCache *cache = &cap->sp_cache;
+        for (uint32_t i = 0; i < n; i++) {
+            if (cache->n_free == SP_CACHE_SIZE) {
+                stablePtrLock();
+                spillStablePtrCache(cache);
+                if (n - i > SP_CACHE_BATCH) {
+                    freeStablePtrsLocked(&sps[i], n - i);
+                    stablePtrUnlock();
+                    return;
+                }
+                stablePtrUnlock();
+            }
+            StgWord sp = (StgWord)sps[i];
+            ASSERT(sp < RELAXED_LOAD(&SPT_size));
+            setSpEntryUnlocked(sp, NULL);
+            cache->free[cache->n_free++] = sp;
+        }
+        return;
+    }
+#endif
+
     stablePtrLock();
-    freeStablePtrUnsafe(sp);
+    freeStablePtrsLocked(sps, n);
     stablePtrUnlock();
 }
 
+void
+freeStablePtr(StgStablePtr sp)
+{
+    freeStablePtrs(&sp, 1);
+}
+
 /* -----------------------------------------------------------------------------
  * Looking up
  * -------------------------------------------------------------------------- */
 
+void
+getStablePtrs(StgPtr ps[], StgStablePtr sps[], uint32_t n)
+{
+#if defined(THREADED_RTS)
+    Capability *cap = myStablePtrCap();
+    if (cap != NULL) {
+        StablePtrCache *cache = &cap->sp_cache;
+        for (uint32_t i = 0; i < n; i++) {
+            if (cache->n_free == 0) {
+                stablePtrLock();
+                if (n - i > SP_CACHE_BATCH) {
+                    getStablePtrsLocked(&ps[i], &sps[i], n - i);
+                    stablePtrUnlock();
+                    return;
+                }
+                refillStablePtrCache(cache);
+                stablePtrUnlock();
+            }
+            StgWord sp = cache->free[--cache->n_free];
+            setSpEntryUnlocked(sp, ps[i]);
+            sps[i] = (StgStablePtr)sp;
+        }
+        return;
+    }
+#endif
+
+    stablePtrLock();
+    getStablePtrsLocked(ps, sps, n);
+    stablePtrUnlock();
+}
+
 StgStablePtr
 getStablePtr(StgPtr p)
 {
-  StgWord sp;
-
-  stablePtrLock();
-  if (!stable_ptr_free) enlargeStablePtrTable();
-  sp = stable_ptr_free - stable_ptr_table;
-  stable_ptr_free  = (spEntry*)(stable_ptr_free->addr);
-  RELAXED_STORE(&stable_ptr_table[sp].addr, p);
-  stablePtrUnlock();
-  return (StgStablePtr)(sp);
+    StgStablePtr sp;
+    getStablePtrs(&p, &sp, 1);
+    return sp;
 }
 
 /* -----------------------------------------------------------------------------
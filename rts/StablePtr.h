@@ -18,6 +18,19 @@
 
 #include "BeginPrivate.h"
 
+/* A capability's cache of free stable pointer table entries, see Note
+   [Per-capability stable pointer caches] in StablePtr.c */
+#define SP_CACHE_SIZE  64
+#define SP_CACHE_BATCH 32
+
+typedef struct StablePtrCache_ {
+    uint32_t n_free;
+    StgWord free[SP_CACHE_SIZE];  // indices of free entries, addr == NULL
+} StablePtrCache;
+
+void    initStablePtrCache    ( StablePtrCache *cache );
+void    flushStablePtrCache   ( StablePtrCache *cache );
+
 void    freeStablePtr         ( StgStablePtr sp );
 
 /* Use the "Unsafe" one after only when manually locking and
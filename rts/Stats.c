@@ -21,6 +21,7 @@
 
 // for spin/yield counters
 #include "sm/GC.h"
+#include "sm/NonMoving.h"
 #include "ThreadPaused.h"
 #include "Messages.h"
 
@@ -69,6 +70,10 @@ static Time *GC_coll_cpu = NULL;
 static Time *GC_coll_elapsed = NULL;
 static Time *GC_coll_max_pause = NULL;
 
+// Bytes copied by the GC threads of each NUMA node, only maintained with
+// more than one node. See Note [NUMA-aware GC work stealing] in GCUtils.c.
+static uint64_t GC_copied_bytes_per_node[MAX_NUMA_NODES];
+
 static void statsPrintf( char *s, ... ) GNUC3_ATTRIBUTE(format (PRINTF, 1, 2));
 static void statsFlush( void );
 static void statsClose( void );
@@ -160,6 +165,7 @@ initStats0(void)
 #endif
 
     GC_end_faults = 0;
+    memset(GC_copied_bytes_per_node, 0, sizeof(GC_copied_bytes_per_node));
 
     stats = (RTSStats) {
         .gcs = 0,
@@ -551,6 +557,27 @@ stat_endGC (Capability *cap, gc_thread *initiating_gct, W_ live, W_ copied, W_ s
     }
 
     stats.copied_bytes += stats.gc.copied_bytes;
+
+    // Bytes copied on each NUMA node during this GC. This excludes the
+    // mutable lists, which stats.gc.copied_bytes counts too.
+    uint64_t node_copied_bytes[MAX_NUMA_NODES];
+    if (n_numa_nodes > 1) {
+        memset(node_copied_bytes, 0, sizeof(node_copied_bytes));
+        if (par_n_threads == 1) {
+            node_copied_bytes[capNoToNumaNode(initiating_gct->thread_index)] =
+                initiating_gct->copied * sizeof(W_);
+        } else {
+            for (unsigned int i=0; i < par_n_threads; i++) {
+                gc_thread *gct = gc_threads[i];
+                node_copied_bytes[capNoToNumaNode(gct->thread_index)] +=
+                    RELAXED_LOAD(&gct->copied) * sizeof(W_);
+            }
+        }
+        for (uint32_t node = 0; node < n_numa_nodes; node++) {
+            GC_copied_bytes_per_node[node] += node_copied_bytes[node];
+        }
+    }
+
     if (par_n_threads > 1) {
         stats.par_copied_bytes += stats.gc.copied_bytes;
         stats.cumulative_par_max_copied_bytes +=
@@ -646,6 +673,14 @@ stat_endGC (Capability *cap, gc_thread *initiating_gct, W_ live, W_ copied, W_ s
                         initiating_gct->gc_start_faults - GC_end_faults,
                     gen);
 
+            if (n_numa_nodes > 1) {
+                statsPrintf("%29s", "copied per node:");
+                for (uint32_t node = 0; node < n_numa_nodes; node++) {
+                    statsPrintf(" %" FMT_Word64, node_copied_bytes[node]);
+                }
+                statsPrintf("\n");
+            }
+
             GC_end_faults = faults;
             statsFlush();
         }
@@ -848,6 +883,13 @@ static void report_summary(const RTSSummaryStats* sum)
 
     showStgWord64(stats.copied_bytes, temp, true/*commas*/);
     statsPrintf("%16s bytes copied during GC\n", temp);
+    if (n_numa_nodes > 1) {
+        for (uint32_t node = 0; node < n_numa_nodes; node++) {
+            showStgWord64(GC_copied_bytes_per_node[node], temp, true/*commas*/);
+            statsPrintf("%16s bytes copied on NUMA node %" FMT_Word32 "\n",
+                        temp, node);
+        }
+    }
 
     if ( stats.major_gcs > 0 ) {
         showStgWord64(stats.max_live_bytes, temp, true/*commas*/);
@@ -860,9 +902,15 @@ static void report_summary(const RTSSummaryStats* sum)
     statsPrintf("%16s bytes maximum slop\n", temp);
 
     statsPrintf("%16" FMT_Word64 " MiB total memory in use (%"
-                FMT_Word64 " MB lost due to fragmentation)\n\n",
+                FMT_Word64 " MB lost due to fragmentation)\n",
                 stats.max_mem_in_use_bytes  / (1024 * 1024),
                 sum->fragmentation_bytes / (1024 * 1024));
+    if (RtsFlags.GcFlags.hugePages) {
+        // See Note [Huge page megablocks] in MBlock.c
+        statsPrintf("%16" FMT_Word64 " MiB backed by huge pages at exit\n",
+                    sum->huge_page_bytes / (1024 * 1024));
+    }
+    statsPrintf("\n");
 
     /* Print garbage collections in each gen */
     statsPrintf("                                     Tot time (elapsed)  Avg pause  Max pause\n");
@@ -971,6 +1019,12 @@ static void report_summary(const RTSSummaryStats* sum)
     // following counters. If you add a counter here, please remember
     // to update the Note.
     if (RtsFlags.MiscFlags.internalCounters) {
+        if (RtsFlags.GcFlags.useNonmoving) {
+            statsPrintf("  Nonmoving segment magazines: %" FMT_Word64 " hits, %"
+                        FMT_Word64 " misses\n\n",
+                        sum->nonmoving_magazine_hits,
+                        sum->nonmoving_magazine_misses);
+        }
 #if defined(THREADED_RTS) && defined(PROF_SPIN)
         const int32_t col_width[] = {4, -30, 14, 14};
         statsPrintf("Internal Counters:\n");
@@ -1140,6 +1194,15 @@ static void report_machine_readable (const RTSSummaryStats * sum)
     MR_STAT("gc_wall_percent", "f", sum->gc_cpu_percent);
 #endif
     MR_STAT("fragmentation_bytes", FMT_Word64, sum->fragmentation_bytes);
+    if (RtsFlags.GcFlags.hugePages) {
+        MR_STAT("huge_page_bytes", FMT_Word64, sum->huge_page_bytes);
+    }
+    if (RtsFlags.GcFlags.useNonmoving) {
+        MR_STAT("nonmoving_magazine_hits", FMT_Word64,
+                sum->nonmoving_magazine_hits);
+        MR_STAT("nonmoving_magazine_misses", FMT_Word64,
+                sum->nonmoving_magazine_misses);
+    }
     // average_bytes_used is done above
     MR_STAT("alloc_rate", FMT_Word64, sum->alloc_rate);
     MR_STAT("productivity_cpu_percent", "f", sum->productivity_cpu_percent);
@@ -1195,6 +1258,16 @@ static void report_machine_readable (const RTSSummaryStats * sum)
 #endif // PROF_SPIN
 #endif // THREADED_RTS
 
+    // per-NUMA-node copied bytes, named as, for example for node 0,
+    // node_0_copied_bytes
+    if (n_numa_nodes > 1) {
+        for (uint32_t node = 0; node < n_numa_nodes; node++) {
+            statsPrintf(" ,(\"node_%" FMT_Word32 "_copied_bytes\", \"%"
+                        FMT_Word64 "\")\n",
+                        node, GC_copied_bytes_per_node[node]);
+        }
+    }
+
     // finally, per-generation stats. Named as, for example for generation 0,
     // gen_0_collections
     for (g = 0; g < RtsFlags.GcFlags.generations; g++) {
@@ -1390,6 +1463,19 @@ stat_exitReport (void)
                                   / stats.elapsed_ns;
     #endif // THREADED_RTS
 
+            if (RtsFlags.GcFlags.useNonmoving) {
+                for (uint32_t i = 0; i < n_capabilities; i++) {
+                    sum.nonmoving_magazine_hits +=
+                      nonmovingHeap.magazines[i].hits;
+                    sum.nonmoving_magazine_misses +=
+                      nonmovingHeap.magazines[i].misses;
+                }
+            }
+
+            if (RtsFlags.GcFlags.hugePages) {
+                sum.huge_page_bytes = getHeapHugePageBytes();
+            }
+
             sum.fragmentation_bytes =
                 (uint64_t)(peak_mblocks_allocated
                          * BLOCKS_PER_MBLOCK
@@ -1613,6 +1699,14 @@ white-hole spin counters:
 We count the number of calls of several functions in the parallel garbage
 collector.
 
+Nonmoving segment magazine counters (these are maintained in all RTS ways):
+* hits:
+    The number of fresh nonmoving segments taken from a capability's magazine.
+* misses:
+    The number of times a capability's magazine was empty and had to be
+    refilled from the global free segment list. See Note [Free segment
+    magazines] in NonMoving.c.
+
 Parallel garbage collector counters:
 * any_work:
     A cheap function called whenever a gc_thread is ready for work. Does
@@ -1729,6 +1823,18 @@ void getRTSStats( RTSStats *s )
         stats.nonmoving_gc_cpu_ns;
     s->mutator_elapsed_ns = current_elapsed - end_init_elapsed -
         stats.gc_elapsed_ns;
+
+    // The STM counters are kept per capability, see
+    // Note [STM contention management] in STM.c.  We read them without
+    // synchronisation, so they may be slightly out of date.
+    s->stm_commits = 0;
+    s->stm_aborts = 0;
+    s->stm_serialised = 0;
+    for (uint32_t i = 0; i < n_capabilities; i++) {
+        s->stm_commits    += RELAXED_LOAD(&capabilities[i]->stm_commits);
+        s->stm_aborts     += RELAXED_LOAD(&capabilities[i]->stm_aborts);
+        s->stm_serialised += RELAXED_LOAD(&capabilities[i]->stm_serialised);
+    }
 }
 
 /* -----------------------------------------------------------------------------
@@ -110,6 +110,11 @@ typedef struct RTSSummaryStats_ {
 #endif
     uint64_t fragmentation_bytes;
     uint64_t average_bytes_used; // This is not shown in the '+RTS -s' report
+    // See Note [Huge page megablocks] in MBlock.c
+    uint64_t huge_page_bytes;
+    // See Note [Free segment magazines] in NonMoving.c
+    uint64_t nonmoving_magazine_hits;
+    uint64_t nonmoving_magazine_misses;
     uint64_t alloc_rate;
     double productivity_cpu_percent;
     double productivity_elapsed_percent;
@@ -112,6 +112,8 @@ createThread(Capability *cap, W_ size)
     ASSIGN_Int64((W_*)&(tso->alloc_limit), 0);
 
     tso->trec = NO_TREC;
+    tso->stm_aborts = 0;
+    tso->sleep_index = 0;
 
 #if defined(PROFILING)
     tso->prof.cccs = CCS_MAIN;
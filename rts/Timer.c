@@ -112,6 +112,31 @@ handle_tick(int unused STG_UNUSED)
   }
 }
 
+/* Note [The timer is disabled]
+ * ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+ * In this RTS initTimer, startTimer, stopTimer and exitTimer do nothing, so
+ * handle_tick above is never installed with initTicker and never runs.  The
+ * RTS is therefore already "tickless": it takes no periodic wakeups, whether
+ * or not any capability has more than one runnable thread.  The price is
+ * that nothing the tick would drive happens either:
+ *
+ *  - there is no timer-driven pre-emption: +RTS -C and -V have no effect,
+ *    and a thread keeps its capability until it blocks, yields or finishes,
+ *    or something else sets cap->context_switch;
+ *
+ *  - recent_activity never leaves ACTIVITY_YES, so the idle GC (+RTS -I)
+ *    never runs, and deadlock detection only happens through
+ *    scheduleDetectDeadlock when there are no runnable threads;
+ *
+ *  - time and heap profiles get no samples from handleProfTick.
+ *
+ * Should the timer be brought back, handle_tick is the place to make it
+ * tickless: it could stop the ticker when no capability has a second
+ * runnable thread, no profile is being sampled and no idle GC is pending,
+ * and the scheduler would then restart it (startTimer) when one of these
+ * changes.
+ */
+
 void
 initTimer(void)
 {
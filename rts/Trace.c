@@ -93,7 +93,18 @@ void initTracing (void)
 
     if (RtsFlags.TraceFlags.tracing == TRACE_EVENTLOG
             && rtsConfig.eventlog_writer != NULL) {
-        startEventLogging(rtsConfig.eventlog_writer);
+        const EventLogWriter *writer = rtsConfig.eventlog_writer;
+        if (writer == &FileEventLogWriter) {
+#if !defined(mingw32_HOST_OS)
+            if (RtsFlags.TraceFlags.ring_size > 0) {
+                writer = &RingEventLogWriter;
+            } else
+#endif
+            if (RtsFlags.TraceFlags.compress) {
+                writer = &CompressedFileEventLogWriter;
+            }
+        }
+        startEventLogging(writer);
     }
 }
 
@@ -854,6 +865,21 @@ void traceNonmovingHeapCensus(uint32_t log_blk_size,
         postNonmovingHeapCensus(log_blk_size, census);
 }
 
+void traceBlockCacheCounters(Capability *cap)
+{
+    if (eventlog_enabled && TRACE_gc)
+        postBlockCacheCounters(cap, cap->block_cache.hits,
+                               cap->block_cache.slow_path);
+}
+
+// See Note [Sampling scheduler and spark events] in EventLog.c
+void traceSchedCounters(Capability *cap)
+{
+    if (eventlog_enabled && TRACE_sched
+            && RtsFlags.TraceFlags.sched_sample_period > 1)
+        postSchedCounters(cap);
+}
+
 void traceThreadStatus_ (StgTSO *tso USED_IF_DEBUG)
 {
 #if defined(DEBUG)
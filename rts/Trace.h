@@ -319,6 +319,8 @@ void traceConcSweepEnd(void);
 void traceConcUpdRemSetFlush(Capability *cap);
 void traceNonmovingHeapCensus(uint32_t log_blk_size,
                               const struct NonmovingAllocCensus *census);
+void traceBlockCacheCounters(Capability *cap);
+void traceSchedCounters(Capability *cap);
 
 void flushTrace(void);
 
@@ -368,6 +370,8 @@ void flushTrace(void);
 #define traceConcSweepEnd() /* nothing */
 #define traceConcUpdRemSetFlush(cap) /* nothing */
 #define traceNonmovingHeapCensus(blk_size, census) /* nothing */
+#define traceBlockCacheCounters(cap) /* nothing */
+#define traceSchedCounters(cap) /* nothing */
 
 #define flushTrace() /* nothing */
 
@@ -34,6 +34,17 @@ static const EventLogWriter *event_log_writer = NULL;
 
 static int flushCount;
 
+// The kinds of scheduler events counted in EVENT_SCHED_COUNTERS, in order
+enum {
+    SCHED_COUNT_CREATE,
+    SCHED_COUNT_RUN,
+    SCHED_COUNT_STOP,
+    SCHED_COUNT_RUNNABLE,
+    SCHED_COUNT_MIGRATE,
+    SCHED_COUNT_WAKEUP,
+    N_SCHED_COUNTERS
+};
+
 // Struct for record keeping of buffer to store event types and events.
 typedef struct _EventsBuf {
   StgInt8 *begin;
@@ -41,6 +52,16 @@ typedef struct _EventsBuf {
   StgInt8 *marker;
   StgWord64 size;
   EventCapNo capno; // which capability this buffer belongs to, or -1
+  uint32_t n_events; // events in the buffer, not counting block markers
+                     // and EVENTLOG_DROPPED
+  StgWord64 dropped; // events dropped by the asynchronous writer so far
+
+  // Sampling state, see Note [Sampling scheduler and spark events]
+  uint32_t sched_skip;  // scheduler events to skip before the next sample
+  uint32_t spark_skip;  // spark events to skip before the next sample
+  uint32_t rng;         // xorshift state for choosing the skips
+  bool run_sampled;     // whether the last RUN_THREAD was posted
+  StgWord64 sched_counts[N_SCHED_COUNTERS]; // all scheduler events, by kind
 } EventsBuf;
 
 EventsBuf *capEventBuf; // one EventsBuf for each Capability
@@ -119,7 +140,10 @@ char *EventDesc[] = {
   [EVENT_CONC_SWEEP_BEGIN]       = "Begin concurrent sweep",
   [EVENT_CONC_SWEEP_END]         = "End concurrent sweep",
   [EVENT_CONC_UPD_REM_SET_FLUSH] = "Update remembered set flushed",
-  [EVENT_NONMOVING_HEAP_CENSUS]  = "Nonmoving heap census"
+  [EVENT_NONMOVING_HEAP_CENSUS]  = "Nonmoving heap census",
+  [EVENT_BLOCK_CACHE_COUNTERS]   = "Block cache counters",
+  [EVENT_EVENTLOG_DROPPED]       = "Eventlog events dropped",
+  [EVENT_SCHED_COUNTERS]         = "Scheduler counters"
 };
 
 // Event type.
@@ -142,6 +166,7 @@ static void postLogMsg(EventsBuf *eb, EventTypeNum type, char *msg, va_list ap);
 
 static void postBlockMarker(EventsBuf *eb);
 static void closeBlockMarker(EventsBuf *ebuf);
+static void postSampledCounters(EventsBuf *eb);
 
 static StgBool hasRoomForEvent(EventsBuf *eb, EventTypeNum eNum);
 static StgBool hasRoomForVariableEvent(EventsBuf *eb, uint32_t payload_bytes);
@@ -229,6 +254,7 @@ static inline void postPayloadSize(EventsBuf *eb, EventPayloadSize size)
 
 static inline void postEventHeader(EventsBuf *eb, EventTypeNum type)
 {
+    eb->n_events++;
     postEventTypeNum(eb, type);
     postTimestamp(eb);
 }
@@ -239,8 +265,87 @@ static inline void postInt8(EventsBuf *eb, StgInt8 i)
 static inline void postInt32(EventsBuf *eb, StgInt32 i)
 { postWord32(eb, (StgWord32)i); }
 
+/* Note [Sampling scheduler and spark events]
+ * ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+ * With -ls every context switch costs at least two events (RUN_THREAD and
+ * STOP_THREAD), and -lf one event per spark operation, which for programs
+ * switching millions of times a second makes the eventlog both slow and huge.
+ * +RTS --eventlog-sample-sched=<n> and --eventlog-sample-sparks=<n> therefore
+ * post only about one in n events of the class:
+ *
+ *  - The gaps between posted events are chosen at random with mean n (from a
+ *    per-capability xorshift generator), so that sampling does not alias with
+ *    periodic behaviour of the program.
+ *
+ *  - RUN_THREAD is sampled, and the matching STOP_THREAD is posted exactly
+ *    when the RUN_THREAD was, so that the posted events still form complete
+ *    run intervals.
+ *
+ *  - Skipping an event costs a few instructions: no timestamp is taken and
+ *    nothing is written to the buffer.
+ *
+ * To keep rates exact despite the sampling each capability counts all its
+ * scheduler events, and posts the cumulative counts as a SCHED_COUNTERS
+ * event at the start of each block, after each GC (traceSchedCounters), and
+ * once more when event logging ends, so that the last counts in the log
+ * are the totals.  For sparks the existing SPARK_COUNTERS event serves the
+ * same purpose and is likewise posted at the start of each block and at the
+ * end.
+ */
+
+static inline bool
+sampleEvent(EventsBuf *eb, uint32_t *skip, uint32_t period)
+{
+    if (*skip > 0) {
+        (*skip)--;
+        return false;
+    }
+    // the next gap is uniform in [0, 2*period-2], so one in period events
+    // is posted on average
+    eb->rng ^= eb->rng << 13;
+    eb->rng ^= eb->rng >> 17;
+    eb->rng ^= eb->rng << 5;
+    *skip = eb->rng % (2 * period - 1);
+    return true;
+}
+
+static bool
+sampleSchedEvent(EventsBuf *eb, EventTypeNum tag)
+{
+    uint32_t period = RtsFlags.TraceFlags.sched_sample_period;
+
+    switch (tag) {
+    case EVENT_CREATE_THREAD:
+        eb->sched_counts[SCHED_COUNT_CREATE]++;
+        break;
+    case EVENT_RUN_THREAD:
+        eb->sched_counts[SCHED_COUNT_RUN]++;
+        eb->run_sampled = sampleEvent(eb, &eb->sched_skip, period);
+        return eb->run_sampled;
+    case EVENT_STOP_THREAD:
+        eb->sched_counts[SCHED_COUNT_STOP]++;
+        return eb->run_sampled;
+    case EVENT_THREAD_RUNNABLE:
+        eb->sched_counts[SCHED_COUNT_RUNNABLE]++;
+        break;
+    case EVENT_MIGRATE_THREAD:
+        eb->sched_counts[SCHED_COUNT_MIGRATE]++;
+        break;
+    case EVENT_THREAD_WAKEUP:
+        eb->sched_counts[SCHED_COUNT_WAKEUP]++;
+        break;
+    default:
+        return true;
+    }
+    return sampleEvent(eb, &eb->sched_skip, period);
+}
+
 #define EVENT_SIZE_DYNAMIC (-1)
 
+#if defined(THREADED_RTS)
+static void waitAsyncEventLogWriter(void);
+#endif
+
 static void
 initEventLogWriter(void)
 {
@@ -273,6 +378,9 @@ stopEventLogWriter(void)
 void
 flushEventLog(void)
 {
+#if defined(THREADED_RTS)
+    waitAsyncEventLogWriter();
+#endif
     if (event_log_writer != NULL &&
             event_log_writer->flushEventLog != NULL) {
         event_log_writer->flushEventLog();
@@ -487,6 +595,18 @@ init_event_types(void)
             eventTypes[t].size = 13;
             break;
 
+        case EVENT_BLOCK_CACHE_COUNTERS: // (hits, slow_path)
+            eventTypes[t].size = 2 * sizeof(StgWord64);
+            break;
+
+        case EVENT_EVENTLOG_DROPPED: // (dropped)
+            eventTypes[t].size = sizeof(StgWord64);
+            break;
+
+        case EVENT_SCHED_COUNTERS: // (N_SCHED_COUNTERS*counter)
+            eventTypes[t].size = N_SCHED_COUNTERS * sizeof(StgWord64);
+            break;
+
         default:
             continue; /* ignore deprecated events */
         }
@@ -529,6 +649,278 @@ get_n_capabilities(void)
 #endif
 }
 
+/* -----------------------------------------------------------------------------
+ * Asynchronous writer
+ * -------------------------------------------------------------------------- */
+
+/* Note [Asynchronous eventlog writer]
+ * ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+ * Normally a full capability buffer is written out by printAndClearEventBuf
+ * on the capability that filled it, so the mutator stalls for as long as the
+ * EventLogWriter takes, which for a file means a 2MB fwrite.
+ *
+ * With +RTS --eventlog-async-buffers=<n> the threaded RTS instead starts a
+ * writer thread when event logging starts, and gives every capability a pool
+ * of n spare buffers.  A full capability buffer is handed off by swapping its
+ * memory with a spare from the pool and queueing the full one; the writer
+ * thread passes queued buffers to the EventLogWriter in order and returns
+ * each to the pool of its capability afterwards.  So a capability only takes
+ * async_mutex briefly and never waits for I/O.
+ *
+ * If a capability fills its buffer while its pool is empty the writer has
+ * fallen behind.  Rather than blocking we then discard the contents of the
+ * buffer and count the events lost in EventsBuf.dropped.  Every buffer that
+ * follows starts with an EVENTLOG_DROPPED event carrying that (cumulative)
+ * count, and the total is reported when event logging ends.
+ *
+ * The global eventBuf has no pool: its buffers are rare, so they are copied
+ * and queued, and never dropped.
+ *
+ * Since the writer thread owns the EventLogWriter while it runs, anything
+ * else that calls the EventLogWriter first waits for the queue to drain
+ * (waitAsyncEventLogWriter, called by flushEventLog, and hence before
+ * forkProcess) or stops the thread (endEventLogging).  The header and the
+ * final buffers are written synchronously, before the thread starts and after
+ * it has stopped respectively.
+ */
+
+#if defined(THREADED_RTS)
+
+typedef struct _EventsChunk {
+    StgInt8 *begin;
+    size_t len;                  // bytes to write
+    EventCapNo capno;            // whose pool to return this to, or -1
+    struct _EventsChunk *link;
+} EventsChunk;
+
+// true while the writer thread is running; written with all capabilities
+// held (or before they exist)
+static bool async_writer_running = false;
+static bool async_writer_stop;   // asks the writer thread to exit
+static bool async_writer_busy;   // the writer thread is writing a chunk
+static OSThreadId async_writer_thread;
+
+// protects the fields below, and the fields above after start-up
+static Mutex async_mutex;
+static Condition async_work_cond;   // a chunk was queued, or stop was set
+static Condition async_idle_cond;   // the queue became empty
+
+static EventsChunk *async_queue_hd, *async_queue_tl;
+static EventsChunk **async_pools;   // spare buffers, one pool per capability
+static uint32_t n_async_pools;
+static StgWord64 async_dropped;     // total number of events dropped
+
+static void
+fillAsyncPools(uint32_t from, uint32_t to)
+{
+    async_pools = stgReallocBytes(async_pools, to * sizeof(EventsChunk *),
+                                  "fillAsyncPools");
+    for (uint32_t c = from; c < to; c++) {
+        async_pools[c] = NULL;
+        for (uint32_t i = 0; i < RtsFlags.TraceFlags.async_buffers; i++) {
+            EventsChunk *chunk = stgMallocBytes(sizeof(EventsChunk),
+                                                "fillAsyncPools");
+            chunk->begin = stgMallocBytes(EVENT_LOG_SIZE, "fillAsyncPools");
+            chunk->link = async_pools[c];
+            async_pools[c] = chunk;
+        }
+    }
+    n_async_pools = to;
+}
+
+static void
+freeEventsChunks(EventsChunk *chunk)
+{
+    while (chunk != NULL) {
+        EventsChunk *next = chunk->link;
+        stgFree(chunk->begin);
+        stgFree(chunk);
+        chunk = next;
+    }
+}
+
+static void *
+asyncEventLogWriter(void *arg STG_UNUSED)
+{
+    ACQUIRE_LOCK(&async_mutex);
+    while (true) {
+        while (async_queue_hd == NULL && !async_writer_stop) {
+            waitCondition(&async_work_cond, &async_mutex);
+        }
+        if (async_queue_hd == NULL) {
+            break; // asked to stop and nothing left to write
+        }
+
+        EventsChunk *chunk = async_queue_hd;
+        async_queue_hd = chunk->link;
+        if (async_queue_hd == NULL) {
+            async_queue_tl = NULL;
+        }
+        async_writer_busy = true;
+        RELEASE_LOCK(&async_mutex);
+
+        if (!writeEventLog(chunk->begin, chunk->len)) {
+            debugBelch("asyncEventLogWriter: could not flush event log\n");
+        }
+
+        ACQUIRE_LOCK(&async_mutex);
+        async_writer_busy = false;
+        if (chunk->capno == (EventCapNo)(-1)) {
+            chunk->link = NULL;
+            freeEventsChunks(chunk);
+        } else {
+            chunk->link = async_pools[chunk->capno];
+            async_pools[chunk->capno] = chunk;
+        }
+        if (async_queue_hd == NULL) {
+            broadcastCondition(&async_idle_cond);
+        }
+    }
+    RELEASE_LOCK(&async_mutex);
+    return NULL;
+}
+
+static void
+startAsyncEventLogWriter(void)
+{
+    if (RtsFlags.TraceFlags.async_buffers == 0) {
+        return;
+    }
+
+    initMutex(&async_mutex);
+    initCondition(&async_work_cond);
+    initCondition(&async_idle_cond);
+    async_queue_hd = async_queue_tl = NULL;
+    async_pools = NULL;
+    fillAsyncPools(0, get_n_capabilities());
+    async_writer_stop = false;
+    async_writer_busy = false;
+    async_dropped = 0;
+
+    if (createOSThread(&async_writer_thread, "ghc_eventlog_writer",
+                       asyncEventLogWriter, NULL) != 0) {
+        sysErrorBelch("startAsyncEventLogWriter: can't create writer thread");
+        stg_exit(EXIT_FAILURE);
+    }
+    async_writer_running = true;
+}
+
+// Wait until the writer thread has written everything queued so far.
+static void
+waitAsyncEventLogWriter(void)
+{
+    if (!async_writer_running) {
+        return;
+    }
+    ACQUIRE_LOCK(&async_mutex);
+    while (async_queue_hd != NULL || async_writer_busy) {
+        waitCondition(&async_idle_cond, &async_mutex);
+    }
+    RELEASE_LOCK(&async_mutex);
+}
+
+// Free the writer's state. The writer thread must not be running; in a
+// forked child resetAsyncEventLogWriterAfterFork must have been called first.
+static void
+freeAsyncEventLogWriter(void)
+{
+    if (!async_writer_running) {
+        return;
+    }
+    freeEventsChunks(async_queue_hd);
+    for (uint32_t c = 0; c < n_async_pools; c++) {
+        freeEventsChunks(async_pools[c]);
+    }
+    stgFree(async_pools);
+    async_pools = NULL;
+    n_async_pools = 0;
+    async_queue_hd = async_queue_tl = NULL;
+    closeCondition(&async_work_cond);
+    closeCondition(&async_idle_cond);
+    closeMutex(&async_mutex);
+    async_writer_running = false;
+}
+
+// In a forked child the writer thread does not exist, but the parent's
+// writer was waiting on async_work_cond at the time of the fork, and
+// destroying a condition variable that has waiters can block forever.  So we
+// reinitialise the locks instead, forget the thread, and leave the rest to
+// freeAsyncEventLogWriter.
+static void
+resetAsyncEventLogWriterAfterFork(void)
+{
+    if (!async_writer_running) {
+        return;
+    }
+    initMutex(&async_mutex);
+    initCondition(&async_work_cond);
+    initCondition(&async_idle_cond);
+    memset(&async_writer_thread, 0, sizeof(async_writer_thread));
+    async_writer_busy = false;
+}
+
+// Write out everything queued and stop the writer thread.
+static void
+stopAsyncEventLogWriter(void)
+{
+    if (!async_writer_running) {
+        return;
+    }
+    ACQUIRE_LOCK(&async_mutex);
+    async_writer_stop = true;
+    signalCondition(&async_work_cond);
+    RELEASE_LOCK(&async_mutex);
+    joinOSThread(async_writer_thread);
+
+    if (async_dropped > 0) {
+        debugBelch("eventlog: %" FMT_Word64 " events were dropped because "
+                   "the asynchronous writer fell behind; consider a larger "
+                   "--eventlog-async-buffers\n", async_dropped);
+    }
+    freeAsyncEventLogWriter();
+}
+
+// Queue the contents of a full buffer for the writer thread, leaving the
+// buffer with fresh memory. Returns false if the events had to be dropped.
+static bool
+handOffEventBuf(EventsBuf *ebuf, size_t len)
+{
+    EventsChunk *chunk;
+
+    ACQUIRE_LOCK(&async_mutex);
+    if (ebuf->capno == (EventCapNo)(-1)) {
+        chunk = stgMallocBytes(sizeof(EventsChunk), "handOffEventBuf");
+        chunk->begin = stgMallocBytes(len, "handOffEventBuf");
+        memcpy(chunk->begin, ebuf->begin, len);
+    } else {
+        chunk = async_pools[ebuf->capno];
+        if (chunk == NULL) {
+            ebuf->dropped += ebuf->n_events;
+            async_dropped += ebuf->n_events;
+            RELEASE_LOCK(&async_mutex);
+            return false;
+        }
+        async_pools[ebuf->capno] = chunk->link;
+        StgInt8 *full = ebuf->begin;
+        ebuf->begin = chunk->begin;
+        chunk->begin = full;
+    }
+    chunk->len = len;
+    chunk->capno = ebuf->capno;
+    chunk->link = NULL;
+    if (async_queue_tl == NULL) {
+        async_queue_hd = chunk;
+    } else {
+        async_queue_tl->link = chunk;
+    }
+    async_queue_tl = chunk;
+    signalCondition(&async_work_cond);
+    RELEASE_LOCK(&async_mutex);
+    return true;
+}
+
+#endif /* THREADED_RTS */
+
 void
 initEventLogging()
 {
@@ -585,6 +977,10 @@ startEventLogging_(void)
     for (uint32_t c = 0; c < get_n_capabilities(); ++c) {
         postBlockMarker(&capEventBuf[c]);
     }
+
+#if defined(THREADED_RTS)
+    startAsyncEventLogWriter();
+#endif
     return true;
 }
 
@@ -604,6 +1000,9 @@ startEventLogging(const EventLogWriter *ev_writer)
 void
 restartEventLogging(void)
 {
+#if defined(THREADED_RTS)
+    resetAsyncEventLogWriterAfterFork();
+#endif
     freeEventLogging();
     stopEventLogWriter();
     initEventLogging();  // allocate new per-capability buffers
@@ -618,8 +1017,15 @@ endEventLogging(void)
     if (!eventlog_enabled)
         return;
 
-    // Flush all events remaining in the buffers.
+#if defined(THREADED_RTS)
+    // The remaining buffers are written synchronously below.
+    stopAsyncEventLogWriter();
+#endif
+
+    // Flush all events remaining in the buffers, with the final counts of
+    // any sampled events (see Note [Sampling scheduler and spark events]).
     for (uint32_t c = 0; c < n_capabilities; ++c) {
+        postSampledCounters(&capEventBuf[c]);
         printAndClearEventBuf(&capEventBuf[c]);
     }
     printAndClearEventBuf(&eventBuf);
@@ -658,12 +1064,24 @@ moreCapEventBufs (uint32_t from, uint32_t to)
            postBlockMarker(&capEventBuf[c]);
         }
     }
+
+#if defined(THREADED_RTS)
+    if (async_writer_running && to > n_async_pools) {
+        ACQUIRE_LOCK(&async_mutex);
+        fillAsyncPools(n_async_pools, to);
+        RELEASE_LOCK(&async_mutex);
+    }
+#endif
 }
 
 
 void
 freeEventLogging(void)
 {
+#if defined(THREADED_RTS)
+    freeAsyncEventLogWriter();
+#endif
+
     // Free events buffer.
     for (uint32_t c = 0; c < n_capabilities; ++c) {
         if (capEventBuf[c].begin != NULL)
@@ -686,6 +1104,12 @@ postSchedEvent (Capability *cap,
                 StgWord info2)
 {
     EventsBuf *eb = &capEventBuf[cap->no];
+
+    if (RtsFlags.TraceFlags.sched_sample_period > 1
+            && !sampleSchedEvent(eb, tag)) {
+        return;
+    }
+
     ensureRoomForEvent(eb, tag);
 
     postEventHeader(eb, tag);
@@ -732,6 +1156,14 @@ postSparkEvent (Capability *cap,
                 StgWord info1)
 {
     EventsBuf *eb = &capEventBuf[cap->no];
+
+    if (RtsFlags.TraceFlags.spark_sample_period > 1
+            && tag != EVENT_CREATE_SPARK_THREAD
+            && !sampleEvent(eb, &eb->spark_skip,
+                            RtsFlags.TraceFlags.spark_sample_period)) {
+        return;
+    }
+
     ensureRoomForEvent(eb, tag);
 
     postEventHeader(eb, tag);
@@ -1250,6 +1682,59 @@ void postNonmovingHeapCensus(int log_blk_size,
     RELEASE_LOCK(&eventBufMutex);
 }
 
+void postBlockCacheCounters(Capability *cap, StgWord hits, StgWord slow_path)
+{
+    EventsBuf *eb = &capEventBuf[cap->no];
+    ensureRoomForEvent(eb, EVENT_BLOCK_CACHE_COUNTERS);
+    postEventHeader(eb, EVENT_BLOCK_CACHE_COUNTERS);
+    postWord64(eb, hits);
+    postWord64(eb, slow_path);
+}
+
+// Only called at the start of a buffer, so there is always room.
+// Like the block marker it is not counted in n_events, so that dropping it
+// doesn't count as dropping an event.
+static void postEventlogDropped(EventsBuf *eb)
+{
+    postEventTypeNum(eb, EVENT_EVENTLOG_DROPPED);
+    postTimestamp(eb);
+    postWord64(eb, eb->dropped);
+}
+
+static void postSchedCountersBuf(EventsBuf *eb)
+{
+    ensureRoomForEvent(eb, EVENT_SCHED_COUNTERS);
+    postEventHeader(eb, EVENT_SCHED_COUNTERS);
+    for (int i = 0; i < N_SCHED_COUNTERS; i++) {
+        postWord64(eb, eb->sched_counts[i]);
+    }
+}
+
+void postSchedCounters(Capability *cap)
+{
+    postSchedCountersBuf(&capEventBuf[cap->no]);
+}
+
+// Post the counters of sampled event classes at the start of a new block of
+// a capability's events. See Note [Sampling scheduler and spark events].
+static void postSampledCounters(EventsBuf *eb)
+{
+    if (eb->capno == (EventCapNo)(-1)) {
+        return;
+    }
+    if (TRACE_sched && RtsFlags.TraceFlags.sched_sample_period > 1) {
+        postSchedCountersBuf(eb);
+    }
+#if defined(THREADED_RTS)
+    if ((TRACE_spark_full || TRACE_spark_sampled)
+            && RtsFlags.TraceFlags.spark_sample_period > 1) {
+        Capability *cap = capabilities[eb->capno];
+        postSparkCountersEvent(cap, cap->spark_stats,
+                               sparkPoolSize(cap->sparks));
+    }
+#endif
+}
+
 void closeBlockMarker (EventsBuf *ebuf)
 {
     if (ebuf->marker)
@@ -1274,7 +1759,9 @@ void postBlockMarker (EventsBuf *eb)
     closeBlockMarker(eb);
 
     eb->marker = eb->pos;
-    postEventHeader(eb, EVENT_BLOCK_MARKER);
+    // not postEventHeader: the marker is not counted in n_events
+    postEventTypeNum(eb, EVENT_BLOCK_MARKER);
+    postTimestamp(eb);
     postWord32(eb,0); // these get filled in later by closeBlockMarker();
     postWord64(eb,0);
     postCapNo(eb, eb->capno);
@@ -1479,6 +1966,21 @@ void printAndClearEventBuf (EventsBuf *ebuf)
     if (ebuf->begin != NULL && ebuf->pos != ebuf->begin)
     {
         size_t elog_size = ebuf->pos - ebuf->begin;
+#if defined(THREADED_RTS)
+        // See Note [Asynchronous eventlog writer]
+        if (async_writer_running) {
+            if (handOffEventBuf(ebuf, elog_size)) {
+                flushCount++;
+            }
+            resetEventsBuf(ebuf);
+            postBlockMarker(ebuf);
+            if (ebuf->dropped > 0) {
+                postEventlogDropped(ebuf);
+            }
+            postSampledCounters(ebuf);
+            return;
+        }
+#endif
         if (!writeEventLog(ebuf->begin, elog_size)) {
             debugBelch(
                     "printAndClearEventLog: could not flush event log\n"
@@ -1491,6 +1993,7 @@ void printAndClearEventBuf (EventsBuf *ebuf)
         flushCount++;
 
         postBlockMarker(ebuf);
+        postSampledCounters(ebuf);
     }
 }
 
@@ -1500,12 +2003,22 @@ void initEventsBuf(EventsBuf* eb, StgWord64 size, EventCapNo capno)
     eb->size = size;
     eb->marker = NULL;
     eb->capno = capno;
+    eb->n_events = 0;
+    eb->dropped = 0;
+    eb->sched_skip = 0;
+    eb->spark_skip = 0;
+    eb->rng = 2463534242U + capno;
+    eb->run_sampled = false;
+    for (int i = 0; i < N_SCHED_COUNTERS; i++) {
+        eb->sched_counts[i] = 0;
+    }
 }
 
 void resetEventsBuf(EventsBuf* eb)
 {
     eb->pos = eb->begin;
     eb->marker = NULL;
+    eb->n_events = 0;
 }
 
 StgBool hasRoomForEvent(EventsBuf *eb, EventTypeNum eNum)
@@ -15,6 +15,8 @@
 
 #include "BeginPrivate.h"
 
+char *eventLogFileName(const char *ext);
+
 #if defined(TRACING)
 
 /*
@@ -172,6 +174,8 @@ void postConcUpdRemSetFlush(Capability *cap);
 void postConcMarkEnd(StgWord32 marked_obj_count);
 void postNonmovingHeapCensus(int log_blk_size,
                              const struct NonmovingAllocCensus *census);
+void postBlockCacheCounters(Capability *cap, StgWord hits, StgWord slow_path);
+void postSchedCounters(Capability *cap);
 
 #else /* !TRACING */
 
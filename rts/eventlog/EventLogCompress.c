@@ -0,0 +1,290 @@
+/* -----------------------------------------------------------------------------
+ *
+ * (c) The GHC Team, 2021
+ *
+ * Block compression for eventlogs.
+ *
+ * ---------------------------------------------------------------------------*/
+
+#include "PosixSource.h"
+#include "Rts.h"
+
+#include "RtsUtils.h"
+#include "rts/EventLogWriter.h"
+#include "eventlog/EventLogCompress.h"
+
+#include <string.h>
+#include <stdio.h>
+#include <fs_rts.h>
+
+/* Note [Compressed eventlogs]
+ * ~~~~~~~~~~~~~~~~~~~~~~~~~~~
+ * With +RTS --eventlog-compress the eventlog is written by
+ * CompressedFileEventLogWriter (EventLogWriter.c), which compresses every
+ * chunk it is asked to write separately.  Apart from the header, each such
+ * chunk is the contents of one EventsBuf, i.e. exactly one block started by
+ * an EVENT_BLOCK_MARKER (see printAndClearEventBuf), so a reader can skip
+ * from block to block without decompressing, and decompress just the blocks
+ * it is interested in.
+ *
+ * The file starts with the 8 bytes EVENTLOG_LZ_MAGIC, followed by frames:
+ *
+ *    Word32 uncompressed length n
+ *    Word32 compressed length c, or 0 if the frame is stored uncompressed
+ *    c bytes of compressed data, or n bytes of uncompressed data if c == 0
+ *
+ * with the lengths big-endian, like everything else in the eventlog.
+ * Concatenating the uncompressed frames gives the ordinary eventlog.
+ *
+ * The compression is a simple byte-oriented LZ77 in the style of LZ4, chosen
+ * because it is fast enough to run on the capability that fills a buffer and
+ * needs no external library.  A block is a sequence of
+ *
+ *    token: Word8, high nibble: literal count L, low nibble: match length - 4
+ *    if L == 15: more length bytes, added to L, up to one that is not 255
+ *    L literal bytes
+ *    offset: Word16 little-endian, 1 <= offset <= 65535
+ *    if the match nibble is 15: more length bytes, as for L
+ *
+ * where the last sequence ends after its literals.  Eventlogs are very
+ * repetitive (event headers, thread ids, close timestamps), so this typically
+ * shrinks them several times.
+ *
+ * The writer compresses into a single frame buffer that it allocates when
+ * the eventlog starts and frees when it stops, rather than allocating one
+ * per write, so capabilities flushing at the same time take turns.
+ *
+ * decompressEventLogFile turns a compressed eventlog back into an ordinary
+ * one, for tools and for the testsuite.
+ */
+
+#define LZ_HASH_BITS  12
+#define LZ_MIN_MATCH  4
+#define LZ_MAX_OFFSET 0xffff
+
+static inline uint32_t
+read32 (const uint8_t *p)
+{
+    uint32_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static inline uint32_t
+lzHash (uint32_t v)
+{
+    return (v * 2654435761U) >> (32 - LZ_HASH_BITS);
+}
+
+static uint8_t *
+putLength (uint8_t *op, size_t n)
+{
+    while (n >= 255) {
+        *op++ = 255;
+        n -= 255;
+    }
+    *op++ = (uint8_t)n;
+    return op;
+}
+
+// A match_len of 0 means the final, literals-only sequence.
+static uint8_t *
+putSequence (uint8_t *op, const uint8_t *lit, size_t n_lit,
+             size_t offset, size_t match_len)
+{
+    size_t m = match_len ? match_len - LZ_MIN_MATCH : 0;
+    *op++ = (uint8_t)((stg_min(n_lit, 15) << 4) | stg_min(m, 15));
+    if (n_lit >= 15) {
+        op = putLength(op, n_lit - 15);
+    }
+    memcpy(op, lit, n_lit);
+    op += n_lit;
+    if (match_len) {
+        *op++ = (uint8_t)(offset & 0xff);
+        *op++ = (uint8_t)(offset >> 8);
+        if (m >= 15) {
+            op = putLength(op, m - 15);
+        }
+    }
+    return op;
+}
+
+size_t
+compressEventLogBlock (const uint8_t *src, size_t len, uint8_t *dst)
+{
+    uint32_t table[1 << LZ_HASH_BITS];
+    const uint8_t *ip = src, *anchor = src, *end = src + len;
+    uint8_t *op = dst;
+
+    ASSERT(len <= EVENTLOG_LZ_MAX_FRAME);
+    memset(table, 0, sizeof(table));
+
+    while ((size_t)(end - ip) >= LZ_MIN_MATCH) {
+        uint32_t v = read32(ip);
+        uint32_t h = lzHash(v);
+        const uint8_t *ref = src + table[h];
+        table[h] = ip - src;
+
+        if (ref < ip && ip - ref <= LZ_MAX_OFFSET && read32(ref) == v) {
+            size_t n = LZ_MIN_MATCH;
+            while (ip + n < end && ref[n] == ip[n]) {
+                n++;
+            }
+            op = putSequence(op, anchor, ip - anchor, ip - ref, n);
+            ip += n;
+            anchor = ip;
+        } else {
+            ip++;
+        }
+    }
+
+    op = putSequence(op, anchor, end - anchor, 0, 0);
+    return op - dst;
+}
+
+static bool
+getLength (const uint8_t **ip, const uint8_t *iend, size_t *n)
+{
+    uint8_t b;
+    do {
+        if (*ip == iend) {
+            return false;
+        }
+        b = *(*ip)++;
+        *n += b;
+    } while (b == 255);
+    return true;
+}
+
+bool
+decompressEventLogBlock (const uint8_t *src, size_t src_len,
+                         uint8_t *dst, size_t dst_len)
+{
+    const uint8_t *ip = src, *iend = src + src_len;
+    uint8_t *op = dst, *oend = dst + dst_len;
+
+    while (ip < iend) {
+        uint8_t token = *ip++;
+
+        size_t n_lit = token >> 4;
+        if (n_lit == 15 && !getLength(&ip, iend, &n_lit)) {
+            return false;
+        }
+        if ((size_t)(iend - ip) < n_lit || (size_t)(oend - op) < n_lit) {
+            return false;
+        }
+        memcpy(op, ip, n_lit);
+        ip += n_lit;
+        op += n_lit;
+
+        if (ip == iend) {
+            break; // the final sequence has no match
+        }
+
+        if (iend - ip < 2) {
+            return false;
+        }
+        size_t offset = ip[0] | (ip[1] << 8);
+        ip += 2;
+        size_t n = token & 15;
+        if (n == 15 && !getLength(&ip, iend, &n)) {
+            return false;
+        }
+        n += LZ_MIN_MATCH;
+        if (offset == 0 || offset > (size_t)(op - dst)
+                || (size_t)(oend - op) < n) {
+            return false;
+        }
+        // the match may overlap the output, so copy byte by byte
+        const uint8_t *ref = op - offset;
+        for (size_t i = 0; i < n; i++) {
+            op[i] = ref[i];
+        }
+        op += n;
+    }
+
+    return op == oend;
+}
+
+/* -----------------------------------------------------------------------------
+ * Decoding a whole file
+ * -------------------------------------------------------------------------- */
+
+static bool
+readWord32BE (FILE *f, uint32_t *w)
+{
+    uint8_t b[4];
+    if (fread(b, 1, 4, f) != 4) {
+        return false;
+    }
+    *w = ((uint32_t)b[0] << 24) | ((uint32_t)b[1] << 16)
+       | ((uint32_t)b[2] << 8) | (uint32_t)b[3];
+    return true;
+}
+
+bool
+decompressEventLogFile (const char *in_path, const char *out_path)
+{
+    FILE *in = NULL, *out = NULL;
+    uint8_t *raw = NULL, *comp = NULL;
+    bool ok = false;
+    char magic[EVENTLOG_LZ_MAGIC_LEN];
+
+    if ((in = __rts_fopen(in_path, "rb")) == NULL) {
+        sysErrorBelch("decompressEventLogFile: can't open %s", in_path);
+        goto done;
+    }
+    if ((out = __rts_fopen(out_path, "wb")) == NULL) {
+        sysErrorBelch("decompressEventLogFile: can't open %s", out_path);
+        goto done;
+    }
+    if (fread(magic, 1, EVENTLOG_LZ_MAGIC_LEN, in) != EVENTLOG_LZ_MAGIC_LEN
+            || memcmp(magic, EVENTLOG_LZ_MAGIC, EVENTLOG_LZ_MAGIC_LEN) != 0) {
+        errorBelch("decompressEventLogFile: %s is not a compressed eventlog",
+                   in_path);
+        goto done;
+    }
+
+    raw = stgMallocBytes(EVENTLOG_LZ_MAX_FRAME, "decompressEventLogFile");
+    comp = stgMallocBytes(EVENTLOG_LZ_BOUND(EVENTLOG_LZ_MAX_FRAME),
+                          "decompressEventLogFile");
+
+    uint32_t raw_len, comp_len;
+    while (readWord32BE(in, &raw_len)) {
+        if (!readWord32BE(in, &comp_len)
+                || raw_len > EVENTLOG_LZ_MAX_FRAME
+                || comp_len > EVENTLOG_LZ_BOUND(raw_len)) {
+            goto corrupt;
+        }
+        if (comp_len == 0) {
+            if (fread(raw, 1, raw_len, in) != raw_len) {
+                goto corrupt;
+            }
+        } else {
+            if (fread(comp, 1, comp_len, in) != comp_len
+                    || !decompressEventLogBlock(comp, comp_len,
+                                                raw, raw_len)) {
+                goto corrupt;
+            }
+        }
+        if (fwrite(raw, 1, raw_len, out) != raw_len) {
+            sysErrorBelch("decompressEventLogFile: can't write %s", out_path);
+            goto done;
+        }
+    }
+
+    ok = !ferror(in);
+    if (!ok) {
+        sysErrorBelch("decompressEventLogFile: can't read %s", in_path);
+    }
+    goto done;
+
+corrupt:
+    errorBelch("decompressEventLogFile: %s is corrupt", in_path);
+done:
+    if (raw) stgFree(raw);
+    if (comp) stgFree(comp);
+    if (in) fclose(in);
+    if (out && fclose(out) != 0) ok = false;
+    return ok;
+}
@@ -0,0 +1,32 @@
+/* -----------------------------------------------------------------------------
+ *
+ * (c) The GHC Team, 2021
+ *
+ * Block compression for eventlogs.
+ *
+ * ---------------------------------------------------------------------------*/
+
+#pragma once
+
+#include "BeginPrivate.h"
+
+/* Magic number at the start of a compressed eventlog */
+#define EVENTLOG_LZ_MAGIC "GHCEVLZ1"
+#define EVENTLOG_LZ_MAGIC_LEN 8
+
+/* Frames larger than this are split */
+#define EVENTLOG_LZ_MAX_FRAME (16 * 1024 * 1024)
+
+/* An upper bound on the compressed size of len bytes */
+#define EVENTLOG_LZ_BOUND(len) ((len) + (len) / 255 + 16)
+
+/* Compress len bytes from src into dst, which must have room for
+ * EVENTLOG_LZ_BOUND(len) bytes. Returns the compressed size. */
+size_t compressEventLogBlock (const uint8_t *src, size_t len, uint8_t *dst);
+
+/* Decompress a block of src_len bytes into exactly dst_len bytes of dst.
+ * Returns false if the input is malformed. */
+bool decompressEventLogBlock (const uint8_t *src, size_t src_len,
+                              uint8_t *dst, size_t dst_len);
+
+#include "EndPrivate.h"
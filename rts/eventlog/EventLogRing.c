@@ -0,0 +1,370 @@
+/* -----------------------------------------------------------------------------
+ *
+ * (c) The GHC Team, 2021
+ *
+ * An EventLogWriter which writes into a memory-mapped ring buffer, for live
+ * monitoring by another process.
+ *
+ * ---------------------------------------------------------------------------*/
+
+#include "PosixSource.h"
+#include "Rts.h"
+
+#include "RtsUtils.h"
+#include "rts/EventLogWriter.h"
+#include "eventlog/EventLog.h"
+
+#if !defined(mingw32_HOST_OS)
+
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+
+/* Note [Eventlog ring buffer]
+ * ~~~~~~~~~~~~~~~~~~~~~~~~~~~
+ * With +RTS --eventlog-ring=<size> the eventlog is written by
+ * RingEventLogWriter into a ring buffer in a shared memory-mapped file,
+ * <program>.eventlog.ring, which another process can follow with
+ * openEventLogRing/readEventLogRing while the program runs.  Writing costs a
+ * memcpy; nothing waits for the consumer, which simply loses data if it falls
+ * more than a ring behind.
+ *
+ * The file consists of
+ *
+ *  - a control page (EventLogRingControl),
+ *  - an area of EVENTLOG_RING_HEADER_AREA bytes holding the eventlog header,
+ *  - the ring itself: ring_size bytes, a power of two.
+ *
+ * The first chunk passed to the writer is the eventlog header, produced by
+ * postHeaderEvents and ending with EVENT_DATA_BEGIN (see startEventLogging_).
+ * It goes to the header area.  Every later chunk, which is the contents of
+ * one EventsBuf and hence one EVENT_BLOCK_MARKER block, becomes a record in
+ * the ring: a RingRecord followed by the data, padded to 8 bytes.  Records
+ * wrap around the end of the ring.  The header followed by any sequence of
+ * whole records is a well-formed eventlog, so a consumer that has lost data
+ * resynchronises by reading the header again and continuing from a record
+ * boundary.
+ *
+ * Positions are byte offsets into the infinite stream of records; a position
+ * p lives at p % ring_size in the ring.  The producer (writes are serialised
+ * by ring_mutex) appends a record of length n at position w = write_pos by
+ *
+ *    reserve_pos = w + n     -- the bytes up to here may be overwritten
+ *    fence
+ *    copy the record into the ring
+ *    last_record_pos = w
+ *    write_pos = w + n       -- release: the record is complete
+ *
+ * The consumer reads the record at its position r < write_pos (acquire), and
+ * after copying it checks that reserve_pos - r <= ring_size, i.e. that the
+ * producer had not started overwriting the record while it was being copied.
+ * If that check fails, or r has already fallen behind write_pos - ring_size,
+ * the consumer has been overrun: it returns the header again and continues
+ * with the oldest record still in the ring.  To find that record, each
+ * record holds the position of the one before it, so the consumer walks
+ * back from last_record_pos for as long as the previous record starts no
+ * earlier than reserve_pos - ring_size.  A record overwritten during the
+ * walk is caught by the check above when it is read.
+ *
+ * Words in the control page and in record headers are in native byte order,
+ * since producer and consumer share a machine.
+ */
+
+#define EVENTLOG_RING_MAGIC       "GHCEVRNG"
+#define EVENTLOG_RING_VERSION     2
+#define EVENTLOG_RING_CONTROL     4096
+#define EVENTLOG_RING_HEADER_AREA (256 * 1024)
+#define EVENTLOG_RING_RECORD      0x65767263 /* 'e' 'v' 'r' 'c' */
+
+typedef struct {
+    char magic[8];                // EVENTLOG_RING_MAGIC, written last
+    StgWord32 version;
+    StgWord32 header_len;         // 0 until the header has been written
+    StgWord64 ring_size;
+    StgWord64 write_pos;
+    StgWord64 reserve_pos;
+    StgWord64 last_record_pos;
+} EventLogRingControl;
+
+typedef struct {
+    StgWord32 magic;              // EVENTLOG_RING_RECORD
+    StgWord32 len;                // bytes of data following
+    StgWord64 prev_pos;           // the previous record, or this one if none
+} RingRecord;
+
+#define RING_RECORD_SIZE(len) \
+    ((sizeof(RingRecord) + (len) + 7) & ~(StgWord64)7)
+
+static StgWord64
+ringMapSize (StgWord64 ring_size)
+{
+    return EVENTLOG_RING_CONTROL + EVENTLOG_RING_HEADER_AREA + ring_size;
+}
+
+static void
+ringCopyIn (uint8_t *ring, StgWord64 ring_size, StgWord64 pos,
+            const void *src, size_t len)
+{
+    StgWord64 off = pos & (ring_size - 1);
+    size_t first = stg_min(len, ring_size - off);
+    memcpy(ring + off, src, first);
+    memcpy(ring, (const uint8_t *)src + first, len - first);
+}
+
+static void
+ringCopyOut (const uint8_t *ring, StgWord64 ring_size, StgWord64 pos,
+             void *dst, size_t len)
+{
+    StgWord64 off = pos & (ring_size - 1);
+    size_t first = stg_min(len, ring_size - off);
+    memcpy(dst, ring + off, first);
+    memcpy((uint8_t *)dst + first, ring, len - first);
+}
+
+/* -----------------------------------------------------------------------------
+ * Producer
+ * -------------------------------------------------------------------------- */
+
+static int ring_fd = -1;
+static uint8_t *ring_map = NULL;
+static StgWord64 ring_size;
+static EventLogRingControl *ring_ctl;
+static uint8_t *ring_data;
+
+#if defined(THREADED_RTS)
+static Mutex ring_mutex;
+#endif
+
+static void
+initRingEventLogWriter (void)
+{
+    // the ring size is rounded up to a power of two
+    ring_size = 1;
+    while (ring_size < RtsFlags.TraceFlags.ring_size) {
+        ring_size <<= 1;
+    }
+
+    char *filename = eventLogFileName(".eventlog.ring");
+    ring_fd = open(filename, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (ring_fd < 0
+            || ftruncate(ring_fd, ringMapSize(ring_size)) != 0) {
+        sysErrorBelch("initRingEventLogWriter: can't create %s", filename);
+        stg_exit(EXIT_FAILURE);
+    }
+    ring_map = mmap(NULL, ringMapSize(ring_size), PROT_READ | PROT_WRITE,
+                    MAP_SHARED, ring_fd, 0);
+    if (ring_map == MAP_FAILED) {
+        sysErrorBelch("initRingEventLogWriter: can't map %s", filename);
+        stg_exit(EXIT_FAILURE);
+    }
+    stgFree(filename);
+
+    ring_ctl = (EventLogRingControl *)ring_map;
+    ring_data = ring_map + EVENTLOG_RING_CONTROL + EVENTLOG_RING_HEADER_AREA;
+    ring_ctl->version = EVENTLOG_RING_VERSION;
+    ring_ctl->header_len = 0;
+    ring_ctl->ring_size = ring_size;
+    ring_ctl->write_pos = 0;
+    ring_ctl->reserve_pos = 0;
+    ring_ctl->last_record_pos = 0;
+    SEQ_CST_FENCE();
+    memcpy(ring_ctl->magic, EVENTLOG_RING_MAGIC, sizeof(ring_ctl->magic));
+
+#if defined(THREADED_RTS)
+    initMutex(&ring_mutex);
+#endif
+}
+
+static bool
+writeRingEventLog (void *eventlog, size_t eventlog_size)
+{
+    bool ok = true;
+
+    ACQUIRE_LOCK(&ring_mutex);
+
+    if (ring_ctl->header_len == 0) {
+        // the first chunk is the header, see Note [Eventlog ring buffer]
+        if (eventlog_size > EVENTLOG_RING_HEADER_AREA) {
+            errorBelch("writeRingEventLog: eventlog header too large");
+            ok = false;
+        } else {
+            memcpy(ring_map + EVENTLOG_RING_CONTROL, eventlog, eventlog_size);
+            RELEASE_STORE(&ring_ctl->header_len, (StgWord32)eventlog_size);
+        }
+    } else if (RING_RECORD_SIZE(eventlog_size) > ring_size) {
+        ok = false;
+    } else {
+        StgWord64 pos = ring_ctl->write_pos;
+        StgWord64 len = RING_RECORD_SIZE(eventlog_size);
+        RingRecord rec = { .magic = EVENTLOG_RING_RECORD,
+                           .len = (StgWord32)eventlog_size,
+                           .prev_pos = pos == 0 ? 0
+                                       : ring_ctl->last_record_pos };
+
+        RELAXED_STORE(&ring_ctl->reserve_pos, pos + len);
+        SEQ_CST_FENCE();
+        ringCopyIn(ring_data, ring_size, pos, &rec, sizeof(rec));
+        ringCopyIn(ring_data, ring_size, pos + sizeof(rec),
+                   eventlog, eventlog_size);
+        RELEASE_STORE(&ring_ctl->last_record_pos, pos);
+        RELEASE_STORE(&ring_ctl->write_pos, pos + len);
+    }
+
+    RELEASE_LOCK(&ring_mutex);
+    return ok;
+}
+
+static void
+stopRingEventLogWriter (void)
+{
+    if (ring_map != NULL) {
+        munmap(ring_map, ringMapSize(ring_size));
+        ring_map = NULL;
+        close(ring_fd);
+        ring_fd = -1;
+#if defined(THREADED_RTS)
+        closeMutex(&ring_mutex);
+#endif
+    }
+}
+
+const EventLogWriter RingEventLogWriter = {
+    .initEventLogWriter = initRingEventLogWriter,
+    .writeEventLog = writeRingEventLog,
+    .flushEventLog = NULL,
+    .stopEventLogWriter = stopRingEventLogWriter
+};
+
+/* -----------------------------------------------------------------------------
+ * Consumer
+ * -------------------------------------------------------------------------- */
+
+struct EventLogRingReader_ {
+    int fd;
+    uint8_t *map;
+    StgWord64 ring_size;
+    const EventLogRingControl *ctl;
+    const uint8_t *data;
+    StgWord64 read_pos;
+    bool need_header;
+    uint8_t *buf;                 // ring_size bytes, for the current chunk
+};
+
+EventLogRingReader *
+openEventLogRing (const char *path)
+{
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        return NULL;
+    }
+
+    EventLogRingControl ctl;
+    if (read(fd, &ctl, sizeof(ctl)) != sizeof(ctl)
+            || memcmp(ctl.magic, EVENTLOG_RING_MAGIC, sizeof(ctl.magic)) != 0
+            || ctl.version != EVENTLOG_RING_VERSION
+            || ctl.ring_size == 0
+            || (ctl.ring_size & (ctl.ring_size - 1)) != 0) {
+        close(fd);
+        return NULL;
+    }
+
+    uint8_t *map = mmap(NULL, ringMapSize(ctl.ring_size), PROT_READ,
+                        MAP_SHARED, fd, 0);
+    if (map == MAP_FAILED) {
+        close(fd);
+        return NULL;
+    }
+
+    EventLogRingReader *r = stgMallocBytes(sizeof(EventLogRingReader),
+                                           "openEventLogRing");
+    r->fd = fd;
+    r->map = map;
+    r->ring_size = ctl.ring_size;
+    r->ctl = (const EventLogRingControl *)map;
+    r->data = map + EVENTLOG_RING_CONTROL + EVENTLOG_RING_HEADER_AREA;
+    r->read_pos = 0;
+    r->need_header = true;
+    r->buf = stgMallocBytes(stg_max(ctl.ring_size, EVENTLOG_RING_HEADER_AREA),
+                            "openEventLogRing");
+    return r;
+}
+
+// The oldest record that hasn't been overwritten yet, see
+// Note [Eventlog ring buffer].
+static StgWord64
+oldestEventLogRingRecord (EventLogRingReader *r)
+{
+    StgWord64 pos = ACQUIRE_LOAD(&r->ctl->last_record_pos);
+    StgWord64 reserve_pos = ACQUIRE_LOAD(&r->ctl->reserve_pos);
+    StgWord64 oldest = reserve_pos > r->ring_size
+                       ? reserve_pos - r->ring_size : 0;
+
+    for (;;) {
+        RingRecord rec;
+        ringCopyOut(r->data, r->ring_size, pos, &rec, sizeof(rec));
+        if (rec.magic != EVENTLOG_RING_RECORD
+                || rec.prev_pos >= pos || rec.prev_pos < oldest) {
+            return pos;
+        }
+        pos = rec.prev_pos;
+    }
+}
+
+const void *
+readEventLogRing (EventLogRingReader *r, size_t *len)
+{
+    const EventLogRingControl *ctl = r->ctl;
+
+    if (r->need_header) {
+        StgWord32 header_len = ACQUIRE_LOAD(&ctl->header_len);
+        if (header_len == 0 || header_len > EVENTLOG_RING_HEADER_AREA) {
+            return NULL;
+        }
+        memcpy(r->buf, r->map + EVENTLOG_RING_CONTROL, header_len);
+        r->need_header = false;
+        *len = header_len;
+        return r->buf;
+    }
+
+    StgWord64 write_pos = ACQUIRE_LOAD(&ctl->write_pos);
+    if (r->read_pos == write_pos) {
+        return NULL;
+    }
+
+    if (write_pos - r->read_pos <= r->ring_size) {
+        RingRecord rec;
+        ringCopyOut(r->data, r->ring_size, r->read_pos, &rec, sizeof(rec));
+        if (rec.magic == EVENTLOG_RING_RECORD
+                && RING_RECORD_SIZE(rec.len)
+                       <= write_pos - r->read_pos) {
+            ringCopyOut(r->data, r->ring_size, r->read_pos + sizeof(rec),
+                        r->buf, rec.len);
+            SEQ_CST_FENCE();
+            StgWord64 reserve_pos = ACQUIRE_LOAD(&ctl->reserve_pos);
+            if (reserve_pos - r->read_pos <= r->ring_size) {
+                r->read_pos += RING_RECORD_SIZE(rec.len);
+                *len = rec.len;
+                return r->buf;
+            }
+        }
+    }
+
+    // Overrun: start again from the header and the oldest record.
+    r->read_pos = oldestEventLogRingRecord(r);
+    r->need_header = true;
+    return readEventLogRing(r, len);
+}
+
+void
+closeEventLogRing (EventLogRingReader *r)
+{
+    munmap(r->map, ringMapSize(r->ring_size));
+    close(r->fd);
+    stgFree(r->buf);
+    stgFree(r);
+}
+
+#endif /* !mingw32_HOST_OS */
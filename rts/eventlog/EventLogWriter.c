@@ -11,6 +11,8 @@
 
 #include "RtsUtils.h"
 #include "rts/EventLogWriter.h"
+#include "eventlog/EventLog.h"
+#include "eventlog/EventLogCompress.h"
 
 #include <string.h>
 #include <stdio.h>
@@ -33,7 +35,25 @@ static bool writeEventLogFile(void *eventlog, size_t eventlog_size);
 static void flushEventLogFile(void);
 static void stopEventLogFileWriter(void);
 
-static char *outputFileName(void)
+static void initCompressedEventLogFileWriter(void);
+static bool writeCompressedEventLogFile(void *eventlog, size_t eventlog_size);
+static void stopCompressedEventLogFileWriter(void);
+
+#if defined(THREADED_RTS)
+// Capabilities write their buffers concurrently, and frame_buf is shared.
+static Mutex event_log_file_mutex;
+#endif
+
+// The compressed frame being written, reused from one write to the next.
+// It is grown if a chunk doesn't fit, but chunks are normally a single
+// event buffer, of EVENTLOG_LZ_FRAME_HINT bytes at most.
+#define EVENTLOG_LZ_FRAME_HINT (2 * 1024 * 1024)
+static uint8_t *frame_buf = NULL;
+static size_t frame_buf_size = 0;
+
+// The eventlog file name, <program><ext> by default; used by the writers in
+// other files too.
+char *eventLogFileName(const char *ext)
 {
 
     if (RtsFlags.TraceFlags.trace_output) {
@@ -53,13 +73,13 @@ static char *outputFileName(void)
         }
 #endif
         char *filename = stgMallocBytes(strlen(prog)
-                                        + 10 /* .%d */
-                                        + 10 /* .eventlog */,
+                                        + 22 /* .%d */
+                                        + strlen(ext) + 1,
                                         "initEventLogFileWriter");
 
         if (event_log_pid == -1) { // #4512
             // Single process
-            sprintf(filename, "%s.eventlog", prog);
+            sprintf(filename, "%s%s", prog, ext);
             event_log_pid = getpid();
         } else {
             // Forked process, eventlog already started by the parent
@@ -68,8 +88,8 @@ static char *outputFileName(void)
             // We don't have a FMT* symbol for pid_t, so we go via Word64
             // to be sure of not losing range. It would be nicer to have a
             // FMT* symbol or similar, though.
-            sprintf(filename, "%s.%" FMT_Word64 ".eventlog",
-                    prog, (StgWord64)event_log_pid);
+            sprintf(filename, "%s.%" FMT_Word64 "%s",
+                    prog, (StgWord64)event_log_pid, ext);
         }
         stgFree(prog);
         return filename;
@@ -79,7 +99,7 @@ static char *outputFileName(void)
 static void
 initEventLogFileWriter(void)
 {
-    char *event_log_filename = outputFileName();
+    char *event_log_filename = eventLogFileName(".eventlog");
 
     /* Open event log file for writing. */
     if ((event_log_file = __rts_fopen(event_log_filename, "wb+")) == NULL) {
@@ -132,3 +152,97 @@ const EventLogWriter FileEventLogWriter = {
     .flushEventLog = flushEventLogFile,
     .stopEventLogWriter = stopEventLogFileWriter
 };
+
+/* -----------------------------------------------------------------------------
+ * Compressed eventlog files, see Note [Compressed eventlogs] in
+ * EventLogCompress.c
+ * -------------------------------------------------------------------------- */
+
+static void
+initCompressedEventLogFileWriter(void)
+{
+    char *event_log_filename = eventLogFileName(".eventlog.lz");
+
+    if ((event_log_file = __rts_fopen(event_log_filename, "wb+")) == NULL) {
+        sysErrorBelch(
+            "initCompressedEventLogFileWriter: can't open %s",
+            event_log_filename);
+        stg_exit(EXIT_FAILURE);
+    }
+
+#if defined(THREADED_RTS)
+    initMutex(&event_log_file_mutex);
+#endif
+    frame_buf_size = 8 + EVENTLOG_LZ_BOUND(EVENTLOG_LZ_FRAME_HINT);
+    frame_buf = stgMallocBytes(frame_buf_size,
+                               "initCompressedEventLogFileWriter");
+
+    if (!writeEventLogFile((void *)EVENTLOG_LZ_MAGIC, EVENTLOG_LZ_MAGIC_LEN)) {
+        sysErrorBelch("initCompressedEventLogFileWriter: can't write %s",
+                      event_log_filename);
+    }
+    stgFree(event_log_filename);
+}
+
+static void
+putWord32BE(uint8_t *p, uint32_t w)
+{
+    p[0] = (uint8_t)(w >> 24);
+    p[1] = (uint8_t)(w >> 16);
+    p[2] = (uint8_t)(w >> 8);
+    p[3] = (uint8_t)w;
+}
+
+static bool
+writeCompressedEventLogFile(void *eventlog, size_t eventlog_size)
+{
+    const uint8_t *src = eventlog;
+    bool ok = true;
+
+    ACQUIRE_LOCK(&event_log_file_mutex);
+    while (ok && eventlog_size > 0) {
+        size_t raw_len = stg_min(eventlog_size, EVENTLOG_LZ_MAX_FRAME);
+        if (8 + EVENTLOG_LZ_BOUND(raw_len) > frame_buf_size) {
+            frame_buf_size = 8 + EVENTLOG_LZ_BOUND(raw_len);
+            frame_buf = stgReallocBytes(frame_buf, frame_buf_size,
+                                        "writeCompressedEventLogFile");
+        }
+        size_t comp_len = compressEventLogBlock(src, raw_len, frame_buf + 8);
+        if (comp_len >= raw_len) {
+            // incompressible: store the frame as it is
+            memcpy(frame_buf + 8, src, raw_len);
+            comp_len = 0;
+        }
+        putWord32BE(frame_buf, raw_len);
+        putWord32BE(frame_buf + 4, comp_len);
+
+        ok = writeEventLogFile(frame_buf,
+                               8 + (comp_len ? comp_len : raw_len));
+        src += raw_len;
+        eventlog_size -= raw_len;
+    }
+    RELEASE_LOCK(&event_log_file_mutex);
+
+    return ok;
+}
+
+static void
+stopCompressedEventLogFileWriter(void)
+{
+    if (event_log_file != NULL) {
+        stopEventLogFileWriter();
+        stgFree(frame_buf);
+        frame_buf = NULL;
+        frame_buf_size = 0;
+#if defined(THREADED_RTS)
+        closeMutex(&event_log_file_mutex);
+#endif
+    }
+}
+
+const EventLogWriter CompressedFileEventLogWriter = {
+    .initEventLogWriter = initCompressedEventLogFileWriter,
+    .writeEventLog = writeCompressedEventLogFile,
+    .flushEventLog = flushEventLogFile,
+    .stopEventLogWriter = stopCompressedEventLogFileWriter
+};
@@ -447,27 +447,28 @@ void setExecutable (void *p, W_ len, bool exec)
 #if defined(USE_LARGE_ADDRESS_SPACE)
 
 static void *
-osTryReserveHeapMemory (W_ len, void *hint)
+osTryReserveHeapMemory (W_ len, W_ align, void *hint)
 {
     void *base, *top;
     void *start, *end;
 
-    ASSERT((len & ~MBLOCK_MASK) == len);
+    ASSERT((len & ~(align - 1)) == len);
 
-    /* We try to allocate len + MBLOCK_SIZE,
-       because we need memory which is MBLOCK_SIZE aligned,
-       and then we discard what we don't need */
+    /* We try to allocate len + align,
+       because we need memory which is aligned (to MBLOCK_SIZE, or to
+       HUGE_PAGE_SIZE with --huge-pages), and then we discard what we
+       don't need */
 
-    base = my_mmap(hint, len + MBLOCK_SIZE, MEM_RESERVE);
+    base = my_mmap(hint, len + align, MEM_RESERVE);
     if (base == NULL)
         return NULL;
 
-    top = (void*)((W_)base + len + MBLOCK_SIZE);
+    top = (void*)((W_)base + len + align);
 
-    if (((W_)base & MBLOCK_MASK) != 0) {
-        start = MBLOCK_ROUND_UP(base);
-        end = MBLOCK_ROUND_DOWN(top);
-        ASSERT(((W_)end - (W_)start) == len);
+    if (((W_)base & (align - 1)) != 0) {
+        start = (void*)(((W_)base + align - 1) & ~(align - 1));
+        end = (void*)((W_)start + len);
+        ASSERT((W_)end <= (W_)top);
 
         if (munmap(base, (W_)start-(W_)base) < 0) {
             sysErrorBelch("unable to release slop before heap");
@@ -574,9 +575,11 @@ void *osReserveHeapMemory(void *startAddressPtr, W_ *len)
     }
 #endif
 
+    W_ align = RtsFlags.GcFlags.hugePages ? HUGE_PAGE_SIZE : MBLOCK_SIZE;
+
     attempt = 0;
     while (1) {
-        *len &= ~MBLOCK_MASK;
+        *len &= ~(align - 1);
 
         if (*len < MBLOCK_SIZE) {
             // Give up if the system won't even give us 16 blocks worth of heap
@@ -584,7 +587,7 @@ void *osReserveHeapMemory(void *startAddressPtr, W_ *len)
         }
 
         void *hint = (void*)(startAddress + attempt * BLOCK_SIZE);
-        at = osTryReserveHeapMemory(*len, hint);
+        at = osTryReserveHeapMemory(*len, align, hint);
         if (at == NULL) {
             // This means that mmap failed which we take to mean that we asked
             // for too much memory. This can happen due to POSIX resource
@@ -686,6 +689,45 @@ void osDecommitMemory(void *at, W_ size)
         sysErrorBelch("unable to decommit memory");
 }
 
+void osAdviseHugePages(void *at STG_UNUSED, W_ size STG_UNUSED)
+{
+#if defined(MADV_HUGEPAGE)
+    // Failure is not fatal: the kernel may have been built without
+    // transparent huge pages, or have them disabled.
+    (void)madvise(at, size, MADV_HUGEPAGE);
+#endif
+}
+
+StgWord64 osHugePageBytes(void *at STG_UNUSED, W_ size STG_UNUSED)
+{
+#if defined(linux_HOST_OS)
+    // Sum the AnonHugePages of every mapping overlapping the range; the
+    // committed heap is made of many mappings (see osCommitMemory).
+    FILE *f = fopen("/proc/self/smaps", "r");
+    if (f == NULL) {
+        return 0;
+    }
+
+    StgWord64 total = 0;
+    bool overlaps = false;
+    W_ lo = (W_)at, hi = (W_)at + size;
+    char line[512];
+    while (fgets(line, sizeof(line), f) != NULL) {
+        unsigned long start, end, kb;
+        if (sscanf(line, "%lx-%lx ", &start, &end) == 2) {
+            overlaps = start < hi && end > lo;
+        } else if (overlaps
+                   && sscanf(line, "AnonHugePages: %lu kB", &kb) == 1) {
+            total += (StgWord64)kb * 1024;
+        }
+    }
+    fclose(f);
+    return total;
+#else
+    return 0;
+#endif
+}
+
 void osReleaseHeapMemory(void)
 {
     int r;
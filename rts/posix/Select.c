@@ -16,6 +16,7 @@
 #include "Schedule.h"
 #include "Prelude.h"
 #include "RaiseAsync.h"
+#include "Threads.h"
 #include "RtsUtils.h"
 #include "Capability.h"
 #include "Select.h"
@@ -31,6 +32,13 @@
 #  include <sys/types.h>
 # endif
 
+# if defined(HAVE_SYS_EPOLL_H)
+#  include <sys/epoll.h>
+#  include <fcntl.h>
+#  include <limits.h>
+#  include <unistd.h>
+# endif
+
 #include <errno.h>
 #include <string.h>
 
@@ -82,6 +90,32 @@ LowResTime getDelayTarget (HsInt us)
     }
 }
 
+/* Note [The sleeping heap]
+ * ~~~~~~~~~~~~~~~~~~~~~~~~~
+ * Threads blocked in threadDelay (BlockedOnDelay) are kept in a binary
+ * min-heap, sleeping_heap, ordered by their wake-up time
+ * tso->block_info.target.  This used to be a list sorted by insertion,
+ * which made each threadDelay O(n) in the number of sleeping threads, and
+ * so made a program with many threads sleeping at once (or with many
+ * 'timeout's, which sleep in a thread of their own) quadratic.
+ *
+ * With the heap, delay# (insertSleepingThread) is O(log n), and so is
+ * cancelling a delay when the thread is woken by an exception
+ * (removeSleepingThread, from removeFromQueues), because each sleeping
+ * thread records its position in the heap in tso->sleep_index.
+ * awaitEvent only ever looks at the root, which is the next thread to
+ * wake up.
+ *
+ * The heap is an array of TSO pointers outside the heap proper, so it is
+ * a GC root: markAwaitEvent evacuates each entry.  Evacuation doesn't
+ * change the order, and sleep_index is copied with the TSO.  Sleeping
+ * threads don't use tso->_link.
+ */
+
+static StgTSO **sleeping_heap = NULL;
+static uint32_t sleeping_heap_size = 0;
+uint32_t n_sleeping_threads = 0;
+
 /* There's a clever trick here to avoid problems when the time wraps
  * around.  Since our maximum delay is smaller than 31 bits of ticks
  * (it's actually 31 bits of microseconds), we can safely check
@@ -92,18 +126,98 @@ LowResTime getDelayTarget (HsInt us)
  *
  * if this is true, then our time has expired.
  * (idea due to Andy Gill).
+ *
+ * The heap orders targets the same way.
  */
+static inline bool wakesBefore (StgTSO *a, StgTSO *b)
+{
+    return ((long)a->block_info.target - (long)b->block_info.target) < 0;
+}
+
+static inline void setSleeping (uint32_t i, StgTSO *tso)
+{
+    sleeping_heap[i] = tso;
+    tso->sleep_index = i;
+}
+
+static void siftUp (uint32_t i, StgTSO *tso)
+{
+    while (i > 0) {
+        uint32_t parent = (i - 1) / 2;
+        if (!wakesBefore(tso, sleeping_heap[parent])) {
+            break;
+        }
+        setSleeping(i, sleeping_heap[parent]);
+        i = parent;
+    }
+    setSleeping(i, tso);
+}
+
+static void siftDown (uint32_t i, StgTSO *tso)
+{
+    for (;;) {
+        uint32_t child = 2 * i + 1;
+        if (child >= n_sleeping_threads) {
+            break;
+        }
+        if (child + 1 < n_sleeping_threads
+            && wakesBefore(sleeping_heap[child + 1], sleeping_heap[child])) {
+            child++;
+        }
+        if (!wakesBefore(sleeping_heap[child], tso)) {
+            break;
+        }
+        setSleeping(i, sleeping_heap[child]);
+        i = child;
+    }
+    setSleeping(i, tso);
+}
+
+void
+insertSleepingThread (StgTSO *tso)
+{
+    if (n_sleeping_threads == sleeping_heap_size) {
+        sleeping_heap_size = sleeping_heap_size ? 2 * sleeping_heap_size : 64;
+        sleeping_heap = stgReallocBytes(sleeping_heap,
+                                        sleeping_heap_size * sizeof(StgTSO *),
+                                        "insertSleepingThread");
+    }
+    n_sleeping_threads++;
+    siftUp(n_sleeping_threads - 1, tso);
+}
+
+void
+removeSleepingThread (StgTSO *tso)
+{
+    uint32_t i = tso->sleep_index;
+    StgTSO *last;
+
+    ASSERT(i < n_sleeping_threads && sleeping_heap[i] == tso);
+    n_sleeping_threads--;
+    if (i == n_sleeping_threads) {
+        return;
+    }
+    // fill the hole with the last entry, which may belong either above
+    // or below it
+    last = sleeping_heap[n_sleeping_threads];
+    if (i > 0 && wakesBefore(last, sleeping_heap[(i - 1) / 2])) {
+        siftUp(i, last);
+    } else {
+        siftDown(i, last);
+    }
+}
+
 static bool wakeUpSleepingThreads (LowResTime now)
 {
     StgTSO *tso;
     bool flag = false;
 
-    while (sleeping_queue != END_TSO_QUEUE) {
-        tso = sleeping_queue;
+    while (n_sleeping_threads > 0) {
+        tso = sleeping_heap[0];
         if (((long)now - (long)tso->block_info.target) < 0) {
             break;
         }
-        sleeping_queue = tso->_link;
+        removeSleepingThread(tso);
         tso->why_blocked = NotBlocked;
         tso->_link = END_TSO_QUEUE;
         IF_DEBUG(scheduler, debugBelch("Waking up sleeping thread %lu\n",
@@ -203,6 +317,494 @@ static enum FdState fdPollWriteState (int fd)
         return RTS_FD_IS_READY;
 }
 
+/* Threads waiting on fds in the per-fd queues below, rather than on
+ * blocked_queue.  See Note [awaitEvent with epoll].
+ */
+StgWord n_epoll_waiters = 0;
+
+#if defined(HAVE_SYS_EPOLL_H)
+
+/* Note [awaitEvent with epoll]
+ * ~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+ * The select() version of awaitEvent below rebuilds its fd_sets from the
+ * whole of blocked_queue on every call, and can't handle descriptors at or
+ * above FD_SETSIZE at all.  Where we have epoll, we use that instead:
+ *
+ *  - waitRead# and waitWrite# call blockOnFd, which puts the thread on a
+ *    queue of its own for the fd and the direction, in fd_waiters[fd],
+ *    rather than on blocked_queue.  The fd is registered with our epoll
+ *    instance for the events its queues are waiting for.
+ *
+ *  - registrations use EPOLLONESHOT, so an fd is reported once and then
+ *    stays quiet until we re-arm it.  blockOnFd always re-arms the fd with
+ *    EPOLL_CTL_MOD, falling back to EPOLL_CTL_ADD if epoll has no entry
+ *    for it: the fd may have been closed and its number reused since we
+ *    last registered it, and the kernel drops the entry of a closed file
+ *    without telling us, so anything we cached about it could be stale.
+ *
+ *  - awaitEvent calls epoll_wait and wakes all the threads queued on the
+ *    fds and directions it reports, as select() did.  So the cost of a
+ *    call depends on the number of threads it wakes, not on the number
+ *    that are blocked, and the number of fds is not limited.  Then it
+ *    re-arms the reported fds that still have waiters.
+ *
+ *  - a thread that is taken off its queue by an exception (see
+ *    removeFromQueues) is removed with removeThreadBlockedOnFd.  The fd
+ *    stays armed; if it is reported with nobody waiting, we drop the event.
+ *
+ *  - an fd that is closed while threads wait on it is never reported, and
+ *    since the queues are GC roots, not even the deadlock detector would
+ *    notice them.  So when awaitEvent would block for long, it waits for
+ *    at most fd_check_ms, and if that wait times out with nothing to do it
+ *    re-arms each fd that has waiters (checkWaitedFds).  For an fd that
+ *    has been closed this fails with EBADF and its threads go to
+ *    blocked_queue, to get blockedOnBadFD as they would have with
+ *    select(); for an fd whose number has been reused it registers the new
+ *    file, so its waiters see it become ready, again as with select().
+ *    The interval doubles each time a check finds the program still idle,
+ *    up to FD_CHECK_MAX_MS, and is reset whenever epoll reports something.
+ *    So a busy program never pays for the check, and an idle one pays a
+ *    system call per waited-on fd only every so often.  The fds with
+ *    waiters are kept in the dense array waited_fds, so that the check
+ *    (and the GC, markAwaitEvent) needn't look at the others.
+ *
+ *  - epoll refuses regular files (EPERM), and we can't register an fd that
+ *    is not open (EBADF).  Threads blocked on such fds go on blocked_queue
+ *    as before, together with any already queued on the fd.  While it is
+ *    not empty, awaitEvent doesn't wait: it wakes the threads whose fd is
+ *    still open, since select() would have said that regular files are
+ *    always ready, and raises blockedOnBadFD in the others.
+ *
+ * The queues are GC roots (markAwaitEvent).  n_epoll_waiters counts the
+ * threads on them, for the scheduler's EMPTY_BLOCKED_QUEUE().
+ *
+ * The epoll instance is created on first use.  If that fails, e.g. on
+ * kernels without epoll, we fall back to select().  The child of
+ * forkProcess shares the parent's instance, so it closes it and makes its
+ * own (resetAwaitEventAfterFork).
+ */
+
+#define EPOLL_MAX_EVENTS 256
+
+typedef struct {
+    StgTSO *hd[2], *tl[2];  // threads blocked reading and writing the fd
+    int waited_ix;          // index in waited_fds, or -1
+} FdWaiters;
+
+#define FD_CHECK_MIN_MS 10
+#define FD_CHECK_MAX_MS 1280
+
+static int epoll_fd = -1;
+static bool epoll_failed = false;
+
+static FdWaiters *fd_waiters = NULL;
+static int n_fd_waiters = 0;
+
+// The fds whose queues are not empty
+static int *waited_fds = NULL;
+static int n_waited_fds = 0;
+
+static int fd_check_ms = FD_CHECK_MIN_MS;
+
+static bool
+useEpoll (void)
+{
+    if (epoll_fd >= 0) {
+        return true;
+    }
+    if (epoll_failed) {
+        return false;
+    }
+    epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    if (epoll_fd < 0) {
+        IF_DEBUG(scheduler,
+                 debugBelch("epoll_create1 failed (errno %d), "
+                            "using select\n", errno));
+        epoll_failed = true;
+        return false;
+    }
+    return true;
+}
+
+static FdWaiters *
+fdWaiters (int fd)
+{
+    if (fd < 0) {
+        fdOutOfRange(fd);
+    }
+    if (fd >= n_fd_waiters) {
+        int i, n = n_fd_waiters ? n_fd_waiters : 64;
+        while (n <= fd) {
+            n *= 2;
+        }
+        fd_waiters = stgReallocBytes(fd_waiters, n * sizeof(FdWaiters),
+                                     "fdWaiters");
+        waited_fds = stgReallocBytes(waited_fds, n * sizeof(int),
+                                     "fdWaiters");
+        for (i = n_fd_waiters; i < n; i++) {
+            fd_waiters[i].hd[0] = fd_waiters[i].tl[0] = END_TSO_QUEUE;
+            fd_waiters[i].hd[1] = fd_waiters[i].tl[1] = END_TSO_QUEUE;
+            fd_waiters[i].waited_ix = -1;
+        }
+        n_fd_waiters = n;
+    }
+    return &fd_waiters[fd];
+}
+
+static int
+fdDirection (StgTSO *tso)
+{
+    switch (tso->why_blocked) {
+    case BlockedOnRead:  return 0;
+    case BlockedOnWrite: return 1;
+    default: barf("fdDirection: %d", tso->why_blocked);
+    }
+}
+
+// Keep waited_fds up to date after the queues of w have changed.
+static void
+trackWaitedFd (FdWaiters *w)
+{
+    bool waited = w->hd[0] != END_TSO_QUEUE || w->hd[1] != END_TSO_QUEUE;
+
+    if (waited && w->waited_ix < 0) {
+        w->waited_ix = n_waited_fds;
+        waited_fds[n_waited_fds++] = w - fd_waiters;
+    } else if (!waited && w->waited_ix >= 0) {
+        int last = waited_fds[--n_waited_fds];
+        waited_fds[w->waited_ix] = last;
+        fd_waiters[last].waited_ix = w->waited_ix;
+        w->waited_ix = -1;
+    }
+}
+
+// Move the threads queued on fd in direction dir to blocked_queue.
+static void
+unpollFdQueue (FdWaiters *w, int dir)
+{
+    StgTSO *tso, *next;
+
+    for (tso = w->hd[dir]; tso != END_TSO_QUEUE; tso = next) {
+        next = tso->_link;
+        tso->_link = END_TSO_QUEUE;
+        appendToBlockedQueue(tso);
+        n_epoll_waiters--;
+    }
+    w->hd[dir] = w->tl[dir] = END_TSO_QUEUE;
+}
+
+// Arm fd for the events its queues are waiting for.  If epoll won't have
+// the fd, e.g. because it has been closed, move its threads to
+// blocked_queue.
+static void
+armFd (int fd, FdWaiters *w)
+{
+    struct epoll_event ev;
+    uint32_t events = (w->hd[0] != END_TSO_QUEUE ? EPOLLIN : 0)
+                    | (w->hd[1] != END_TSO_QUEUE ? EPOLLOUT : 0);
+    int r;
+
+    if (events == 0) {
+        return;
+    }
+
+    memset(&ev, 0, sizeof(ev));
+    ev.events = events | EPOLLONESHOT;
+    ev.data.fd = fd;
+
+    // see Note [awaitEvent with epoll] for why we never trust that the fd
+    // is registered already
+    r = epoll_ctl(epoll_fd, EPOLL_CTL_MOD, fd, &ev);
+    if (r < 0 && errno == ENOENT) {
+        r = epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &ev);
+    }
+    if (r == 0) {
+        return;
+    }
+
+    if (errno != EPERM && errno != EBADF) {
+        sysErrorBelch("epoll_ctl");
+        stg_exit(EXIT_FAILURE);
+    }
+    unpollFdQueue(w, 0);
+    unpollFdQueue(w, 1);
+    trackWaitedFd(w);
+}
+
+// Re-arm every fd that has waiters, to notice those that have been closed
+// or reused.  See Note [awaitEvent with epoll].
+static void
+checkWaitedFds (void)
+{
+    int i;
+
+    // armFd may take fds off waited_fds, which moves the last one down,
+    // so go backwards
+    for (i = n_waited_fds - 1; i >= 0; i--) {
+        if (i < n_waited_fds) {
+            armFd(waited_fds[i], &fd_waiters[waited_fds[i]]);
+        }
+    }
+}
+
+void
+blockOnFd (StgTSO *tso)
+{
+    if (!useEpoll()) {
+        appendToBlockedQueue(tso);
+        return;
+    }
+
+    int fd = tso->block_info.fd;
+    int dir = fdDirection(tso);
+    FdWaiters *w = fdWaiters(fd);
+
+    ASSERT(tso->_link == END_TSO_QUEUE);
+    if (w->hd[dir] == END_TSO_QUEUE) {
+        w->hd[dir] = tso;
+    } else {
+        setTSOLink(&MainCapability, w->tl[dir], tso);
+    }
+    w->tl[dir] = tso;
+    n_epoll_waiters++;
+    trackWaitedFd(w);
+
+    armFd(fd, w);
+}
+
+void
+removeThreadBlockedOnFd (Capability *cap, StgTSO *tso)
+{
+    if (epoll_fd >= 0) {
+        int fd = tso->block_info.fd;
+        int dir = fdDirection(tso);
+        FdWaiters *w = &fd_waiters[fd];
+        StgTSO *t;
+
+        for (t = w->hd[dir]; t != END_TSO_QUEUE; t = t->_link) {
+            if (t == tso) {
+                removeThreadFromDeQueue(cap, &w->hd[dir], &w->tl[dir], tso);
+                n_epoll_waiters--;
+                trackWaitedFd(w);
+                return;
+            }
+        }
+    }
+    removeThreadFromDeQueue(cap, &blocked_queue_hd, &blocked_queue_tl, tso);
+}
+
+static void
+markFdWaiters (evac_fn evac, void *user)
+{
+    int i;
+
+    // the queues of the other fds are empty
+    for (i = 0; i < n_waited_fds; i++) {
+        FdWaiters *w = &fd_waiters[waited_fds[i]];
+        evac(user, (StgClosure **)(void *)&w->hd[0]);
+        evac(user, (StgClosure **)(void *)&w->tl[0]);
+        evac(user, (StgClosure **)(void *)&w->hd[1]);
+        evac(user, (StgClosure **)(void *)&w->tl[1]);
+    }
+}
+
+static void
+resetFdWaitersAfterFork (void)
+{
+    ASSERT(n_epoll_waiters == 0);
+    if (epoll_fd >= 0) {
+        close(epoll_fd);
+        epoll_fd = -1;
+    }
+    stgFree(fd_waiters);
+    stgFree(waited_fds);
+    fd_waiters = NULL;
+    waited_fds = NULL;
+    n_fd_waiters = 0;
+    n_waited_fds = 0;
+    fd_check_ms = FD_CHECK_MIN_MS;
+}
+
+static void
+wakeUpFdQueue (FdWaiters *w, int dir)
+{
+    StgTSO *tso, *next;
+
+    for (tso = w->hd[dir]; tso != END_TSO_QUEUE; tso = next) {
+        next = tso->_link;
+        IF_DEBUG(scheduler,
+                 debugBelch("Waking up blocked thread %lu\n",
+                            (unsigned long)tso->id));
+        tso->why_blocked = NotBlocked;
+        tso->_link = END_TSO_QUEUE;
+        pushOnRunQueue(&MainCapability,tso);
+        n_epoll_waiters--;
+    }
+    w->hd[dir] = w->tl[dir] = END_TSO_QUEUE;
+}
+
+/* Empty blocked_queue, which only has threads blocked on fds that epoll
+ * would not take.
+ */
+static void
+wakeUpUnpolledThreads (void)
+{
+    StgTSO *tso, *next;
+
+    for (tso = blocked_queue_hd; tso != END_TSO_QUEUE; tso = next) {
+        next = tso->_link;
+        tso->_link = END_TSO_QUEUE;
+        int fd = tso->block_info.fd;
+
+        if (fcntl(fd, F_GETFD) == -1 && errno == EBADF) {
+            IF_DEBUG(scheduler,
+                debugBelch("Killing blocked thread %lu on bad fd=%i\n",
+                           (unsigned long)tso->id, fd));
+            raiseAsync(&MainCapability, tso,
+                (StgClosure *)blockedOnBadFD_closure, false, NULL);
+        } else {
+            IF_DEBUG(scheduler,
+                debugBelch("Waking up blocked thread %lu\n",
+                           (unsigned long)tso->id));
+            tso->why_blocked = NotBlocked;
+            pushOnRunQueue(&MainCapability,tso);
+        }
+    }
+    blocked_queue_hd = blocked_queue_tl = END_TSO_QUEUE;
+}
+
+static void
+awaitEventEpoll (bool wait)
+{
+    struct epoll_event events[EPOLL_MAX_EVENTS];
+    int i, n, timeout;
+    bool check;
+    LowResTime now;
+
+    /* loop until we've woken up some threads, as in awaitEvent */
+    do {
+
+      now = getLowResTimeOfDay();
+      if (wakeUpSleepingThreads(now)) {
+          return;
+      }
+
+      if (!wait || blocked_queue_hd != END_TSO_QUEUE) {
+          timeout = 0;
+      } else if (n_sleeping_threads > 0) {
+          // round up, so that we don't wake up just too early, and
+          // truncate what doesn't fit, as in awaitEvent
+          Time min = LowResTimeToTime(sleeping_heap[0]->block_info.target - now);
+          Time ms = TimeToMS(min + MSToTime(1) - 1);
+          timeout = ms < INT_MAX ? (int)ms : INT_MAX;
+      } else {
+          timeout = -1;
+      }
+
+      // don't block for long without checking for closed fds, see
+      // Note [awaitEvent with epoll]
+      check = n_waited_fds > 0 && timeout != 0
+              && (timeout < 0 || timeout > fd_check_ms);
+      if (check) {
+          timeout = fd_check_ms;
+      }
+
+      while ((n = epoll_wait(epoll_fd, events, EPOLL_MAX_EVENTS, timeout)) < 0) {
+          if (errno != EINTR) {
+              sysErrorBelch("epoll_wait");
+              stg_exit(EXIT_FAILURE);
+          }
+
+          /* We got a signal; as in awaitEvent. */
+#if defined(RTS_USER_SIGNALS)
+          if (RtsFlags.MiscFlags.install_signal_handlers && signals_pending()) {
+              startSignalHandlers(&MainCapability);
+              return; /* still hold the lock */
+          }
+#endif
+          if (sched_state >= SCHED_INTERRUPTING) {
+              return; /* still hold the lock */
+          }
+          wakeUpSleepingThreads(getLowResTimeOfDay());
+          if (!emptyRunQueue(&MainCapability)) {
+              return; /* still hold the lock */
+          }
+      }
+
+      for (i = 0; i < n; i++) {
+          int fd = events[i].data.fd;
+          uint32_t ev = events[i].events;
+          FdWaiters *w = &fd_waiters[fd];
+
+          // EPOLLONESHOT has disarmed it
+          if (ev & (EPOLLIN | EPOLLERR | EPOLLHUP)) {
+              wakeUpFdQueue(w, 0);
+          }
+          if (ev & (EPOLLOUT | EPOLLERR | EPOLLHUP)) {
+              wakeUpFdQueue(w, 1);
+          }
+          trackWaitedFd(w);
+          armFd(fd, w);
+      }
+
+      if (n > 0) {
+          fd_check_ms = FD_CHECK_MIN_MS;
+      } else if (check) {
+          checkWaitedFds();
+          fd_check_ms = stg_min(2 * fd_check_ms, FD_CHECK_MAX_MS);
+      }
+
+      wakeUpUnpolledThreads();
+
+    } while (wait && sched_state == SCHED_RUNNING
+             && emptyRunQueue(&MainCapability));
+}
+
+#else
+
+void
+blockOnFd (StgTSO *tso)
+{
+    appendToBlockedQueue(tso);
+}
+
+void
+removeThreadBlockedOnFd (Capability *cap, StgTSO *tso)
+{
+    removeThreadFromDeQueue(cap, &blocked_queue_hd, &blocked_queue_tl, tso);
+}
+
+static void
+markFdWaiters (evac_fn evac STG_UNUSED, void *user STG_UNUSED)
+{
+}
+
+static void
+resetFdWaitersAfterFork (void)
+{
+}
+
+#endif /* HAVE_SYS_EPOLL_H */
+
+void
+markAwaitEvent (evac_fn evac, void *user)
+{
+    uint32_t i;
+
+    for (i = 0; i < n_sleeping_threads; i++) {
+        evac(user, (StgClosure **)(void *)&sleeping_heap[i]);
+    }
+    markFdWaiters(evac, user);
+}
+
+void
+resetAwaitEventAfterFork (void)
+{
+    // forkProcess has deleted all our threads, so the queues are empty
+    ASSERT(n_sleeping_threads == 0);
+    resetFdWaitersAfterFork();
+}
+
 /* Argument 'wait' says whether to wait for I/O to become available,
  * or whether to just check and return immediately.  If there are
  * other threads ready to run, we normally do the non-waiting variety,
@@ -235,6 +837,13 @@ awaitEvent(bool wait)
              debugBelch("\n");
              );
 
+#if defined(HAVE_SYS_EPOLL_H)
+    if (useEpoll()) {
+        awaitEventEpoll(wait);
+        return;
+    }
+#endif
+
     /* loop until we've woken up some threads.  This loop is needed
      * because the select timing isn't accurate, we sometimes sleep
      * for a while but not long enough to wake up a thread in
@@ -298,7 +907,7 @@ awaitEvent(bool wait)
           tv.tv_sec  = 0;
           tv.tv_usec = 0;
           ptv = &tv;
-      } else if (sleeping_queue != END_TSO_QUEUE) {
+      } else if (n_sleeping_threads > 0) {
           /* SUSv2 allows implementations to have an implementation defined
            * maximum timeout for select(2). The standard requires
            * implementations to silently truncate values exceeding this maximum
@@ -317,7 +926,7 @@ awaitEvent(bool wait)
            */
           const time_t max_seconds = 2678400; // 31 * 24 * 60 * 60
 
-          Time min = LowResTimeToTime(sleeping_queue->block_info.target - now);
+          Time min = LowResTimeToTime(sleeping_heap[0]->block_info.target - now);
           tv.tv_sec  = TimeToSeconds(min);
           if (tv.tv_sec < max_seconds) {
               tv.tv_usec = TimeToUS(min) % 1000000;
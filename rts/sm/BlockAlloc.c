@@ -729,6 +729,109 @@ allocBlockOnNode_lock(uint32_t node)
     return bd;
 }
 
+/* -----------------------------------------------------------------------------
+   Per-capability block caches
+
+   Note [Per-capability block caches]
+   ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+   The block allocator is protected by sm_mutex, which the mutator has to take
+   whenever it needs a block group outside of its nursery: for large objects,
+   pinned object blocks, compact regions, mutable list blocks and so on. With
+   many capabilities allocating heavily sm_mutex becomes contended.
+
+   To avoid this each capability has a BlockCache (cap->block_cache) holding a
+   few groups of each size from 1 to BLOCK_CACHE_MAX_GROUP blocks. An
+   allocation of such a size is served from the cache without taking any
+   lock. When the cache has no group of the requested size we take sm_mutex
+   once and fetch about BLOCK_CACHE_BATCH_BLOCKS blocks worth of groups of
+   that size. Larger requests go straight to the global free lists.
+
+   Some callers take sm_mutex right after allocating anyway, to link the group
+   onto a generation's lists (large objects, compact regions). They take the
+   lock first and call allocGroupCached_locked instead, so that a miss or a
+   large request is served under that same lock rather than a second one.
+
+   Cached groups have been allocated as far as the block allocator is
+   concerned (they are counted in n_alloc_blocks). To keep the block
+   accounting exact, and so that the GC can return free memory to the OS,
+   the caches are flushed back to the free lists at the start of every GC.
+   Only the owner of a capability touches its cache, except for the flush,
+   which is done while all capabilities are stopped.
+
+   The hits and slow_path counters of each cache are emitted with the
+   BLOCK_CACHE_COUNTERS event before the flush (see traceBlockCacheCounters).
+   -------------------------------------------------------------------------- */
+
+void
+initBlockCache (BlockCache *cache)
+{
+    for (uint32_t i = 0; i < BLOCK_CACHE_MAX_GROUP; i++) {
+        cache->groups[i] = NULL;
+    }
+    cache->hits = 0;
+    cache->slow_path = 0;
+}
+
+// The owner of the cache must hold the capability. If locked, the caller
+// holds sm_mutex already, otherwise we take it if we need it.
+static bdescr *
+allocGroupCached_ (BlockCache *cache, uint32_t node, W_ n, bool locked)
+{
+    bdescr *bd;
+
+    if (n == 0 || n > BLOCK_CACHE_MAX_GROUP) {
+        cache->slow_path++;
+        return locked ? allocGroupOnNode(node, n)
+                      : allocGroupOnNode_lock(node, n);
+    }
+
+    bd = cache->groups[n-1];
+    if (bd != NULL) {
+        cache->hits++;
+    } else {
+        cache->slow_path++;
+        if (!locked) {
+            ACQUIRE_SM_LOCK;
+        }
+        for (W_ i = 0; i < stg_max(1, BLOCK_CACHE_BATCH_BLOCKS / n); i++) {
+            bdescr *new_bd = allocGroupOnNode(node, n);
+            new_bd->link = bd;
+            bd = new_bd;
+        }
+        if (!locked) {
+            RELEASE_SM_LOCK;
+        }
+    }
+
+    cache->groups[n-1] = bd->link;
+    bd->link = NULL;
+    return bd;
+}
+
+bdescr *
+allocGroupCached (BlockCache *cache, uint32_t node, W_ n)
+{
+    return allocGroupCached_(cache, node, n, false);
+}
+
+// For callers that hold sm_mutex anyway, e.g. to link the group onto a
+// generation's lists, so that a miss doesn't cost a second lock round trip.
+bdescr *
+allocGroupCached_locked (BlockCache *cache, uint32_t node, W_ n)
+{
+    return allocGroupCached_(cache, node, n, true);
+}
+
+// Return the cached groups to the free lists. Must hold sm_mutex.
+void
+flushBlockCache (BlockCache *cache)
+{
+    for (uint32_t i = 0; i < BLOCK_CACHE_MAX_GROUP; i++) {
+        freeChain(cache->groups[i]);
+        cache->groups[i] = NULL;
+    }
+}
+
 /* -----------------------------------------------------------------------------
    De-Allocation
    -------------------------------------------------------------------------- */
@@ -1030,6 +1133,91 @@ void returnMemoryToOS(uint32_t n /* megablocks */)
     );
 }
 
+/* Note [Incremental memory return]
+   ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+   After a major GC the heap may be much larger than the live data needs.
+   Returning the surplus in a single returnMemoryToOS() call from inside the
+   GC would put a burst of madvise()/munmap() calls, and the page faults that
+   follow if the memory is needed again, into the pause. Instead, with
+   +RTS --return-memory-rate=<size>:
+
+    * The major GC only decides how many megablocks should go back to the OS
+      (scheduleReturnMemoryToOS). The surplus must have persisted for
+      RtsFlags.GcFlags.returnMemoryDelay consecutive major GCs, and we only
+      return the smallest surplus seen over that window. A heap which
+      alternately grows and shrinks therefore keeps its memory rather than
+      returning and refaulting it in a sawtooth. Any major GC without a
+      surplus cancels the pending return.
+
+    * The pending megablocks are then returned returnMemoryRate megablocks at
+      a time by returnSomeMemoryToOS(), which is called by the capability
+      that ran each GC once the other capabilities have been released (see
+      scheduleDoGC), and by idle capabilities (see doIdleGCWork).
+
+   Without the flag no memory is returned to the OS.
+*/
+
+// Megablocks still to be returned to the OS, and the hysteresis window.
+// Protected by sm_mutex.
+static W_ pending_return_mblocks = 0;
+static W_ surplus_window_min = 0;
+static uint32_t surplus_window_gcs = 0;
+
+// Called at the end of each major GC with the number of megablocks the heap
+// holds beyond what it needs. Requires sm_mutex.
+void scheduleReturnMemoryToOS(W_ surplus /* megablocks */)
+{
+    if (RtsFlags.GcFlags.returnMemoryRate == 0) {
+        return;
+    }
+
+    if (surplus == 0) {
+        // The heap is (again) as big as it needs to be: don't return memory
+        // we are going to fault straight back in.
+        pending_return_mblocks = 0;
+        surplus_window_gcs = 0;
+        return;
+    }
+
+    if (surplus_window_gcs == 0) {
+        surplus_window_min = surplus;
+    } else {
+        surplus_window_min = stg_min(surplus_window_min, surplus);
+    }
+    surplus_window_gcs++;
+
+    if (surplus_window_gcs >= RtsFlags.GcFlags.returnMemoryDelay) {
+        pending_return_mblocks = surplus_window_min;
+        surplus_window_gcs = 0;
+    } else {
+        // Don't overshoot what this GC considers surplus.
+        pending_return_mblocks = stg_min(pending_return_mblocks, surplus);
+    }
+}
+
+// Return up to RtsFlags.GcFlags.returnMemoryRate of the pending megablocks
+// to the OS. Returns true if there is more to return.
+bool returnSomeMemoryToOS(void)
+{
+    if (RELAXED_LOAD(&pending_return_mblocks) == 0) {
+        return false;
+    }
+
+    ACQUIRE_SM_LOCK;
+    W_ n = stg_min(pending_return_mblocks,
+                   (W_)RtsFlags.GcFlags.returnMemoryRate);
+    pending_return_mblocks -= n;
+    if (n > 0) {
+        IF_DEBUG(gc, debugBelch("returning %" FMT_Word " megablock(s) to the OS, "
+                                "%" FMT_Word " pending\n",
+                                n, pending_return_mblocks));
+        returnMemoryToOS((uint32_t)n);
+    }
+    bool more = pending_return_mblocks > 0;
+    RELEASE_SM_LOCK;
+    return more;
+}
+
 /* -----------------------------------------------------------------------------
    Debugging
    -------------------------------------------------------------------------- */
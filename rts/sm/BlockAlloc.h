@@ -13,12 +13,39 @@
 bdescr *allocLargeChunk (W_ min, W_ max);
 bdescr *allocLargeChunkOnNode (uint32_t node, W_ min, W_ max);
 
+/* Per-capability block caches --------------------------------------------- */
+
+// Groups of 1 to BLOCK_CACHE_MAX_GROUP blocks are cached.
+#define BLOCK_CACHE_MAX_GROUP 8
+
+// Roughly how many blocks the cache fetches at once for each group size.
+#define BLOCK_CACHE_BATCH_BLOCKS 16
+
+// See Note [Per-capability block caches] in BlockAlloc.c.
+typedef struct BlockCache_ {
+    // groups[n-1] holds cached groups of n blocks, linked through link
+    bdescr *groups[BLOCK_CACHE_MAX_GROUP];
+    // allocations served from the cache
+    StgWord hits;
+    // allocations which had to take sm_mutex
+    StgWord slow_path;
+} BlockCache;
+
+void    initBlockCache      (BlockCache *cache);
+bdescr *allocGroupCached    (BlockCache *cache, uint32_t node, W_ n);
+bdescr *allocGroupCached_locked (BlockCache *cache, uint32_t node, W_ n);
+void    flushBlockCache     (BlockCache *cache);
+
 /* Debugging  -------------------------------------------------------------- */
 
 extern W_ countBlocks       (bdescr *bd);
 extern W_ countAllocdBlocks (bdescr *bd);
 extern void returnMemoryToOS(uint32_t n);
 
+// See Note [Incremental memory return] in BlockAlloc.c.
+void scheduleReturnMemoryToOS(W_ surplus);
+bool returnSomeMemoryToOS(void);
+
 #if defined(DEBUG)
 void checkFreeListSanity(void);
 W_   countFreeList(void);
@@ -200,7 +200,7 @@ compactAllocateBlockInternal(Capability            *cap,
     }
 
     ACQUIRE_SM_LOCK;
-    block = allocGroup(n_blocks);
+    block = allocGroupCached_locked(&cap->block_cache, cap->node, n_blocks);
     switch (operation) {
     case ALLOCATE_NEW:
         ASSERT(first == NULL);
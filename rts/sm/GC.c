@@ -377,6 +377,13 @@ GarbageCollect (uint32_t collect_gen,
   debugTrace(DEBUG_gc, "GC (gen %d, using %d thread(s))",
              N, n_gc_threads);
 
+  // Return the block groups cached by the capabilities to the block
+  // allocator. See Note [Per-capability block caches] in BlockAlloc.c.
+  for (n = 0; n < n_capabilities; n++) {
+      traceBlockCacheCounters(capabilities[n]);
+      flushBlockCache(&capabilities[n]->block_cache);
+  }
+
 #if defined(DEBUG)
   // check for memory leaks if DEBUG is on
   memInventory(DEBUG_gc);
@@ -478,9 +485,6 @@ GarbageCollect (uint32_t collect_gen,
   // Mark the stable pointer table.
   markStablePtrTable(mark_root, gct);
 
-  // Remember old stable name addresses.
-  rememberOldStableNameAddresses ();
-
   /* -------------------------------------------------------------------------
    * Repeatedly scavenge all the areas we know about until there's no
    * more scavenging to be done.
@@ -969,8 +973,8 @@ GarbageCollect (uint32_t collect_gen,
 
       got = mblocks_allocated;
 
-      if (got > need) {
-      }
+      // See Note [Incremental memory return] in BlockAlloc.c
+      scheduleReturnMemoryToOS(got > need ? got - need : 0);
   }
 
   // extra GC trace info
@@ -1197,13 +1201,18 @@ any_work (void)
 
 #if defined(THREADED_RTS)
     if (work_stealing) {
-        uint32_t n;
-        // look for work to steal
-        for (n = 0; n < n_gc_threads; n++) {
-            if (n == gct->thread_index) continue;
-            for (g = RtsFlags.GcFlags.generations-1; g >= 0; g--) {
-                ws = &gc_threads[n]->gens[g];
-                if (!looksEmptyWSDeque(ws->todo_q)) return true;
+        uint32_t n, pass;
+        uint32_t my_node = capNoToNumaNode(gct->thread_index);
+        // look for work to steal, on our own node first.
+        // See Note [NUMA-aware GC work stealing] in GCUtils.c
+        for (pass = 0; pass < (n_numa_nodes > 1 ? 2 : 1); pass++) {
+            for (n = 0; n < n_gc_threads; n++) {
+                if (n == gct->thread_index) continue;
+                if ((capNoToNumaNode(n) == my_node) != (pass == 0)) continue;
+                for (g = RtsFlags.GcFlags.generations-1; g >= 0; g--) {
+                    ws = &gc_threads[n]->gens[g];
+                    if (!looksEmptyWSDeque(ws->todo_q)) return true;
+                }
             }
         }
     }
@@ -2073,5 +2082,11 @@ void gcCAFs(void)
 
 bool doIdleGCWork(Capability *cap STG_UNUSED, bool all)
 {
-    return runSomeFinalizers(all);
+    bool more = runSomeFinalizers(all);
+    // Pending memory is only ever returned a little at a time; 'all'
+    // callers are about to GC, which recomputes it anyway.
+    if (!all) {
+        more = returnSomeMemoryToOS() || more;
+    }
+    return more;
 }
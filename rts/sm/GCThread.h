@@ -75,6 +75,11 @@
 
    ------------------------------------------------------------------------- */
 
+// Tags a chunk of a large array on a todo_q, as opposed to a block.
+// See Note [Parallel scavenging of large arrays] in Scav.c.
+#define ARRAY_SCAV_JOB_TAG 1
+#define IS_ARRAY_SCAV_JOB(p) (((StgWord)(p) & ARRAY_SCAV_JOB_TAG) != 0)
+
 typedef struct gen_workspace_ {
     generation * gen;           // the gen for this workspace
     struct gc_thread_ * my_gct; // the gc_thread that contains this workspace
@@ -85,6 +90,9 @@ typedef struct gen_workspace_ {
     StgPtr       todo_lim;             // lim for todo_bd
     struct NonmovingSegment *todo_seg; // only available for oldest gen workspace
 
+    // Blocks waiting to be scavenged. This may also hold chunks of large
+    // arrays, tagged with ARRAY_SCAV_JOB_TAG; see Note [Parallel scavenging
+    // of large arrays] in Scav.c.
     WSDeque *    todo_q;
     bdescr *     todo_overflow;
     uint32_t     n_todo_overflow;
@@ -110,7 +110,7 @@ grab_local_todo_block (gen_workspace *ws)
     bd = popWSDeque(ws->todo_q);
     if (bd != NULL)
     {
-        ASSERT(bd->link == NULL);
+        ASSERT(IS_ARRAY_SCAV_JOB(bd) || bd->link == NULL);
         return bd;
     }
 
@@ -118,15 +118,33 @@ grab_local_todo_block (gen_workspace *ws)
 }
 
 #if defined(THREADED_RTS)
-bdescr *
-steal_todo_block (uint32_t g)
+/* Note [NUMA-aware GC work stealing]
+   ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+   With +RTS --numa each GC thread runs on the node of its capability and
+   copies objects into to-space blocks allocated on that node (see
+   allocGroup_sync and allocBlocks_sync, which allocate on the node of gct).
+   A thief scavenges the blocks it steals, so stealing from a GC thread on
+   another node means reading every object in the block across the
+   interconnect, and pulling the objects they point to across as well.
+
+   Thieves therefore look at the deques of the GC threads on their own node
+   first, and only then at those on other nodes (steal_todo_block,
+   any_work). On a single node this is the same as before: one pass over
+   all the other GC threads.
+*/
+
+// Steal a todo block of generation g from a GC thread which is (same_node)
+// or is not (!same_node) on our NUMA node.
+static bdescr *
+steal_todo_block_from (uint32_t g, bool same_node)
 {
     uint32_t n;
+    uint32_t my_node = capNoToNumaNode(gct->thread_index);
     bdescr *bd;
 
-    // look for work to steal
     for (n = 0; n < n_gc_threads; n++) {
         if (n == gct->thread_index) continue;
+        if ((capNoToNumaNode(n) == my_node) != same_node) continue;
         bd = stealWSDeque(gc_threads[n]->gens[g].todo_q);
         if (bd) {
             return bd;
@@ -134,6 +152,20 @@ steal_todo_block (uint32_t g)
     }
     return NULL;
 }
+
+bdescr *
+steal_todo_block (uint32_t g)
+{
+    bdescr *bd;
+
+    // look for work to steal, on our own node first.
+    // See Note [NUMA-aware GC work stealing]
+    bd = steal_todo_block_from(g, true);
+    if (bd == NULL && n_numa_nodes > 1) {
+        bd = steal_todo_block_from(g, false);
+    }
+    return bd;
+}
 #endif
 
 void
@@ -96,6 +96,72 @@ typedef struct free_list {
 
 static free_list *free_list_head;
 static W_ mblock_high_watermark;
+// With --huge-pages: the end of the committed part of the address space,
+// always mblock_high_watermark rounded up to a huge page. Unused otherwise.
+// See Note [Huge page megablocks].
+static W_ mblock_commit_watermark;
+
+/* Note [Huge page megablocks]
+   ~~~~~~~~~~~~~~~~~~~~~~~~~~~
+   With +RTS --huge-pages we try to get the heap backed by transparent huge
+   pages (2MB on the platforms we care about), which cuts TLB misses for
+   programs with large heaps. The kernel will only use a huge page for a
+   HUGE_PAGE_SIZE-aligned range of a mapping which is entirely committed and
+   has been madvise(MADV_HUGEPAGE)d, so we
+
+    * reserve the address space HUGE_PAGE_SIZE-aligned (osReserveHeapMemory),
+
+    * only ever commit whole huge pages, advising each newly committed range
+      with osAdviseHugePages, and
+
+    * only ever decommit whole huge pages. Decommitting a single mblock
+      would split the huge page backing it and leave the remaining half
+      backed by small pages.
+
+   An mblock is still the unit of allocation, so a huge page can be partially
+   allocated. The invariant we keep is that, below mblock_high_watermark,
+   a huge page is committed iff at least one of its mblocks is allocated,
+   and that [mblock_high_watermark, mblock_commit_watermark) is committed:
+
+    * getFreshMBlocks commits up to the huge page containing the new
+      high watermark.
+
+    * getReusableMBlocks commits the huge pages lying wholly inside the free
+      extent it carves the allocation from. Any huge page straddling the
+      boundary of the extent has an allocated mblock outside it, since the
+      free list is coalesced, and so is committed already.
+
+    * decommitMBlocks decommits the huge pages lying wholly inside the
+      coalesced free extent the freed mblocks end up in, or everything above
+      the new high watermark's huge page if the free lowered it.
+
+   The number of bytes actually backed by huge pages is reported by +RTS -s;
+   the kernel may decline to use them (e.g. if they are disabled, or memory
+   is fragmented), in which case the flag costs nothing but the slightly
+   coarser decommit.
+*/
+
+#define HUGE_PAGE_ROUND_UP(p)   (((W_)(p) + HUGE_PAGE_SIZE - 1) & ~(HUGE_PAGE_SIZE - 1))
+#define HUGE_PAGE_ROUND_DOWN(p) ((W_)(p) & ~(HUGE_PAGE_SIZE - 1))
+
+static void commitHugePages(W_ lo, W_ hi)
+{
+    if (lo < hi) {
+        debugTrace(DEBUG_gc, "committing huge pages %p-%p",
+                   (void*)lo, (void*)hi);
+        osCommitMemory((void*)lo, hi - lo);
+        osAdviseHugePages((void*)lo, hi - lo);
+    }
+}
+
+static void decommitHugePages(W_ lo, W_ hi)
+{
+    if (lo < hi) {
+        debugTrace(DEBUG_gc, "decommitting huge pages %p-%p",
+                   (void*)lo, (void*)hi);
+        osDecommitMemory((void*)lo, hi - lo);
+    }
+}
 /*
  * it is quite important that these are in the same cache line as they
  * are both needed by HEAP_ALLOCED. Moreover, we need to ensure that they
@@ -159,6 +225,8 @@ static void *getReusableMBlocks(uint32_t n)
 
     for (iter = free_list_head; iter != NULL; iter = iter->next) {
         void *addr;
+        W_ ext_lo = iter->address;
+        W_ ext_hi = iter->address + iter->size;
 
         if (iter->size < size)
             continue;
@@ -183,7 +251,16 @@ static void *getReusableMBlocks(uint32_t n)
             stgFree(iter);
         }
 
-        osCommitMemory(addr, size);
+        if (RtsFlags.GcFlags.hugePages) {
+            // See Note [Huge page megablocks]
+            commitHugePages(
+                stg_max(HUGE_PAGE_ROUND_UP(ext_lo),
+                        HUGE_PAGE_ROUND_DOWN(addr)),
+                stg_min(HUGE_PAGE_ROUND_DOWN(ext_hi),
+                        HUGE_PAGE_ROUND_UP((W_)addr + size)));
+        } else {
+            osCommitMemory(addr, size);
+        }
         return addr;
     }
 
@@ -202,8 +279,17 @@ static void *getFreshMBlocks(uint32_t n)
         stg_exit(EXIT_HEAPOVERFLOW);
     }
 
-    osCommitMemory(addr, size);
     mblock_high_watermark += size;
+    if (RtsFlags.GcFlags.hugePages) {
+        // See Note [Huge page megablocks]
+        W_ commit_to = HUGE_PAGE_ROUND_UP(mblock_high_watermark);
+        if (commit_to > mblock_commit_watermark) {
+            commitHugePages(mblock_commit_watermark, commit_to);
+            mblock_commit_watermark = commit_to;
+        }
+    } else {
+        osCommitMemory(addr, size);
+    }
     return addr;
 }
 
@@ -220,13 +306,9 @@ static void *getCommittedMBlocks(uint32_t n)
     return p;
 }
 
-static void decommitMBlocks(char *addr, uint32_t n)
+static void insertFreeMBlocks(W_ address, W_ size)
 {
     struct free_list *iter, *prev;
-    W_ size = MBLOCK_SIZE * (W_)n;
-    W_ address = (W_)addr;
-
-    osDecommitMemory(addr, size);
 
     prev = NULL;
     for (iter = free_list_head; iter != NULL; iter = iter->next)
@@ -328,6 +410,48 @@ static void decommitMBlocks(char *addr, uint32_t n)
     }
 }
 
+static void decommitMBlocks(char *addr, uint32_t n)
+{
+    W_ size = MBLOCK_SIZE * (W_)n;
+    W_ address = (W_)addr;
+
+    if (!RtsFlags.GcFlags.hugePages) {
+        osDecommitMemory(addr, size);
+        insertFreeMBlocks(address, size);
+        return;
+    }
+
+    // See Note [Huge page megablocks]
+    insertFreeMBlocks(address, size);
+
+    if (address >= mblock_high_watermark) {
+        // The free lowered the high watermark.
+        W_ commit_to = HUGE_PAGE_ROUND_UP(mblock_high_watermark);
+        if (commit_to < mblock_commit_watermark) {
+            decommitHugePages(commit_to, mblock_commit_watermark);
+            mblock_commit_watermark = commit_to;
+        }
+    } else {
+        struct free_list *iter;
+        for (iter = free_list_head; iter != NULL; iter = iter->next) {
+            if (iter->address + iter->size > address) break;
+        }
+        ASSERT(iter != NULL && iter->address <= address);
+
+        W_ lo = stg_max(HUGE_PAGE_ROUND_UP(iter->address),
+                        HUGE_PAGE_ROUND_DOWN(address));
+        W_ hi = stg_min(HUGE_PAGE_ROUND_DOWN(iter->address + iter->size),
+                        HUGE_PAGE_ROUND_UP(address + size));
+        decommitHugePages(lo, hi);
+    }
+}
+
+StgWord64 getHeapHugePageBytes(void)
+{
+    return osHugePageBytes((void*)mblock_address_space.begin,
+                           mblock_high_watermark - mblock_address_space.begin);
+}
+
 void releaseFreeMemory(void)
 {
     // This function exists for releasing address space
@@ -557,6 +681,11 @@ void releaseFreeMemory(void)
     osReleaseFreeMemory();
 }
 
+StgWord64 getHeapHugePageBytes(void)
+{
+    return 0;
+}
+
 #endif /* !USE_LARGE_ADDRESS_SPACE */
 
 /* -----------------------------------------------------------------------------
@@ -635,6 +764,7 @@ freeAllMBlocks(void)
     mblock_address_space.begin = (W_)-1;
     mblock_address_space.end = (W_)-1;
     mblock_high_watermark = (W_)-1;
+    mblock_commit_watermark = (W_)-1;
 #else
     osFreeAllMBlocks();
 
@@ -671,6 +801,7 @@ initMBlocks(void)
         mblock_address_space.begin = (W_)addr;
         mblock_address_space.end = (W_)addr + size;
         mblock_high_watermark = (W_)addr;
+        mblock_commit_watermark = (W_)addr;
     }
 #elif SIZEOF_VOID_P == 8
     memset(mblock_cache,0xff,sizeof(mblock_cache));
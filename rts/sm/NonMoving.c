@@ -93,7 +93,8 @@ Mutex concurrent_coll_finished_lock;
  *
  * In addition, to relieve pressure on the block allocator we keep a small pool
  * of free blocks around (nonmovingHeap.free) which can be pushed/popped
- * to/from in a lock-free manner.
+ * to/from in a lock-free manner. Each capability caches a few of these in
+ * its magazine (see Note [Free segment magazines]).
  *
  *
  * === Allocation ===
@@ -106,7 +107,8 @@ Mutex concurrent_coll_finished_lock;
  * segment to make current from a few sources:
  *
  *  1. the allocator's active list (see pop_active_segment)
- *  2. the nonmoving heap's free block pool (see nonmovingPopFreeSegment)
+ *  2. the nonmoving heap's free block pool, by way of the capability's
+ *     magazine (see nonmovingPopFreeSegment)
  *  3. allocate a new segment from the block allocator (see
  *     nonmovingAllocSegment)
  *
@@ -494,7 +496,7 @@ static void* nonmovingConcurrentMark(void *mark_queue);
 #endif
 static void nonmovingMark_(MarkQueue *mark_queue, StgWeak **dead_weaks, StgTSO **resurrected_threads);
 
-static void nonmovingInitSegment(struct NonmovingSegment *seg, uint8_t log_block_size)
+void nonmovingInitSegment(struct NonmovingSegment *seg, uint8_t log_block_size)
 {
     bdescr *bd = Bdescr((P_) seg);
     seg->link = NULL;
@@ -506,9 +508,87 @@ static void nonmovingInitSegment(struct NonmovingSegment *seg, uint8_t log_block
     nonmovingClearBitmap(seg);
 }
 
-// Add a segment to the free list.
+/* Note [Free segment magazines]
+ * ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+ * When many capabilities promote into the nonmoving heap at once they all
+ * take their fresh segments from nonmovingHeap.free, which then sees a lot of
+ * CAS traffic. To avoid this each capability has a small magazine of free
+ * segments (nonmovingHeap.magazines[cap->no]), holding at most
+ * NONMOVING_MAGAZINE_SIZE segments, which only that capability's owner (the
+ * mutator or the GC thread running on its behalf) touches.
+ *
+ * The segments freed by the sweep go to the magazines first. The sweeper
+ * doesn't own a capability (it runs on the mark thread, concurrently with the
+ * mutators), so it can't touch segs; instead it pushes to the magazine's
+ * returned list with a CAS, picking the magazines in turn so that the
+ * segments are spread over the capabilities. A segment only goes to the
+ * global list (or back to the block allocator) if the magazine it picked
+ * already has NONMOVING_MAGAZINE_SIZE returned segments.
+ *
+ * nonmovingPopFreeSegment serves requests from the magazine. When segs is
+ * empty it first takes the returned list with a single exchange, and
+ * otherwise refills from the global list in a batch: the whole global list is
+ * taken with a single exchange. Either way the first NONMOVING_MAGAZINE_SIZE
+ * segments are kept and the rest are spilled to the global list with a single
+ * CAS. Since neither list is ever popped one segment at a time, they are not
+ * subject to the ABA problem.
+ *
+ * Segments in magazines remain counted towards oldest_gen->n_blocks but not
+ * towards nonmovingHeap.n_free, so the heap may hold on to up to
+ * 2 * NONMOVING_MAGAZINE_SIZE free segments per capability beyond
+ * NONMOVING_MAX_FREE.
+ *
+ * Each magazine counts its hits (requests served without the global list)
+ * and misses; they are reported by +RTS -s --internal-counters.
+ */
+
+// Push a chain of segments, linked from first to last, to the free list.
+static void push_free_segments(struct NonmovingSegment *first,
+                               struct NonmovingSegment *last)
+{
+    while (true) {
+        struct NonmovingSegment *old = nonmovingHeap.free;
+        last->link = old;
+        if (cas((StgVolatilePtr) &nonmovingHeap.free, (StgWord) old, (StgWord) first) == (StgWord) old)
+            break;
+    }
+}
+
+// Return a free segment to the next magazine in turn, unless that already
+// has enough returned segments. See Note [Free segment magazines].
+static bool nonmovingReturnToMagazine(struct NonmovingSegment *seg)
+{
+    static volatile StgWord next_magazine = 0;
+    uint32_t n_caps = nonmovingHeap.n_caps;
+    if (n_caps == 0) {
+        return false;
+    }
+
+    struct NonmovingSegmentMagazine *mag =
+        &nonmovingHeap.magazines[atomic_inc(&next_magazine, 1) % n_caps];
+    if (VOLATILE_LOAD(&mag->n_returned) >= NONMOVING_MAGAZINE_SIZE) {
+        return false;
+    }
+
+    // Count the segment before it becomes visible so that
+    // nonmovingTakeReturned never takes n_returned below zero.
+    __sync_add_and_fetch(&mag->n_returned, 1);
+    while (true) {
+        struct NonmovingSegment *old = mag->returned;
+        seg->link = old;
+        if (cas((StgVolatilePtr) &mag->returned, (StgWord) old, (StgWord) seg) == (StgWord) old)
+            break;
+    }
+    return true;
+}
+
+// Add a segment to a magazine or the free list.
 void nonmovingPushFreeSegment(struct NonmovingSegment *seg)
 {
+    if (nonmovingReturnToMagazine(seg)) {
+        return;
+    }
+
     // See Note [Live data accounting in nonmoving collector].
     if (nonmovingHeap.n_free > NONMOVING_MAX_FREE) {
         bdescr *bd = Bdescr((StgPtr) seg);
@@ -522,29 +602,108 @@ void nonmovingPushFreeSegment(struct NonmovingSegment *seg)
         return;
     }
 
-    while (true) {
-        struct NonmovingSegment *old = nonmovingHeap.free;
-        seg->link = old;
-        if (cas((StgVolatilePtr) &nonmovingHeap.free, (StgWord) old, (StgWord) seg) == (StgWord) old)
-            break;
-    }
+    // Count the segment before it becomes visible so that
+    // nonmovingRefillMagazine never takes n_free below zero.
     __sync_add_and_fetch(&nonmovingHeap.n_free, 1);
+    seg->link = NULL;
+    push_free_segments(seg, seg);
 }
 
-static struct NonmovingSegment *nonmovingPopFreeSegment(void)
+// Fill an empty magazine with the first NONMOVING_MAGAZINE_SIZE of a chain
+// of segments and spill the rest to the free list. Returns how many segments
+// were kept.
+static unsigned int nonmovingFillMagazine(struct NonmovingSegmentMagazine *mag,
+                                          struct NonmovingSegment *segs)
 {
-    while (true) {
-        struct NonmovingSegment *seg = nonmovingHeap.free;
-        if (seg == NULL) {
-            return NULL;
+    ASSERT(mag->segs == NULL && mag->n_segs == 0);
+    struct NonmovingSegment *last = segs;
+    unsigned int n = 1;
+    while (n < NONMOVING_MAGAZINE_SIZE && last->link != NULL) {
+        last = last->link;
+        n++;
+    }
+    struct NonmovingSegment *rest = last->link;
+    last->link = NULL;
+    mag->segs = segs;
+    mag->n_segs = n;
+
+    // Spill what we don't need to the free list
+    if (rest != NULL) {
+        struct NonmovingSegment *rest_last = rest;
+        unsigned int n_rest = 1;
+        while (rest_last->link != NULL) {
+            rest_last = rest_last->link;
+            n_rest++;
         }
-        if (cas((StgVolatilePtr) &nonmovingHeap.free,
-                (StgWord) seg,
-                (StgWord) seg->link) == (StgWord) seg) {
-            __sync_sub_and_fetch(&nonmovingHeap.n_free, 1);
-            return seg;
+        __sync_add_and_fetch(&nonmovingHeap.n_free, n_rest);
+        push_free_segments(rest, rest_last);
+    }
+    return n;
+}
+
+// Refill an empty magazine from the segments the sweeper returned to it.
+static void nonmovingTakeReturned(struct NonmovingSegmentMagazine *mag)
+{
+    if (VOLATILE_LOAD(&mag->returned) == 0) {
+        return;
+    }
+
+    struct NonmovingSegment *segs = (struct NonmovingSegment *)
+        xchg((StgPtr) &mag->returned, (StgWord) NULL);
+    if (segs == NULL) {
+        return;
+    }
+
+    unsigned int n = 0;
+    for (struct NonmovingSegment *seg = segs; seg != NULL; seg = seg->link) {
+        n++;
+    }
+    __sync_sub_and_fetch(&mag->n_returned, n);
+    nonmovingFillMagazine(mag, segs);
+}
+
+// Refill an empty magazine from the free list.
+static void nonmovingRefillMagazine(struct NonmovingSegmentMagazine *mag)
+{
+    if (VOLATILE_LOAD(&nonmovingHeap.free) == 0) {
+        return;
+    }
+
+    struct NonmovingSegment *segs = (struct NonmovingSegment *)
+        xchg((StgPtr) &nonmovingHeap.free, (StgWord) NULL);
+    if (segs == NULL) {
+        return;
+    }
+
+    // The spilled segments are counted again by nonmovingFillMagazine
+    unsigned int n = 0;
+    for (struct NonmovingSegment *seg = segs; seg != NULL; seg = seg->link) {
+        n++;
+    }
+    __sync_sub_and_fetch(&nonmovingHeap.n_free, n);
+    nonmovingFillMagazine(mag, segs);
+}
+
+static struct NonmovingSegment *nonmovingPopFreeSegment(Capability *cap)
+{
+    struct NonmovingSegmentMagazine *mag = &nonmovingHeap.magazines[cap->no];
+    if (mag->segs == NULL) {
+        nonmovingTakeReturned(mag);
+    }
+    if (mag->segs != NULL) {
+        mag->hits++;
+    } else {
+        mag->misses++;
+        nonmovingRefillMagazine(mag);
+        if (mag->segs == NULL) {
+            return NULL;
         }
     }
+
+    struct NonmovingSegment *seg = mag->segs;
+    mag->segs = seg->link;
+    mag->n_segs--;
+    return seg;
 }
 
 unsigned int nonmovingBlockCountFromSize(uint8_t log_block_size)
@@ -562,24 +721,24 @@ unsigned int nonmovingBlockCountFromSize(uint8_t log_block_size)
 }
 
 /*
- * Request a fresh segment from the free segment list or allocate one of the
- * given node.
+ * Request a fresh segment from the free segment list or allocate one on the
+ * capability's node.
  *
  * Caller must hold SM_MUTEX (although we take the gc_alloc_block_sync spinlock
  * under the assumption that we are in a GC context).
  */
-static struct NonmovingSegment *nonmovingAllocSegment(uint32_t node)
+static struct NonmovingSegment *nonmovingAllocSegment(Capability *cap)
 {
     // First try taking something off of the free list
     struct NonmovingSegment *ret;
-    ret = nonmovingPopFreeSegment();
+    ret = nonmovingPopFreeSegment(cap);
 
     // Nothing in the free list, allocate a new segment...
     if (ret == NULL) {
         // Take gc spinlock: another thread may be scavenging a moving
         // generation and call `todo_block_full`
         ACQUIRE_SPIN_LOCK(&gc_alloc_block_sync);
-        bdescr *bd = allocAlignedGroupOnNode(node, NONMOVING_SEGMENT_BLOCKS);
+        bdescr *bd = allocAlignedGroupOnNode(cap->node, NONMOVING_SEGMENT_BLOCKS);
         // See Note [Live data accounting in nonmoving collector].
         oldest_gen->n_blocks += bd->blocks;
         oldest_gen->n_words  += BLOCK_SIZE_W * bd->blocks;
@@ -682,9 +841,17 @@ void *nonmovingAllocate(Capability *cap, StgWord sz)
         // first look for a new segment in the active list
         struct NonmovingSegment *new_current = pop_active_segment(alloca);
 
+#if defined(THREADED_RTS)
+        // then try sweeping one ourselves.
+        // See Note [Parallel and lazy sweeping] in NonMovingSweep.c.
+        if (new_current == NULL && RtsFlags.GcFlags.nonmovingLazySweep) {
+            new_current = nonmovingLazySweep(log_block_size);
+        }
+#endif
+
         // there are no active segments, allocate new segment
         if (new_current == NULL) {
-            new_current = nonmovingAllocSegment(cap->node);
+            new_current = nonmovingAllocSegment(cap);
             nonmovingInitSegment(new_current, log_block_size);
         }
 
@@ -720,6 +887,7 @@ void nonmovingInit(void)
     initMutex(&nonmoving_collection_mutex);
     initCondition(&concurrent_coll_finished);
     initMutex(&concurrent_coll_finished_lock);
+    nonmovingInitSweep();
 #endif
     for (unsigned int i = 0; i < NONMOVING_ALLOCA_CNT; i++) {
         nonmovingHeap.allocators[i] = alloc_nonmoving_allocator(n_capabilities);
@@ -757,6 +925,8 @@ void nonmovingExit(void)
     for (unsigned int i = 0; i < NONMOVING_ALLOCA_CNT; i++) {
         free_nonmoving_allocator(nonmovingHeap.allocators[i]);
     }
+    stgFree(nonmovingHeap.magazines);
+    nonmovingHeap.magazines = NULL;
 }
 
 /*
@@ -770,6 +940,14 @@ void nonmovingAddCapabilities(uint32_t new_n_caps)
     unsigned int old_n_caps = nonmovingHeap.n_caps;
     struct NonmovingAllocator **allocs = nonmovingHeap.allocators;
 
+    // See Note [Free segment magazines].
+    nonmovingHeap.magazines =
+        stgReallocBytes(nonmovingHeap.magazines,
+                        new_n_caps * sizeof(struct NonmovingSegmentMagazine),
+                        "nonmovingAddCapabilities");
+    memset(&nonmovingHeap.magazines[old_n_caps], 0,
+           (new_n_caps - old_n_caps) * sizeof(struct NonmovingSegmentMagazine));
+
     for (unsigned int i = 0; i < NONMOVING_ALLOCA_CNT; i++) {
         struct NonmovingAllocator *old = allocs[i];
         allocs[i] = alloc_nonmoving_allocator(new_n_caps);
@@ -784,7 +962,7 @@ void nonmovingAddCapabilities(uint32_t new_n_caps)
 
         // Initialize current segments for the new capabilities
         for (unsigned int j = old_n_caps; j < new_n_caps; j++) {
-            allocs[i]->current[j] = nonmovingAllocSegment(capabilities[j]->node);
+            allocs[i]->current[j] = nonmovingAllocSegment(capabilities[j]);
             nonmovingInitSegment(allocs[i]->current[j], NONMOVING_ALLOCA0 + i);
             allocs[i]->current[j]->link = NULL;
         }
@@ -1046,6 +1224,12 @@ static void nonmovingMark_(MarkQueue *mark_queue, StgWeak **dead_weaks, StgTSO *
     debugTrace(DEBUG_nonmoving_gc, "Starting mark...");
     stat_startNonmovingGc();
 
+#if defined(THREADED_RTS)
+    // See Note [Parallel marking in the nonmoving collector] in
+    // NonMovingMark.c.
+    nonmovingStartMarkWorkers();
+#endif
+
     // Walk the list of filled segments that we collected during preparation,
     // updated their snapshot pointers and move them to the sweep list.
     for (int alloca_idx = 0; alloca_idx < NONMOVING_ALLOCA_CNT; ++alloca_idx) {
@@ -1226,6 +1410,7 @@ static void nonmovingMark_(MarkQueue *mark_queue, StgWeak **dead_weaks, StgTSO *
 
 #if defined(THREADED_RTS)
 finish:
+    nonmovingStopMarkWorkers();
     boundTaskExiting(task);
 
     // We are done...
@@ -78,6 +78,26 @@ struct NonmovingAllocator {
 // maximum number of free segments to hold on to
 #define NONMOVING_MAX_FREE 16
 
+// maximum number of free segments held by each capability's magazine
+#define NONMOVING_MAGAZINE_SIZE 4
+
+// A capability-local cache of free segments in front of nonmovingHeap.free.
+// Only touched by the capability's owner, except for returned.
+// See Note [Free segment magazines] in NonMoving.c.
+struct NonmovingSegmentMagazine {
+    struct NonmovingSegment *segs;  // linked through link
+    unsigned int n_segs;
+    // segments freed by the sweeper, taken by the owner when segs is empty.
+    // pushed to with CAS, taken with an exchange.
+    struct NonmovingSegment *returned;
+    // how many segments are on returned. accessed atomically.
+    unsigned int n_returned;
+    // segment requests served from the magazine
+    StgWord hits;
+    // segment requests which had to go to nonmovingHeap.free
+    StgWord misses;
+};
+
 struct NonmovingHeap {
     struct NonmovingAllocator *allocators[NONMOVING_ALLOCA_CNT];
     // free segment list. This is a cache where we keep up to
@@ -88,6 +108,9 @@ struct NonmovingHeap {
     // how many segments in free segment list? accessed atomically.
     unsigned int n_free;
 
+    // per-capability free segment caches, indexed by capability number
+    struct NonmovingSegmentMagazine *magazines;
+
     // records the current length of the nonmovingAllocator.current arrays
     unsigned int n_caps;
 
@@ -131,6 +154,7 @@ void nonmovingCollect(StgWeak **dead_weaks,
 void *nonmovingAllocate(Capability *cap, StgWord sz);
 void nonmovingAddCapabilities(uint32_t new_n_caps);
 void nonmovingPushFreeSegment(struct NonmovingSegment *seg);
+void nonmovingInitSegment(struct NonmovingSegment *seg, uint8_t log_block_size);
 void nonmovingClearBitmap(struct NonmovingSegment *seg);
 
 
@@ -26,6 +26,7 @@
 #include "MarkWeak.h"
 #include "sm/Storage.h"
 #include "CNF.h"
+#include "RtsUtils.h"
 
 static bool check_in_nonmoving_heap(StgClosure *p);
 static void mark_closure (MarkQueue *queue, const StgClosure *p, StgClosure **origin);
@@ -90,9 +91,9 @@ memcount n_nonmoving_marked_compact_blocks = 0;
  * move the same large object to nonmoving_marked_large_objects more than once.
  */
 static Mutex nonmoving_large_objects_mutex;
-// Note that we don't need a similar lock for compact objects becuase we never
-// mark a compact object eagerly in a write barrier; all compact objects are
-// marked by the mark thread, so there can't be any races here.
+// We never mark a compact object eagerly in a write barrier, so compact
+// objects can only race with other mark workers. We take the same lock when
+// marking them during a parallel mark pass.
 #endif
 
 /*
@@ -249,12 +250,86 @@ StgWord nonmoving_write_barrier_enabled = false;
  */
 MarkQueue *current_mark_queue = NULL;
 
+#if defined(THREADED_RTS)
+/* Note [Parallel marking in the nonmoving collector]
+ * ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+ * With +RTS --nonmoving-mark-threads=<n> the mark thread is assisted by n-1
+ * mark workers. The workers are started at the beginning of nonmovingMark_
+ * and stopped at its end; in between, each call to nonmovingMark is a
+ * parallel mark pass in which the mark thread (worker 0) and the workers all
+ * drain their own MarkQueue.
+ *
+ * Work is shared at the granularity of mark queue blocks. Each queue taking
+ * part in a pass has a WSDeque (MarkQueue.steal_q). When push fills a block
+ * it offers the full block on its deque instead of chaining it; when a queue
+ * runs dry its owner first takes its own blocks back (popWSDeque) and then
+ * tries to steal from the other workers (stealWSDeque). Blocks taken from the
+ * update remembered set are offered in the same way. If a deque is full we
+ * simply fall back to chaining the block as the sequential mark does.
+ *
+ * Termination follows scavenge_until_all_done: mark_workers_running counts the
+ * workers which may still produce work. A worker which has nothing to mark
+ * decrements it and spins, looking for stealable work, until it reaches zero.
+ * At that point all deques are empty and the pass is complete; the mark
+ * thread then carries on with the (sequential) thread and weak pointer
+ * tidying as usual. Since the final post-mark synchronisation also marks via
+ * nonmovingMark it is parallelised too.
+ *
+ * Marking an object is idempotent except for a few pieces of bookkeeping,
+ * which must tolerate two workers racing to mark the same object:
+ *
+ *  - the BF_MARKED flag of large and compact objects is only set while
+ *    holding nonmoving_large_objects_mutex,
+ *  - the mark bit of small objects is set with a CAS so that only one worker
+ *    accounts for the object in nonmoving_live_words,
+ *  - static objects, stacks and the selector optimisation already
+ *    synchronise with the mutator using CAS or closure locking.
+ *
+ * Both workers may trace the object's fields; this is wasted work but
+ * harmless.
+ *
+ * Once marking is done the workers are also used to sweep; see Note [Parallel
+ * and lazy sweeping] in NonMovingSweep.c.
+ */
+
+// Size of each mark worker's deque, in blocks.
+#define MARK_WORKER_DEQUE_SIZE 1024
+
+uint32_t n_nonmoving_mark_workers = 1;
+
+// Indexed by worker number. Entry 0 is the queue of the mark thread, which is
+// only set during a pass.
+MarkQueue **nonmoving_mark_worker_queues = NULL;
+
+static OSThreadId *mark_worker_threads = NULL;
+static WSDeque **mark_worker_deques = NULL;
+
+// Protects mark_workers_pass, mark_workers_job, mark_workers_finished and
+// mark_workers_exit.
+static Mutex mark_workers_lock;
+static Condition mark_workers_start_cond;
+static Condition mark_workers_done_cond;
+static uint32_t mark_workers_pass = 0;
+static uint32_t mark_workers_finished = 0;
+static bool mark_workers_exit = false;
+// What the workers do in the current pass.
+static void (*mark_workers_job)(uint32_t me) = NULL;
+
+// Number of workers still marking in the current pass.
+static volatile StgWord mark_workers_running = 0;
+// Number of mark queue entries processed in the current pass.
+static volatile StgWord mark_pass_count = 0;
+#endif
+
 /* Initialise update remembered set data structures */
 void nonmovingMarkInitUpdRemSet() {
 #if defined(THREADED_RTS)
     initMutex(&upd_rem_set_lock);
     initCondition(&upd_rem_set_flushed_cond);
     initMutex(&nonmoving_large_objects_mutex);
+    initMutex(&mark_workers_lock);
+    initCondition(&mark_workers_start_cond);
+    initCondition(&mark_workers_done_cond);
 #endif
 }
 
@@ -431,11 +506,25 @@ push (MarkQueue *q, const MarkQueueEnt *ent)
             // allocate a fresh block.
             ACQUIRE_SM_LOCK;
             bdescr *bd = allocGroup(MARK_QUEUE_BLOCKS);
+            RELEASE_SM_LOCK;
             bd->link = q->blocks;
+#if defined(THREADED_RTS)
+            // Offer the full block to the other mark workers.
+            // See Note [Parallel marking in the nonmoving collector].
+            if (q->steal_q != NULL) {
+                bdescr *full = q->blocks;
+                bdescr *rest = full->link;
+                full->link = NULL;
+                if (pushWSDeque(q->steal_q, full)) {
+                    bd->link = rest;
+                } else {
+                    full->link = rest;
+                }
+            }
+#endif
             q->blocks = bd;
             q->top = (MarkQueueBlock *) bd->start;
             q->top->head = 0;
-            RELEASE_SM_LOCK;
         }
     }
 
@@ -812,6 +901,19 @@ again:
     if (top->head == 0) {
         // Is this the first block of the queue?
         if (q->blocks->link == NULL) {
+#if defined(THREADED_RTS)
+            // Take back any blocks we offered to the other mark workers that
+            // they haven't stolen yet.
+            if (q->steal_q != NULL) {
+                bdescr *bd = popWSDeque(q->steal_q);
+                if (bd != NULL) {
+                    bd->link = q->blocks;
+                    q->blocks = bd;
+                    q->top = (MarkQueueBlock *) bd->start;
+                    goto again;
+                }
+            }
+#endif
             // Yes, therefore queue is empty...
             MarkQueueEnt none = { .null_entry = { .p = NULL } };
             return none;
@@ -888,6 +990,9 @@ static void init_mark_queue_ (MarkQueue *queue)
     memset(&queue->prefetch_queue, 0, sizeof(queue->prefetch_queue));
     queue->prefetch_head = 0;
 #endif
+#if defined(THREADED_RTS)
+    queue->steal_q = NULL;
+#endif
 }
 
 /* Must hold sm_mutex. */
@@ -1291,12 +1396,26 @@ mark_closure (MarkQueue *queue, const StgClosure *p0, StgClosure **origin)
             }
 
             if (! (bd->flags & BF_MARKED)) {
-                dbl_link_remove(bd, &nonmoving_compact_objects);
-                dbl_link_onto(bd, &nonmoving_marked_compact_objects);
-                StgWord blocks = str->totalW / BLOCK_SIZE_W;
-                n_nonmoving_compact_blocks -= blocks;
-                n_nonmoving_marked_compact_blocks += blocks;
-                bd->flags |= BF_MARKED;
+#if defined(THREADED_RTS)
+                // See Note [Parallel marking in the nonmoving collector].
+                const bool lock = n_nonmoving_mark_workers > 1;
+                if (lock) {
+                    ACQUIRE_LOCK(&nonmoving_large_objects_mutex);
+                }
+                if (! (bd->flags & BF_MARKED)) {
+#endif
+                    dbl_link_remove(bd, &nonmoving_compact_objects);
+                    dbl_link_onto(bd, &nonmoving_marked_compact_objects);
+                    StgWord blocks = str->totalW / BLOCK_SIZE_W;
+                    n_nonmoving_compact_blocks -= blocks;
+                    n_nonmoving_marked_compact_blocks += blocks;
+                    bd->flags |= BF_MARKED;
+#if defined(THREADED_RTS)
+                }
+                if (lock) {
+                    RELEASE_LOCK(&nonmoving_large_objects_mutex);
+                }
+#endif
             }
 
             // N.B. the object being marked is in a compact region so by
@@ -1561,6 +1680,12 @@ mark_closure (MarkQueue *queue, const StgClosure *p0, StgClosure **origin)
     case SMALL_MUT_ARR_PTRS_FROZEN_CLEAN:
     case SMALL_MUT_ARR_PTRS_FROZEN_DIRTY: {
         StgSmallMutArrPtrs *arr = (StgSmallMutArrPtrs *) p;
+        // Mark large arrays in chunks, so that other mark threads can take
+        // some of them. See MARK_ARRAY in nonmovingMarkQueue_.
+        if (arr->ptrs > MARK_ARRAY_CHUNK_LENGTH) {
+            markQueuePushArray(queue, (StgMutArrPtrs *) arr, 0);
+            break;
+        }
         for (StgWord i = 0; i < arr->ptrs; i++) {
             StgClosure **field = &arr->payload[i];
             markQueuePushClosure(queue, *field, field);
@@ -1655,8 +1780,23 @@ mark_closure (MarkQueue *queue, const StgClosure *p0, StgClosure **origin)
         // TODO: Kill repetition
         struct NonmovingSegment *seg = nonmovingGetSegment((StgPtr) p);
         nonmoving_block_idx block_idx = nonmovingGetBlockIdx((StgPtr) p);
-        nonmovingSetMark(seg, block_idx);
-        nonmoving_live_words += nonmovingSegmentBlockSize(seg) / sizeof(W_);
+#if defined(THREADED_RTS)
+        if (n_nonmoving_mark_workers > 1) {
+            // Another mark worker may be marking the same object; only the
+            // one which sets the mark bit accounts for it.
+            // See Note [Parallel marking in the nonmoving collector].
+            uint8_t mark = nonmovingGetMark(seg, block_idx);
+            if (mark != nonmovingMarkEpoch
+                && cas_word8(&seg->bitmap[block_idx], mark, nonmovingMarkEpoch) == mark) {
+                atomic_inc((StgVolatilePtr) &nonmoving_live_words,
+                           nonmovingSegmentBlockSize(seg) / sizeof(W_));
+            }
+        } else
+#endif
+        {
+            nonmovingSetMark(seg, block_idx);
+            nonmoving_live_words += nonmovingSegmentBlockSize(seg) / sizeof(W_);
+        }
     }
 
     // If we found a indirection to shortcut keep going.
@@ -1675,19 +1815,71 @@ done:
     }
 }
 
-/* This is the main mark loop.
- * Invariants:
- *
- *  a. nonmovingPrepareMark has been called.
- *  b. the nursery has been fully evacuated into the non-moving generation.
- *  c. the mark queue has been seeded with a set of roots.
- *
+#if defined(THREADED_RTS)
+/* Offer all but the first block of a mark queue to the other mark workers.
+ * See Note [Parallel marking in the nonmoving collector].
  */
-GNUC_ATTR_HOT void
-nonmovingMark (MarkQueue *queue)
+static void
+share_mark_queue_blocks (MarkQueue *queue)
+{
+    if (queue->steal_q == NULL) {
+        return;
+    }
+
+    bdescr *top = queue->blocks;
+    while (top->link != NULL) {
+        bdescr *bd = top->link;
+        top->link = bd->link;
+        bd->link = NULL;
+        if (!pushWSDeque(queue->steal_q, bd)) {
+            bd->link = top->link;
+            top->link = bd;
+            break;
+        }
+    }
+}
+#endif
+
+/* Replace the blocks of an empty mark queue with the global update
+ * remembered set. Returns false if there was nothing to take.
+ */
+static bool
+take_upd_rem_set_blocks (MarkQueue *queue)
+{
+    if (upd_rem_set_block_list == NULL) {
+        return false;
+    }
+
+    ACQUIRE_LOCK(&upd_rem_set_lock);
+    bdescr *rset = upd_rem_set_block_list;
+    upd_rem_set_block_list = NULL;
+    RELEASE_LOCK(&upd_rem_set_lock);
+
+    // Another mark worker may have beaten us to it.
+    if (rset == NULL) {
+        return false;
+    }
+
+    bdescr *old = queue->blocks;
+    queue->blocks = rset;
+    queue->top = (MarkQueueBlock *) queue->blocks->start;
+
+    ACQUIRE_SM_LOCK;
+    freeGroup(old);
+    RELEASE_SM_LOCK;
+
+#if defined(THREADED_RTS)
+    share_mark_queue_blocks(queue);
+#endif
+    return true;
+}
+
+/* Mark until the given queue and the update remembered set are empty.
+ * Returns the number of mark queue entries processed.
+ */
+static GNUC_ATTR_HOT unsigned int
+nonmovingMarkQueue_ (MarkQueue *queue)
 {
-    traceConcMarkBegin();
-    debugTrace(DEBUG_nonmoving_gc, "Starting mark pass");
     unsigned int count = 0;
     while (true) {
         count++;
@@ -1698,44 +1890,288 @@ nonmovingMark (MarkQueue *queue)
             mark_closure(queue, ent.mark_closure.p, ent.mark_closure.origin);
             break;
         case MARK_ARRAY: {
+            // Either a MUT_ARR_PTRS or a large SMALL_MUT_ARR_PTRS.
             const StgMutArrPtrs *arr = (const StgMutArrPtrs *)
                 UNTAG_CLOSURE((StgClosure *) ent.mark_array.array);
+            StgWord ptrs;
+            StgClosure *const *payload;
+            switch (get_itbl((StgClosure *) arr)->type) {
+            case SMALL_MUT_ARR_PTRS_CLEAN:
+            case SMALL_MUT_ARR_PTRS_DIRTY:
+            case SMALL_MUT_ARR_PTRS_FROZEN_CLEAN:
+            case SMALL_MUT_ARR_PTRS_FROZEN_DIRTY: {
+                const StgSmallMutArrPtrs *small =
+                    (const StgSmallMutArrPtrs *) arr;
+                ptrs = small->ptrs;
+                payload = small->payload;
+                break;
+            }
+            default:
+                ptrs = arr->ptrs;
+                payload = arr->payload;
+                break;
+            }
             StgWord start = ent.mark_array.start_index;
             StgWord end = start + MARK_ARRAY_CHUNK_LENGTH;
-            if (end < arr->ptrs) {
+            if (end < ptrs) {
                 // There is more to be marked after this chunk.
                 markQueuePushArray(queue, arr, end);
             } else {
-                end = arr->ptrs;
+                end = ptrs;
             }
             for (StgWord i = start; i < end; i++) {
-                markQueuePushClosure_(queue, arr->payload[i]);
+                markQueuePushClosure_(queue, payload[i]);
             }
             break;
         }
         case NULL_ENTRY:
             // Perhaps the update remembered set has more to mark...
-            if (upd_rem_set_block_list) {
-                ACQUIRE_LOCK(&upd_rem_set_lock);
-                bdescr *old = queue->blocks;
-                queue->blocks = upd_rem_set_block_list;
-                queue->top = (MarkQueueBlock *) queue->blocks->start;
-                upd_rem_set_block_list = NULL;
-                RELEASE_LOCK(&upd_rem_set_lock);
-
-                ACQUIRE_SM_LOCK;
-                freeGroup(old);
-                RELEASE_SM_LOCK;
-            } else {
+            if (!take_upd_rem_set_blocks(queue)) {
                 // Nothing more to do
-                debugTrace(DEBUG_nonmoving_gc, "Finished mark pass: %d", count);
-                traceConcMarkEnd(count);
-                return;
+                return count;
             }
         }
     }
 }
 
+#if defined(THREADED_RTS)
+/* Try to steal a block of work from another mark worker. */
+static bool
+steal_mark_block (uint32_t me)
+{
+    MarkQueue *queue = nonmoving_mark_worker_queues[me];
+    for (uint32_t i = 1; i < n_nonmoving_mark_workers; i++) {
+        uint32_t victim = (me + i) % n_nonmoving_mark_workers;
+        bdescr *bd = stealWSDeque(mark_worker_deques[victim]);
+        if (bd != NULL) {
+            bd->link = queue->blocks;
+            queue->blocks = bd;
+            queue->top = (MarkQueueBlock *) bd->start;
+            return true;
+        }
+    }
+    return false;
+}
+
+static bool
+any_mark_work (uint32_t me)
+{
+    if (upd_rem_set_block_list != NULL) {
+        return true;
+    }
+    for (uint32_t i = 0; i < n_nonmoving_mark_workers; i++) {
+        if (i != me && !looksEmptyWSDeque(mark_worker_deques[i])) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/* The body of a parallel mark pass, run by each of the mark workers.
+ * See Note [Parallel marking in the nonmoving collector].
+ */
+static void
+nonmovingParallelMarkLoop (uint32_t me)
+{
+    MarkQueue *queue = nonmoving_mark_worker_queues[me];
+    StgWord count = 0;
+
+loop:
+    count += nonmovingMarkQueue_(queue);
+    if (steal_mark_block(me)) {
+        goto loop;
+    }
+
+    atomic_dec(&mark_workers_running);
+    while (SEQ_CST_LOAD(&mark_workers_running) != 0) {
+        if (any_mark_work(me)) {
+            atomic_inc(&mark_workers_running, 1);
+            goto loop;
+        }
+        busy_wait_nop();
+    }
+
+    atomic_inc(&mark_pass_count, count);
+}
+
+static void *
+nonmovingMarkWorker (void *data)
+{
+    uint32_t me = (uint32_t) (StgWord) data;
+    uint32_t pass = 0;
+
+    ACQUIRE_LOCK(&mark_workers_lock);
+    while (true) {
+        while (mark_workers_pass == pass && !mark_workers_exit) {
+            waitCondition(&mark_workers_start_cond, &mark_workers_lock);
+        }
+        if (mark_workers_exit) {
+            break;
+        }
+        pass = mark_workers_pass;
+        void (*job)(uint32_t) = mark_workers_job;
+        RELEASE_LOCK(&mark_workers_lock);
+
+        job(me);
+
+        ACQUIRE_LOCK(&mark_workers_lock);
+        mark_workers_finished++;
+        signalCondition(&mark_workers_done_cond);
+    }
+    RELEASE_LOCK(&mark_workers_lock);
+    return NULL;
+}
+
+/* Start the mark workers for a collection, if parallel marking is enabled.
+ * Called by the mark thread.
+ */
+void
+nonmovingStartMarkWorkers (void)
+{
+    const uint32_t n = RtsFlags.GcFlags.nonmovingMarkThreads;
+    if (n <= 1) {
+        return;
+    }
+
+    nonmoving_mark_worker_queues =
+        stgMallocBytes(n * sizeof(MarkQueue *), "nonmovingStartMarkWorkers");
+    mark_worker_deques =
+        stgMallocBytes(n * sizeof(WSDeque *), "nonmovingStartMarkWorkers");
+    mark_worker_threads =
+        stgMallocBytes(n * sizeof(OSThreadId), "nonmovingStartMarkWorkers");
+
+    nonmoving_mark_worker_queues[0] = NULL;
+    mark_worker_deques[0] = newWSDeque(MARK_WORKER_DEQUE_SIZE);
+    for (uint32_t i = 1; i < n; i++) {
+        MarkQueue *queue = stgMallocBytes(sizeof(MarkQueue), "mark queue");
+        ACQUIRE_SM_LOCK;
+        initMarkQueue(queue);
+        RELEASE_SM_LOCK;
+        mark_worker_deques[i] = newWSDeque(MARK_WORKER_DEQUE_SIZE);
+        queue->steal_q = mark_worker_deques[i];
+        nonmoving_mark_worker_queues[i] = queue;
+    }
+
+    mark_workers_pass = 0;
+    mark_workers_exit = false;
+    n_nonmoving_mark_workers = n;
+
+    for (uint32_t i = 1; i < n; i++) {
+        if (createOSThread(&mark_worker_threads[i], "non-moving mark worker",
+                           nonmovingMarkWorker, (void *) (StgWord) i) != 0) {
+            barf("nonmovingStartMarkWorkers: failed to spawn mark worker: %s",
+                 strerror(errno));
+        }
+    }
+    debugTrace(DEBUG_nonmoving_gc, "Started %d mark workers", n - 1);
+}
+
+/* Stop the mark workers started by nonmovingStartMarkWorkers. */
+void
+nonmovingStopMarkWorkers (void)
+{
+    const uint32_t n = n_nonmoving_mark_workers;
+    if (n <= 1) {
+        return;
+    }
+
+    ACQUIRE_LOCK(&mark_workers_lock);
+    mark_workers_exit = true;
+    broadcastCondition(&mark_workers_start_cond);
+    RELEASE_LOCK(&mark_workers_lock);
+
+    for (uint32_t i = 1; i < n; i++) {
+        joinOSThread(mark_worker_threads[i]);
+    }
+
+    n_nonmoving_mark_workers = 1;
+    for (uint32_t i = 1; i < n; i++) {
+        freeMarkQueue(nonmoving_mark_worker_queues[i]);
+        stgFree(nonmoving_mark_worker_queues[i]);
+    }
+    for (uint32_t i = 0; i < n; i++) {
+        ASSERT(looksEmptyWSDeque(mark_worker_deques[i]));
+        freeWSDeque(mark_worker_deques[i]);
+    }
+    stgFree(nonmoving_mark_worker_queues);
+    stgFree(mark_worker_deques);
+    stgFree(mark_worker_threads);
+    nonmoving_mark_worker_queues = NULL;
+    mark_worker_deques = NULL;
+    mark_worker_threads = NULL;
+}
+
+/* Run job on the mark thread (as worker 0) and on each of the mark workers,
+ * returning once all of them have finished. Must only be called by the mark
+ * thread while the workers are running.
+ */
+void
+nonmovingRunMarkWorkers (void (*job)(uint32_t me))
+{
+    ACQUIRE_LOCK(&mark_workers_lock);
+    mark_workers_finished = 0;
+    mark_workers_job = job;
+    mark_workers_pass++;
+    broadcastCondition(&mark_workers_start_cond);
+    RELEASE_LOCK(&mark_workers_lock);
+
+    job(0);
+
+    ACQUIRE_LOCK(&mark_workers_lock);
+    while (mark_workers_finished < n_nonmoving_mark_workers - 1) {
+        waitCondition(&mark_workers_done_cond, &mark_workers_lock);
+    }
+    mark_workers_job = NULL;
+    RELEASE_LOCK(&mark_workers_lock);
+}
+
+/* Run a mark pass over the given queue with the help of the mark workers.
+ * Returns the number of mark queue entries processed.
+ */
+static unsigned int
+nonmovingParallelMark (MarkQueue *queue)
+{
+    nonmoving_mark_worker_queues[0] = queue;
+    queue->steal_q = mark_worker_deques[0];
+    share_mark_queue_blocks(queue);
+    mark_pass_count = 0;
+    SEQ_CST_STORE(&mark_workers_running, n_nonmoving_mark_workers);
+
+    nonmovingRunMarkWorkers(nonmovingParallelMarkLoop);
+
+    ASSERT(looksEmptyWSDeque(queue->steal_q));
+    queue->steal_q = NULL;
+    nonmoving_mark_worker_queues[0] = NULL;
+    return SEQ_CST_LOAD(&mark_pass_count);
+}
+#endif
+
+/* This is the main mark loop.
+ * Invariants:
+ *
+ *  a. nonmovingPrepareMark has been called.
+ *  b. the nursery has been fully evacuated into the non-moving generation.
+ *  c. the mark queue has been seeded with a set of roots.
+ *
+ */
+GNUC_ATTR_HOT void
+nonmovingMark (MarkQueue *queue)
+{
+    traceConcMarkBegin();
+    debugTrace(DEBUG_nonmoving_gc, "Starting mark pass");
+    unsigned int count = 0;
+#if defined(THREADED_RTS)
+    if (n_nonmoving_mark_workers > 1) {
+        count += nonmovingParallelMark(queue);
+    } else
+#endif
+    {
+        count += nonmovingMarkQueue_(queue);
+    }
+    debugTrace(DEBUG_nonmoving_gc, "Finished mark pass: %d", count);
+    traceConcMarkEnd(count);
+}
+
 // A variant of `isAlive` that works for non-moving heap. Used for:
 //
 // - Collecting weak pointers; checking key of a weak pointer.
@@ -10,6 +10,7 @@
 
 #include "Hash.h"
 #include "Task.h"
+#include "WSDeque.h"
 #include "NonMoving.h"
 
 #include "BeginPrivate.h"
@@ -56,7 +57,7 @@ typedef struct {
                                   // See Note [Origin references in the nonmoving collector]
         } mark_closure;
         struct {
-            const StgMutArrPtrs *array;
+            const StgMutArrPtrs *array; // or a large SMALL_MUT_ARR_PTRS
             StgWord start_index;  // start index is shifted to the left by 16 bits
         } mark_array;
     };
@@ -103,6 +104,13 @@ typedef struct MarkQueue_ {
     // The first free slot in prefetch_queue.
     uint8_t prefetch_head;
 #endif
+
+#if defined(THREADED_RTS)
+    // Full blocks which this queue has offered to the other mark workers.
+    // NULL unless the queue is taking part in a parallel mark pass.
+    // See Note [Parallel marking in the nonmoving collector].
+    WSDeque *steal_q;
+#endif
 } MarkQueue;
 
 /* While it shares its representation with MarkQueue, UpdRemSet differs in
@@ -148,6 +156,13 @@ void updateRemembSetPushTSO(Capability *cap, StgTSO *tso);
 void updateRemembSetPushStack(Capability *cap, StgStack *stack);
 
 #if defined(THREADED_RTS)
+extern uint32_t n_nonmoving_mark_workers;
+extern MarkQueue **nonmoving_mark_worker_queues;
+
+void nonmovingStartMarkWorkers(void);
+void nonmovingStopMarkWorkers(void);
+void nonmovingRunMarkWorkers(void (*job)(uint32_t me));
+
 void nonmovingFlushCapUpdRemSetBlocks(Capability *cap);
 void nonmovingBeginFlush(Task *task);
 bool nonmovingWaitForFlush(void);
@@ -125,14 +125,81 @@ clear_segment_free_blocks(struct NonmovingSegment* seg)
 
 #endif
 
-GNUC_ATTR_HOT void nonmovingSweep(void)
+/* Note [Parallel and lazy sweeping]
+ * ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+ * Until a segment on nonmovingHeap.sweep_list has been swept its free blocks
+ * can't be allocated into, so allocators which run out of active segments
+ * fall back to fresh segments while the sweep is in progress. We shorten this
+ * window in two ways:
+ *
+ *  - Parallel sweeping: when the mark workers are running (see Note
+ *    [Parallel marking in the nonmoving collector] in NonMovingMark.c) the
+ *    mark thread has them sweep alongside it. Each sweeper takes
+ *    SWEEP_CHUNK_SIZE segments at a time off sweep_list. The segments are
+ *    then pushed to the free, active and filled lists, all of which can
+ *    already be pushed to concurrently.
+ *
+ *  - Lazy sweeping (+RTS --nonmoving-lazy-sweep): once the mark is complete
+ *    the sweep list is opened to the allocator. An allocator which has no
+ *    active segment left sweeps a few segments itself (nonmovingLazySweep),
+ *    taking the first one which has free blocks of the right size as its new
+ *    current segment rather than waiting for the sweeper to reach it.
+ *
+ * In both cases sweep_list is only modified while holding sweep_list_lock.
+ * Until nonmoving_lazy_sweep_open is set the list is private to the mark
+ * thread and its workers.
+ *
+ * Since the sweeper no longer owns all of sweep_list, the last segments may
+ * still be in the process of being swept by the allocator when nonmovingSweep
+ * returns. This is fine: such segments are owned by the allocating
+ * capability and, as the next collection can only start in a pause, they
+ * will have become its current segment by then.
+ */
+
+// How many segments a sweeper takes off sweep_list at a time.
+#define SWEEP_CHUNK_SIZE 16
+
+// How many segments an allocator sweeps looking for one it can use before
+// giving up and falling back to a fresh segment.
+#define LAZY_SWEEP_MAX_SEGMENTS 8
+
+#if defined(THREADED_RTS)
+static SpinLock sweep_list_lock;
+
+// Set while allocators may sweep segments on sweep_list.
+// See Note [Parallel and lazy sweeping].
+static volatile StgWord nonmoving_lazy_sweep_open = 0;
+
+void nonmovingInitSweep(void)
 {
-    while (nonmovingHeap.sweep_list) {
-        struct NonmovingSegment *seg = nonmovingHeap.sweep_list;
+    initSpinLock(&sweep_list_lock);
+}
+#endif
 
+// Detach up to n segments from the head of sweep_list. The segments remain
+// linked to each other; the last has a NULL link.
+static struct NonmovingSegment *take_sweep_segments(unsigned int n)
+{
+    ACQUIRE_SPIN_LOCK(&sweep_list_lock);
+    struct NonmovingSegment *head = nonmovingHeap.sweep_list;
+    if (head != NULL) {
+        struct NonmovingSegment *last = head;
+        for (unsigned int i = 1; i < n && last->link != NULL; i++) {
+            last = last->link;
+        }
+        nonmovingHeap.sweep_list = last->link;
+        last->link = NULL;
+    }
+    RELEASE_SPIN_LOCK(&sweep_list_lock);
+    return head;
+}
+
+GNUC_ATTR_HOT static void sweep_segments(struct NonmovingSegment *seg)
+{
+    while (seg) {
         // Pushing the segment to one of the free/active/filled segments
-        // updates the link field, so update sweep_list here
-        nonmovingHeap.sweep_list = seg->link;
+        // updates the link field, so take the next segment here
+        struct NonmovingSegment *next = seg->link;
 
         enum SweepResult ret = nonmovingSweepSegment(seg);
 
@@ -151,8 +218,83 @@ GNUC_ATTR_HOT void nonmovingSweep(void)
         default:
             barf("nonmovingSweep: weird sweep return: %d\n", ret);
         }
+
+        seg = next;
+    }
+}
+
+static void nonmovingSweepWorker(uint32_t me STG_UNUSED)
+{
+    struct NonmovingSegment *segs;
+    while ((segs = take_sweep_segments(SWEEP_CHUNK_SIZE)) != NULL) {
+        sweep_segments(segs);
+    }
+}
+
+GNUC_ATTR_HOT void nonmovingSweep(void)
+{
+#if defined(THREADED_RTS)
+    if (RtsFlags.GcFlags.nonmovingLazySweep) {
+        SEQ_CST_STORE(&nonmoving_lazy_sweep_open, 1);
+    }
+
+    if (n_nonmoving_mark_workers > 1) {
+        nonmovingRunMarkWorkers(nonmovingSweepWorker);
+    } else
+#endif
+    {
+        nonmovingSweepWorker(0);
+    }
+
+#if defined(THREADED_RTS)
+    SEQ_CST_STORE(&nonmoving_lazy_sweep_open, 0);
+#endif
+}
+
+#if defined(THREADED_RTS)
+/* Called by nonmovingAllocate when the allocator for the given block size has
+ * no active segments left. Sweeps up to LAZY_SWEEP_MAX_SEGMENTS segments off
+ * sweep_list and returns the first one which can become the allocator's
+ * current segment, or NULL if there is none. Segments which can't be used are
+ * disposed of as nonmovingSweep would.
+ *
+ * See Note [Parallel and lazy sweeping].
+ */
+struct NonmovingSegment *nonmovingLazySweep(uint8_t log_block_size)
+{
+    for (unsigned int i = 0; i < LAZY_SWEEP_MAX_SEGMENTS; i++) {
+        if (!SEQ_CST_LOAD(&nonmoving_lazy_sweep_open)) {
+            return NULL;
+        }
+        struct NonmovingSegment *seg = take_sweep_segments(1);
+        if (seg == NULL) {
+            return NULL;
+        }
+
+        enum SweepResult ret = nonmovingSweepSegment(seg);
+        switch (ret) {
+        case SEGMENT_FREE:
+            // Don't put it on the free list: that may need to free the segment
+            // with sm_mutex held, which our caller may already hold.
+            nonmovingInitSegment(seg, log_block_size);
+            return seg;
+        case SEGMENT_PARTIAL:
+            IF_DEBUG(sanity, clear_segment_free_blocks(seg));
+            if (nonmovingSegmentLogBlockSize(seg) == log_block_size) {
+                return seg;
+            }
+            nonmovingPushActiveSegment(seg);
+            break;
+        case SEGMENT_FILLED:
+            nonmovingPushFilledSegment(seg);
+            break;
+        default:
+            barf("nonmovingLazySweep: weird sweep return: %d\n", ret);
+        }
     }
+    return NULL;
 }
+#endif
 
 /* Must a closure remain on the mutable list?
  *
@@ -395,7 +537,7 @@ void nonmovingSweepStableNameTable()
                     freeSnEntry(p);
                 } else if (p->addr != NULL) {
                     if (!is_alive((StgClosure*)p->addr)) {
-                        p->addr = NULL;
+                        clearSnEntryAddr(p);
                     }
                 }
             }
@@ -13,6 +13,15 @@
 
 GNUC_ATTR_HOT void nonmovingSweep(void);
 
+#if defined(THREADED_RTS)
+// Called once by nonmovingInit
+void nonmovingInitSweep(void);
+
+// Sweep segments on behalf of an allocator which has run out of active
+// segments. See Note [Parallel and lazy sweeping] in NonMovingSweep.c.
+struct NonmovingSegment *nonmovingLazySweep(uint8_t log_block_size);
+#endif
+
 // Remove unmarked entries in oldest generation mut_lists
 void nonmovingSweepMutLists(void);
 
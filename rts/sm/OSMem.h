@@ -91,6 +91,20 @@ void osDecommitMemory(void *p, W_ len);
 // This function is called once, when the block allocator is deinitialized
 // before the program terminates.
 void osReleaseHeapMemory(void);
+
+// The size of the huge pages used by +RTS --huge-pages. With that flag the
+// reserved address space is aligned to, and a multiple of, this size.
+// See Note [Huge page megablocks] in MBlock.c.
+#define HUGE_PAGE_SIZE ((W_)2 * 1024 * 1024)
+
+// Ask the OS to back a committed piece of address space with huge pages.
+// @p and @len must be multiples of HUGE_PAGE_SIZE. This is only a hint and
+// is silently ignored where it is not supported.
+void osAdviseHugePages(void *p, W_ len);
+
+// Return the number of bytes in [@p, @p + @len) currently backed by huge
+// pages, or 0 if the OS cannot tell us.
+StgWord64 osHugePageBytes(void *p, W_ len);
 #endif
 
 #include "EndPrivate.h"
@@ -1056,8 +1056,17 @@ findMemoryLeak (void)
         }
         markNonMovingSegments(nonmovingHeap.sweep_list);
         markNonMovingSegments(nonmovingHeap.free);
+        for (i = 0; i < n_capabilities; i++) {
+            markNonMovingSegments(nonmovingHeap.magazines[i].segs);
+            markNonMovingSegments(nonmovingHeap.magazines[i].returned);
+        }
         if (current_mark_queue)
             markBlocks(current_mark_queue->blocks);
+#if defined(THREADED_RTS)
+        for (i = 1; i < n_nonmoving_mark_workers; i++) {
+            markBlocks(nonmoving_mark_worker_queues[i]->blocks);
+        }
+#endif
     }
 
 #if defined(PROFILING)
@@ -1129,6 +1138,11 @@ genBlocks (generation *gen)
         ret += countNonMovingHeap(&nonmovingHeap);
         if (current_mark_queue)
             ret += countBlocks(current_mark_queue->blocks);
+#if defined(THREADED_RTS)
+        for (uint32_t i = 1; i < n_nonmoving_mark_workers; i++) {
+            ret += countBlocks(nonmoving_mark_worker_queues[i]->blocks);
+        }
+#endif
     } else {
         ASSERT(countBlocks(gen->blocks) == gen->n_blocks);
         ASSERT(countCompactBlocks(gen->compact_objects) == gen->n_compact_blocks);
@@ -1176,6 +1190,10 @@ countNonMovingHeap(struct NonmovingHeap *heap)
     }
     ret += countNonMovingSegments(heap->sweep_list);
     ret += countNonMovingSegments(heap->free);
+    for (uint32_t i = 0; i < n_capabilities; ++i) {
+        ret += countNonMovingSegments(heap->magazines[i].segs);
+        ret += countNonMovingSegments(heap->magazines[i].returned);
+    }
     return ret;
 }
 
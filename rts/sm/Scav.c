@@ -45,6 +45,7 @@
 #include "PosixSource.h"
 #include "Rts.h"
 
+#include "RtsUtils.h"
 #include "Storage.h"
 #include "GC.h"
 #include "GCThread.h"
@@ -408,6 +409,156 @@ scavenge_fun_srt(const StgInfoTable *info)
     }
 }
 
+/* Note [Prefetching while scavenging]
+   ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+   scavenge_block walks the objects in a block linearly, so the objects it
+   scavenges are usually in the cache already, but the objects their fields
+   point to are scattered across the heap. evacuate() has to read the header
+   of each of them, then its info table and, for heap objects, its block
+   descriptor, and in a large heap most of these reads miss the cache.
+
+   With +RTS --gc-prefetch, scavenge_block does not evacuate the pointer
+   fields of constructors, functions and thunks straight away. Instead it
+   pushes them onto a small ring buffer, a ScavPrefetchQueue, and issues
+   prefetches for the header and block descriptor of the object each field
+   points to. Only once SCAV_PREFETCH_DEPTH fields are queued is the oldest
+   evacuated, by which time its loads have hopefully completed. When a
+   field gets halfway along the queue its header should have arrived, so we
+   also prefetch the info table it points to.
+
+   Deferring evacuation has two consequences:
+
+    * Whether an object must go on the mutable list (because one of its
+      fields could not be promoted, see gct->failed_to_evac) is only known
+      once its last queued field has been evacuated. So each queue entry
+      remembers the object the field belongs to and scav_prefetch_evac
+      records that object itself. An object can also need recording because
+      evacuating its SRT, or one of the fields we don't queue, failed. In
+      that case we don't record it straight away, as an older object whose
+      fields are still queued could be recorded after it, but queue an entry
+      with a NULL field that just records the owner. Owners then leave the
+      queue in the order they were scavenged, so remembering the last object
+      recorded is enough to avoid recording an object twice.
+
+    * Evacuating the fields left in the queue at the end of the block may
+      copy more objects into the same block, so we go round the block again
+      until the queue stays empty.
+
+   Mutable objects still evacuate their fields straight away, as they need
+   to know the outcome to decide whether they are clean or dirty, and with
+   eager promotion disabled. Since the queue is only pushed and drained
+   while scavenging immutable objects, queued fields are always evacuated
+   with the block's own eager promotion setting.
+
+   The nonmoving collector's mark loop already has the equivalent, see
+   MARK_PREFETCH_QUEUE_DEPTH in NonMovingMark.h.
+*/
+
+#define SCAV_PREFETCH_DEPTH 8 // must be a power of two
+
+typedef struct {
+    StgClosure **field;   // the field to evacuate, or NULL to just record owner
+    StgClosure *owner;    // the object containing field
+} ScavPrefetchEntry;
+
+typedef struct {
+    ScavPrefetchEntry ents[SCAV_PREFETCH_DEPTH];
+    uint32_t head;              // the next entry to evacuate
+    uint32_t count;             // the number of entries queued
+    uint32_t gen_no;            // the generation of the block being scavenged
+    StgClosure *last_recorded;  // last owner added to the mutable list
+} ScavPrefetchQueue;
+
+static void
+scav_prefetch_evac (ScavPrefetchQueue *pq, ScavPrefetchEntry *ent)
+{
+    bool saved_failed_to_evac = gct->failed_to_evac;
+    bool record = true;
+
+    if (ent->field != NULL) {
+        gct->failed_to_evac = false;
+        evacuate(ent->field);
+        record = gct->failed_to_evac;
+    }
+    if (record && pq->gen_no > 0 && ent->owner != pq->last_recorded) {
+        recordMutableGen_GC(ent->owner, pq->gen_no);
+        pq->last_recorded = ent->owner;
+    }
+    gct->failed_to_evac = saved_failed_to_evac;
+}
+
+// Queue an entry, evacuating the oldest one first if the queue is full.
+STATIC_INLINE void
+scav_prefetch_enqueue (ScavPrefetchQueue *pq, StgClosure **field,
+                       StgClosure *owner)
+{
+    ScavPrefetchEntry *ent;
+
+    if (pq->count == SCAV_PREFETCH_DEPTH) {
+        // The queue is full: evacuate the oldest field and reuse its slot
+        ent = &pq->ents[pq->head];
+        scav_prefetch_evac(pq, ent);
+        pq->head = (pq->head + 1) % SCAV_PREFETCH_DEPTH;
+    } else {
+        ent = &pq->ents[(pq->head + pq->count) % SCAV_PREFETCH_DEPTH];
+        pq->count++;
+    }
+    ent->field = field;
+    ent->owner = owner;
+}
+
+STATIC_INLINE void
+scav_prefetch_push (ScavPrefetchQueue *pq, StgClosure **field,
+                    StgClosure *owner)
+{
+    StgClosure *c = UNTAG_CLOSURE(*field);
+    ScavPrefetchEntry *ent;
+
+    prefetchForRead(c);
+    prefetchForRead(Bdescr((P_)c));
+
+    scav_prefetch_enqueue(pq, field, owner);
+
+    // Once the queue is full, the header of the object halfway along it was
+    // prefetched a while ago, so we can read it to prefetch the info table.
+    if (pq->count == SCAV_PREFETCH_DEPTH) {
+        ent = &pq->ents[(pq->head + SCAV_PREFETCH_DEPTH / 2)
+                        % SCAV_PREFETCH_DEPTH];
+        if (ent->field != NULL) {
+            c = UNTAG_CLOSURE(*ent->field);
+            prefetchForRead(RELAXED_LOAD(&c->header.info));
+        }
+    }
+}
+
+// Evacuate the field of an immutable object owner, either now or via the
+// prefetch queue if there is one.
+STATIC_INLINE void
+scavenge_field (ScavPrefetchQueue *pq, StgClosure **field, StgClosure *owner)
+{
+    if (pq != NULL) {
+        scav_prefetch_push(pq, field, owner);
+    } else {
+        evacuate(field);
+    }
+}
+
+// Evacuate everything left in the prefetch queue. Returns true if there
+// was anything to evacuate.
+static bool
+scav_prefetch_flush (ScavPrefetchQueue *pq)
+{
+    if (pq == NULL || pq->count == 0) {
+        return false;
+    }
+    while (pq->count > 0) {
+        scav_prefetch_evac(pq, &pq->ents[pq->head]);
+        pq->head = (pq->head + 1) % SCAV_PREFETCH_DEPTH;
+        pq->count--;
+    }
+    return true;
+}
+
 /* -----------------------------------------------------------------------------
    Scavenge a block from the given scan pointer up to bd->free.
 
@@ -427,6 +578,7 @@ scavenge_block (bdescr *bd)
   const StgInfoTable *info;
   bool saved_eager_promotion;
   gen_workspace *ws;
+  ScavPrefetchQueue prefetch_queue, *pq = NULL;
 
   debugTrace(DEBUG_gc, "scavenging block %p (gen %d) @ %p",
              bd->start, bd->gen_no, bd->u.scan);
@@ -440,6 +592,15 @@ scavenge_block (bdescr *bd)
 
   p = bd->u.scan;
 
+  // See Note [Prefetching while scavenging]
+  if (RtsFlags.GcFlags.scavPrefetch) {
+      pq = &prefetch_queue;
+      pq->head = 0;
+      pq->count = 0;
+      pq->gen_no = bd->gen_no;
+      pq->last_recorded = NULL;
+  }
+
   // Sanity check: See Note [Deadlock detection under nonmoving collector].
 #if defined(DEBUG)
   if (RtsFlags.GcFlags.useNonmoving && deadlock_detect_gc) {
@@ -448,6 +609,7 @@ scavenge_block (bdescr *bd)
 #endif
 
 
+scan:
   // we might be evacuating into the very object that we're
   // scavenging, so we have to check the real bd->free pointer each
   // time around the loop.
@@ -500,27 +662,27 @@ scavenge_block (bdescr *bd)
 
     case FUN_2_0:
         scavenge_fun_srt(info);
-        evacuate(&((StgClosure *)p)->payload[1]);
-        evacuate(&((StgClosure *)p)->payload[0]);
+        scavenge_field(pq, &((StgClosure *)p)->payload[1], (StgClosure *)q);
+        scavenge_field(pq, &((StgClosure *)p)->payload[0], (StgClosure *)q);
         p += sizeofW(StgHeader) + 2;
         break;
 
     case THUNK_2_0:
         scavenge_thunk_srt(info);
-        evacuate(&((StgThunk *)p)->payload[1]);
-        evacuate(&((StgThunk *)p)->payload[0]);
+        scavenge_field(pq, &((StgThunk *)p)->payload[1], (StgClosure *)q);
+        scavenge_field(pq, &((StgThunk *)p)->payload[0], (StgClosure *)q);
         p += sizeofW(StgThunk) + 2;
         break;
 
     case CONSTR_2_0:
-        evacuate(&((StgClosure *)p)->payload[1]);
-        evacuate(&((StgClosure *)p)->payload[0]);
+        scavenge_field(pq, &((StgClosure *)p)->payload[1], (StgClosure *)q);
+        scavenge_field(pq, &((StgClosure *)p)->payload[0], (StgClosure *)q);
         p += sizeofW(StgHeader) + 2;
         break;
 
     case THUNK_1_0:
         scavenge_thunk_srt(info);
-        evacuate(&((StgThunk *)p)->payload[0]);
+        scavenge_field(pq, &((StgThunk *)p)->payload[0], (StgClosure *)q);
         p += sizeofW(StgThunk) + 1;
         break;
 
@@ -528,7 +690,7 @@ scavenge_block (bdescr *bd)
         scavenge_fun_srt(info);
         FALLTHROUGH;
     case CONSTR_1_0:
-        evacuate(&((StgClosure *)p)->payload[0]);
+        scavenge_field(pq, &((StgClosure *)p)->payload[0], (StgClosure *)q);
         p += sizeofW(StgHeader) + 1;
         break;
 
@@ -558,7 +720,7 @@ scavenge_block (bdescr *bd)
 
     case THUNK_1_1:
         scavenge_thunk_srt(info);
-        evacuate(&((StgThunk *)p)->payload[0]);
+        scavenge_field(pq, &((StgThunk *)p)->payload[0], (StgClosure *)q);
         p += sizeofW(StgThunk) + 2;
         break;
 
@@ -566,7 +728,7 @@ scavenge_block (bdescr *bd)
         scavenge_fun_srt(info);
         FALLTHROUGH;
     case CONSTR_1_1:
-        evacuate(&((StgClosure *)p)->payload[0]);
+        scavenge_field(pq, &((StgClosure *)p)->payload[0], (StgClosure *)q);
         p += sizeofW(StgHeader) + 2;
         break;
 
@@ -581,7 +743,7 @@ scavenge_block (bdescr *bd)
         scavenge_thunk_srt(info);
         end = (P_)((StgThunk *)p)->payload + info->layout.payload.ptrs;
         for (p = (P_)((StgThunk *)p)->payload; p < end; p++) {
-            evacuate((StgClosure **)p);
+            scavenge_field(pq, (StgClosure **)p, (StgClosure *)q);
         }
         p += info->layout.payload.nptrs;
         break;
@@ -597,7 +759,7 @@ scavenge_block (bdescr *bd)
 
         end = (P_)((StgClosure *)p)->payload + info->layout.payload.ptrs;
         for (p = (P_)((StgClosure *)p)->payload; p < end; p++) {
-            evacuate((StgClosure **)p);
+            scavenge_field(pq, (StgClosure **)p, (StgClosure *)q);
         }
         p += info->layout.payload.nptrs;
         break;
@@ -835,12 +997,21 @@ scavenge_block (bdescr *bd)
      */
     if (gct->failed_to_evac) {
         gct->failed_to_evac = false;
-        if (bd->gen_no > 0) {
+        if (pq != NULL) {
+            // See Note [Prefetching while scavenging]
+            scav_prefetch_enqueue(pq, NULL, (StgClosure *)q);
+        } else if (bd->gen_no > 0) {
             recordMutableGen_GC((StgClosure *)q, bd->gen_no);
         }
     }
   }
 
+  // Evacuating the fields left in the prefetch queue may have copied more
+  // objects into this block.
+  if (scav_prefetch_flush(pq)) {
+      goto scan;
+  }
+
   if (p > bd->free)  {
       gct->copied += ws->todo_free - bd->free;
       RELEASE_STORE(&bd->free, p);
@@ -1995,6 +2166,283 @@ scavenge_stack(StgPtr p, StgPtr stack_end)
   }
 }
 
+/* -----------------------------------------------------------------------------
+   Parallel scavenging of large arrays
+   -------------------------------------------------------------------------- */
+
+/* Note [Parallel scavenging of large arrays]
+   ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+   A large object is evacuated by linking its block onto the
+   todo_large_objects list of the evacuating GC thread, and scavenge_large
+   scavenges it as a unit. An array of tens of millions of elements then
+   keeps one GC thread busy while the others spin in scavenge_until_all_done.
+
+   So in the parallel GC (with work stealing), scavenge_large splits
+   MUT_ARR_PTRS and SMALL_MUT_ARR_PTRS objects of at least
+   ARRAY_SCAV_SPLIT_CHUNKS chunks into chunks of ARRAY_SCAV_CHUNK_CARDS card
+   table cards. Chunks never share a card, so no two threads write the same
+   card byte. The chunks are handed out by an ArrayScavJob:
+
+    * The job is pushed onto the workspace's todo_q once for every other GC
+      thread, tagged with ARRAY_SCAV_JOB_TAG to tell it apart from a block.
+      Any GC thread which pops or steals a copy, as well as the thread which
+      split the array, claims chunks by atomically bumping job->next_chunk
+      until there are none left.
+
+    * Each copy on a deque, and the splitting thread, holds a reference to
+      the job, which it drops once there is nothing left to claim. Since a
+      thread only drops its reference after finishing the chunks it claimed,
+      the thread dropping the last one knows the whole array has been
+      scavenged. It sets the header of the array to CLEAN or DIRTY depending
+      on whether any chunk failed to evacuate, puts the array on the mutable
+      list if needed (as scavenge_large would after scavenge_one), and frees
+      the job.
+
+   Jobs never go onto todo_overflow: if the deque is full the splitting
+   thread simply does more of the work itself.
+
+   The non-moving collector's mark queue splits large arrays in the same
+   way, see MARK_ARRAY in NonMovingMark.c.
+*/
+
+#if defined(PARALLEL_GC)
+
+// Chunk size, in cards of 2^MUT_ARR_PTRS_CARD_BITS elements
+#define ARRAY_SCAV_CHUNK_CARDS 16
+#define ARRAY_SCAV_CHUNK_ELEMS (ARRAY_SCAV_CHUNK_CARDS << MUT_ARR_PTRS_CARD_BITS)
+// Only split arrays of at least this many chunks
+#define ARRAY_SCAV_SPLIT_CHUNKS 8
+
+typedef struct ArrayScavJob_ {
+    StgClosure *arr;      // a MUT_ARR_PTRS or SMALL_MUT_ARR_PTRS
+    uint32_t gen_no;      // generation of arr
+    StgWord n_chunks;
+    StgWord next_chunk;   // first unclaimed chunk, bumped atomically
+    StgWord refs;         // references held, decremented atomically
+    StgWord any_failed;   // has some chunk failed to evacuate?
+} ArrayScavJob;
+
+// Scavenge cards [first, last) of a MUT_ARR_PTRS and update the card table.
+// Returns true if any of them still points into a younger generation.
+static bool
+scavenge_mut_arr_ptrs_cards (StgMutArrPtrs *a, W_ first, W_ last)
+{
+    W_ m;
+    StgPtr p, q;
+    bool any_failed = false;
+
+    for (m = first; m < last; m++) {
+        p = (StgPtr)&a->payload[m << MUT_ARR_PTRS_CARD_BITS];
+        q = stg_min(p + (1 << MUT_ARR_PTRS_CARD_BITS),
+                    (StgPtr)&a->payload[a->ptrs]);
+        for (; p < q; p++) {
+            evacuate((StgClosure**)p);
+        }
+        if (gct->failed_to_evac) {
+            any_failed = true;
+            *mutArrPtrsCard(a,m) = 1;
+            gct->failed_to_evac = false;
+        } else {
+            *mutArrPtrsCard(a,m) = 0;
+        }
+    }
+    return any_failed;
+}
+
+static void
+finish_array_job (ArrayScavJob *job)
+{
+    StgClosure *arr = job->arr;
+    bool failed = RELAXED_LOAD(&job->any_failed) != 0;
+    bool record;
+
+    switch (get_itbl(arr)->type) {
+    case MUT_ARR_PTRS_CLEAN:
+    case MUT_ARR_PTRS_DIRTY:
+        RELEASE_STORE(&arr->header.info,
+                      failed ? &stg_MUT_ARR_PTRS_DIRTY_info
+                             : &stg_MUT_ARR_PTRS_CLEAN_info);
+        record = true;
+        break;
+    case MUT_ARR_PTRS_FROZEN_CLEAN:
+    case MUT_ARR_PTRS_FROZEN_DIRTY:
+        RELEASE_STORE(&arr->header.info,
+                      failed ? &stg_MUT_ARR_PTRS_FROZEN_DIRTY_info
+                             : &stg_MUT_ARR_PTRS_FROZEN_CLEAN_info);
+        record = failed;
+        break;
+    case SMALL_MUT_ARR_PTRS_CLEAN:
+    case SMALL_MUT_ARR_PTRS_DIRTY:
+        RELEASE_STORE(&arr->header.info,
+                      failed ? &stg_SMALL_MUT_ARR_PTRS_DIRTY_info
+                             : &stg_SMALL_MUT_ARR_PTRS_CLEAN_info);
+        record = true;
+        break;
+    case SMALL_MUT_ARR_PTRS_FROZEN_CLEAN:
+    case SMALL_MUT_ARR_PTRS_FROZEN_DIRTY:
+        RELEASE_STORE(&arr->header.info,
+                      failed ? &stg_SMALL_MUT_ARR_PTRS_FROZEN_DIRTY_info
+                             : &stg_SMALL_MUT_ARR_PTRS_FROZEN_CLEAN_info);
+        record = failed;
+        break;
+    default:
+        barf("finish_array_job: strange closure type %d",
+             (int)(get_itbl(arr)->type));
+    }
+
+    if (record && job->gen_no > 0) {
+        recordMutableGen_GC(arr, job->gen_no);
+    }
+    stgFree(job);
+}
+
+// Scavenge chunks of the array until there are none left to claim, then
+// drop our reference to the job.
+static void
+scavenge_array_job (ArrayScavJob *job)
+{
+    StgClosure *arr = job->arr;
+    StgHalfWord type = get_itbl(arr)->type;
+    bool small = type == SMALL_MUT_ARR_PTRS_CLEAN
+              || type == SMALL_MUT_ARR_PTRS_DIRTY
+              || type == SMALL_MUT_ARR_PTRS_FROZEN_CLEAN
+              || type == SMALL_MUT_ARR_PTRS_FROZEN_DIRTY;
+    bool saved_eager = gct->eager_promotion;
+    bool any_failed = false;
+    StgWord chunk;
+
+    gct->evac_gen_no = job->gen_no;
+    // We don't eagerly promote objects pointed to by a mutable array,
+    // as in scavenge_one.
+    if (type == MUT_ARR_PTRS_CLEAN || type == MUT_ARR_PTRS_DIRTY
+        || type == SMALL_MUT_ARR_PTRS_CLEAN
+        || type == SMALL_MUT_ARR_PTRS_DIRTY) {
+        gct->eager_promotion = false;
+    }
+
+    while ((chunk = atomic_inc((StgVolatilePtr)&job->next_chunk, 1) - 1)
+           < job->n_chunks) {
+        gct->failed_to_evac = false;
+        if (small) {
+            StgSmallMutArrPtrs *a = (StgSmallMutArrPtrs *)arr;
+            StgPtr p = (StgPtr)&a->payload[chunk * ARRAY_SCAV_CHUNK_ELEMS];
+            StgPtr q = stg_min(p + ARRAY_SCAV_CHUNK_ELEMS,
+                               (StgPtr)&a->payload[a->ptrs]);
+            gct->scanned += q - p;
+            for (; p < q; p++) {
+                evacuate((StgClosure**)p);
+            }
+            any_failed = gct->failed_to_evac || any_failed;
+        } else {
+            StgMutArrPtrs *a = (StgMutArrPtrs *)arr;
+            W_ first = chunk * ARRAY_SCAV_CHUNK_CARDS;
+            W_ last = stg_min(first + ARRAY_SCAV_CHUNK_CARDS,
+                              mutArrPtrsCards(a->ptrs));
+            gct->scanned += stg_min((last - first) << MUT_ARR_PTRS_CARD_BITS,
+                                    a->ptrs - (first << MUT_ARR_PTRS_CARD_BITS));
+            any_failed = scavenge_mut_arr_ptrs_cards(a, first, last)
+                         || any_failed;
+        }
+    }
+
+    gct->failed_to_evac = false;
+    gct->eager_promotion = saved_eager;
+
+    if (any_failed) {
+        RELAXED_STORE(&job->any_failed, 1);
+    }
+    if (atomic_dec((StgVolatilePtr)&job->refs) == 0) {
+        finish_array_job(job);
+    }
+}
+
+// Scavenge a tagged item from a todo_q, which is either a block or a chunk
+// of a large array.
+static void
+scavenge_todo_item (bdescr *bd)
+{
+    if (IS_ARRAY_SCAV_JOB(bd)) {
+        scavenge_array_job(
+            (ArrayScavJob *)((StgWord)bd & ~(StgWord)ARRAY_SCAV_JOB_TAG));
+    } else {
+        scavenge_block(bd);
+    }
+}
+
+// If p is a large enough array, scavenge it in chunks which other GC
+// threads can help with, and return true.
+static bool
+split_large_array (StgClosure *p, gen_workspace *ws)
+{
+    W_ n_elems, n_chunks;
+    uint32_t copies, pushed;
+    ArrayScavJob *job;
+
+    if (!work_stealing || n_gc_threads == 1) {
+        return false;
+    }
+
+    switch (get_itbl(p)->type) {
+    case MUT_ARR_PTRS_CLEAN:
+    case MUT_ARR_PTRS_DIRTY:
+    case MUT_ARR_PTRS_FROZEN_CLEAN:
+    case MUT_ARR_PTRS_FROZEN_DIRTY:
+        n_elems = ((StgMutArrPtrs *)p)->ptrs;
+        break;
+    case SMALL_MUT_ARR_PTRS_CLEAN:
+    case SMALL_MUT_ARR_PTRS_DIRTY:
+    case SMALL_MUT_ARR_PTRS_FROZEN_CLEAN:
+    case SMALL_MUT_ARR_PTRS_FROZEN_DIRTY:
+        n_elems = ((StgSmallMutArrPtrs *)p)->ptrs;
+        break;
+    default:
+        return false;
+    }
+
+    n_chunks = (n_elems + ARRAY_SCAV_CHUNK_ELEMS - 1) / ARRAY_SCAV_CHUNK_ELEMS;
+    if (n_chunks < ARRAY_SCAV_SPLIT_CHUNKS) {
+        return false;
+    }
+
+    job = stgMallocBytes(sizeof(ArrayScavJob), "split_large_array");
+    job->arr = p;
+    job->gen_no = ws->gen->no;
+    job->n_chunks = n_chunks;
+    job->next_chunk = 0;
+    job->any_failed = 0;
+
+    // One reference for us and one for each copy on the deque. They must
+    // all be in place before the first copy can be stolen.
+    copies = n_gc_threads - 1;
+    job->refs = 1 + copies;
+    for (pushed = 0; pushed < copies; pushed++) {
+        if (!pushWSDeque(ws->todo_q,
+                         (void *)((StgWord)job | ARRAY_SCAV_JOB_TAG))) {
+            break;
+        }
+    }
+    for (; pushed < copies; pushed++) {
+        atomic_dec((StgVolatilePtr)&job->refs);
+    }
+
+    debugTrace(DEBUG_gc, "splitting large array %p into %" FMT_Word " chunks",
+               p, n_chunks);
+
+    scavenge_array_job(job);
+    return true;
+}
+
+#else
+
+STATIC_INLINE void
+scavenge_todo_item (bdescr *bd)
+{
+    ASSERT(!IS_ARRAY_SCAV_JOB(bd));
+    scavenge_block(bd);
+}
+
+#endif /* PARALLEL_GC */
+
 /*-----------------------------------------------------------------------------
   scavenge the large object list.
 
@@ -2035,6 +2483,14 @@ scavenge_large (gen_workspace *ws)
         }
         RELEASE_SPIN_LOCK(&ws->gen->sync);
 
+#if defined(PARALLEL_GC)
+        // See Note [Parallel scavenging of large arrays]
+        if (split_large_array((StgClosure *)p, ws)) {
+            gct->evac_gen_no = ws->gen->no;
+            continue;
+        }
+#endif
+
         if (scavenge_one(p)) {
             if (ws->gen->no > 0) {
                 recordMutableGen_GC((StgClosure *)p, ws->gen->no);
@@ -2111,7 +2567,7 @@ loop:
         }
 
         if ((bd = grab_local_todo_block(ws)) != NULL) {
-            scavenge_block(bd);
+            scavenge_todo_item(bd);
             did_something = true;
             break;
         }
@@ -2127,7 +2583,7 @@ loop:
         // look for work to steal
         for (g = RtsFlags.GcFlags.generations-1; g >= 0; g--) {
             if ((bd = steal_todo_block(g)) != NULL) {
-                scavenge_block(bd);
+                scavenge_todo_item(bd);
                 did_something = true;
                 break;
             }
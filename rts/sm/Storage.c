@@ -992,8 +992,8 @@ allocateMightFail (Capability *cap, W_ n)
         // Only credit allocation after we've passed the size check above
         accountAllocation(cap, n);
 
-        ACQUIRE_SM_LOCK
-        bd = allocGroupOnNode(cap->node,req_blocks);
+        ACQUIRE_SM_LOCK;
+        bd = allocGroupCached_locked(&cap->block_cache, cap->node, req_blocks);
         dbl_link_onto(bd, &g0->large_objects);
         g0->n_large_blocks += bd->blocks; // might be larger than req_blocks
         g0->n_new_large_words += n;
@@ -1021,10 +1021,8 @@ allocateMightFail (Capability *cap, W_ n)
         if (bd == NULL) {
             // The nursery is empty: allocate a fresh block (we can't
             // fail here).
-            ACQUIRE_SM_LOCK;
-            bd = allocGroupOnNode(cap->node, 1);
+            bd = allocGroupCached(&cap->block_cache, cap->node, 1);
             cap->r.rNursery->n_blocks++;
-            RELEASE_SM_LOCK;
             initBdescr(bd, g0, g0);
             bd->flags = 0;
             // If we had to allocate a new block, then we'll GC
@@ -1142,9 +1140,7 @@ allocatePinned (Capability *cap, W_ n)
         if (bd == NULL) {
             // The nursery is empty: allocate a fresh block (we can't fail
             // here).
-            ACQUIRE_SM_LOCK;
-            bd = allocGroupOnNode(cap->node, 1);
-            RELEASE_SM_LOCK;
+            bd = allocGroupCached(&cap->block_cache, cap->node, 1);
             initBdescr(bd, g0, g0);
         } else {
             newNurseryBlock(bd);
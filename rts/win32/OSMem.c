@@ -460,8 +460,10 @@ static void* heap_base = NULL;
 void *osReserveHeapMemory (void *startAddress, W_ *len)
 {
     void *start;
+    W_ align = RtsFlags.GcFlags.hugePages ? HUGE_PAGE_SIZE : MBLOCK_SIZE;
 
-    heap_base = VirtualAlloc(startAddress, *len + MBLOCK_SIZE,
+    *len &= ~(align - 1);
+    heap_base = VirtualAlloc(startAddress, *len + align,
                               MEM_RESERVE, PAGE_READWRITE);
     if (heap_base == NULL) {
         if (GetLastError() == ERROR_NOT_ENOUGH_MEMORY) {
@@ -470,7 +472,7 @@ void *osReserveHeapMemory (void *startAddress, W_ *len)
             sysErrorBelch(
                 "osReserveHeapMemory: VirtualAlloc MEM_RESERVE %llu bytes \
                 at address %p bytes failed",
-                *len + MBLOCK_SIZE, startAddress);
+                *len + align, startAddress);
         }
         stg_exit(EXIT_FAILURE);
     }
@@ -481,7 +483,7 @@ void *osReserveHeapMemory (void *startAddress, W_ *len)
     // before and after the aligned area
     // It is not a huge problem because we never commit
     // that memory
-    start = MBLOCK_ROUND_UP(heap_base);
+    start = (void*)(((W_)heap_base + align - 1) & ~(align - 1));
 
     return start;
 }
@@ -509,6 +511,18 @@ void osReleaseHeapMemory (void)
     VirtualFree(heap_base, 0, MEM_RELEASE);
 }
 
+void osAdviseHugePages (void *at STG_UNUSED, W_ size STG_UNUSED)
+{
+    // Windows large pages need SeLockMemoryPrivilege and must be requested
+    // with MEM_LARGE_PAGES when committing; we don't attempt that. The heap
+    // is still laid out in HUGE_PAGE_SIZE-aligned runs.
+}
+
+StgWord64 osHugePageBytes (void *at STG_UNUSED, W_ size STG_UNUSED)
+{
+    return 0;
+}
+
 #endif
 
 bool osBuiltWithNumaSupport(void)
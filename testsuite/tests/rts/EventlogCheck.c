@@ -0,0 +1,285 @@
+// Check properties of the eventlogs written by the eventlog_async,
+// eventlog_sample and block_cache tests.
+//
+// This is a minimal eventlog reader: it takes the sizes of the event types
+// from the header, so that it can step over the events it doesn't look at,
+// and attributes the events in each block to the capability in the block
+// marker.
+
+#include "Rts.h"
+#include "rts/EventLogFormat.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define MAX_CAPS 64
+
+static const unsigned char *p, *end;
+static int16_t event_size[NUM_GHC_EVENT_TAGS];
+
+static void truncated (void)
+{
+    printf("truncated eventlog\n");
+    exit(1);
+}
+
+static uint64_t getN (int n)
+{
+    uint64_t v = 0;
+    if (end - p < n) {
+        truncated();
+    }
+    for (int i = 0; i < n; i++) {
+        v = (v << 8) | *p++;
+    }
+    return v;
+}
+
+#define get16() ((uint16_t)getN(2))
+#define get32() ((uint32_t)getN(4))
+#define get64() getN(8)
+
+static void expect32 (uint32_t want, const char *what)
+{
+    if (get32() != want) {
+        printf("bad eventlog: expected %s\n", what);
+        exit(1);
+    }
+}
+
+static void readHeader (void)
+{
+    expect32(EVENT_HEADER_BEGIN, "header");
+    expect32(EVENT_HET_BEGIN, "event types");
+    for (int i = 0; i < NUM_GHC_EVENT_TAGS; i++) {
+        event_size[i] = -2; // not declared
+    }
+    for (;;) {
+        uint32_t tag = get32();
+        if (tag == EVENT_HET_END) {
+            break;
+        }
+        if (tag != EVENT_ET_BEGIN) {
+            printf("bad eventlog: expected an event type\n");
+            exit(1);
+        }
+        uint16_t num = get16();
+        int16_t size = (int16_t)get16();
+        uint32_t desc_len = get32();
+        p += desc_len;
+        uint32_t ext_len = get32();
+        p += ext_len;
+        expect32(EVENT_ET_END, "end of event type");
+        if (num < NUM_GHC_EVENT_TAGS) {
+            event_size[num] = size;
+        }
+    }
+    expect32(EVENT_HEADER_END, "end of header");
+    expect32(EVENT_DATA_BEGIN, "data");
+}
+
+// Per capability
+static uint64_t user_msgs[MAX_CAPS];
+static uint64_t dropped[MAX_CAPS];   // from the last EVENTLOG_DROPPED
+static uint64_t runs[MAX_CAPS];      // RUN_THREAD events
+static uint64_t running[MAX_CAPS];   // thread of the last RUN_THREAD, or 0
+static uint64_t spark_events[MAX_CAPS];
+static uint64_t counted_runs[MAX_CAPS];   // from the last SCHED_COUNTERS
+static uint64_t counted_sparks[MAX_CAPS]; // from the last SPARK_COUNTERS
+static uint64_t cache_hits[MAX_CAPS];      // from the last BLOCK_CACHE_COUNTERS
+static uint64_t cache_slow_path[MAX_CAPS];
+static bool unmatched_stop = false;
+
+static void readEvents (void)
+{
+    int cap = -1;   // the capability of the current block, or -1
+    const unsigned char *block_end = NULL;
+
+    for (;;) {
+        if (block_end != NULL && p >= block_end) {
+            cap = -1;
+            block_end = NULL;
+        }
+        uint16_t tag = get16();
+        if (tag == EVENT_DATA_END) {
+            break;
+        }
+        (void)get64(); // timestamp
+        if (tag >= NUM_GHC_EVENT_TAGS || event_size[tag] == -2) {
+            printf("bad eventlog: undeclared event %d\n", tag);
+            exit(1);
+        }
+        uint32_t size = event_size[tag] == -1 ? get16() : event_size[tag];
+        const unsigned char *payload = p;
+        if ((size_t)(end - p) < size) {
+            truncated();
+        }
+
+        switch (tag) {
+        case EVENT_BLOCK_MARKER: {
+            // the block size counts from the start of the marker
+            uint32_t block_size = get32();
+            (void)get64(); // end time
+            cap = (int16_t)get16();
+            block_end = payload - sizeof(EventTypeNum)
+                      - sizeof(EventTimestamp) + block_size;
+            if (cap >= MAX_CAPS) {
+                printf("too many capabilities\n");
+                exit(1);
+            }
+            break;
+        }
+        case EVENT_USER_MSG:
+            if (cap >= 0) {
+                user_msgs[cap]++;
+            }
+            break;
+        case EVENT_EVENTLOG_DROPPED:
+            if (cap >= 0) {
+                dropped[cap] = get64();
+            }
+            break;
+        case EVENT_RUN_THREAD:
+            if (cap >= 0) {
+                runs[cap]++;
+                running[cap] = get32();
+            }
+            break;
+        case EVENT_STOP_THREAD:
+            if (cap >= 0) {
+                if (running[cap] != get32()) {
+                    unmatched_stop = true;
+                }
+                running[cap] = 0;
+            }
+            break;
+        case EVENT_SPARK_CREATE:
+        case EVENT_SPARK_DUD:
+        case EVENT_SPARK_OVERFLOW:
+        case EVENT_SPARK_RUN:
+        case EVENT_SPARK_STEAL:
+        case EVENT_SPARK_FIZZLE:
+        case EVENT_SPARK_GC:
+            if (cap >= 0) {
+                spark_events[cap]++;
+            }
+            break;
+        case EVENT_SCHED_COUNTERS:
+            if (cap >= 0) {
+                (void)get64(); // created
+                counted_runs[cap] = get64();
+            }
+            break;
+        case EVENT_SPARK_COUNTERS:
+            if (cap >= 0) {
+                // (crt,dud,ovf,cnv,gcd,fiz,rem): all but the remaining ones
+                counted_sparks[cap] = 0;
+                for (int i = 0; i < 6; i++) {
+                    counted_sparks[cap] += get64();
+                }
+            }
+            break;
+        case EVENT_BLOCK_CACHE_COUNTERS:
+            if (cap >= 0) {
+                cache_hits[cap] = get64();
+                cache_slow_path[cap] = get64();
+            }
+            break;
+        }
+        p = payload + size;
+    }
+}
+
+// Each of the test's 400000 user messages was either written, or counted in
+// the EVENTLOG_DROPPED events of its capability.
+static void checkAsync (void)
+{
+    uint64_t seen = 0, lost = 0;
+    for (int c = 0; c < MAX_CAPS; c++) {
+        seen += user_msgs[c];
+        lost += dropped[c];
+    }
+    printf("events accounted for: %s\n",
+           seen + lost == 400000 ? "ok" : "bad");
+}
+
+// The test runs 400000 yields and creates 40000 sparks, with one in 100
+// scheduler events and one in 10 spark events sampled.  The final counters
+// must cover all of them, and many fewer events must have been posted.
+static void checkSample (void)
+{
+    uint64_t posted_runs = 0, all_runs = 0;
+    uint64_t posted_sparks = 0, all_sparks = 0;
+    for (int c = 0; c < MAX_CAPS; c++) {
+        posted_runs += runs[c];
+        all_runs += counted_runs[c];
+        posted_sparks += spark_events[c];
+        all_sparks += counted_sparks[c];
+    }
+    printf("SCHED_COUNTERS size: %s\n",
+           event_size[EVENT_SCHED_COUNTERS] == 6 * 8 ? "ok" : "bad");
+    printf("stops matched: %s\n", unmatched_stop ? "bad" : "ok");
+    printf("runs counted: %s\n", all_runs >= 400000 ? "ok" : "bad");
+    printf("runs sampled: %s\n",
+           posted_runs > 0 && 5 * posted_runs < all_runs ? "ok" : "bad");
+    printf("sparks counted: %s\n", all_sparks >= 40000 ? "ok" : "bad");
+    printf("sparks sampled: %s\n",
+           posted_sparks > 0 && 2 * posted_sparks < all_sparks ? "ok" : "bad");
+}
+
+// The test allocates 40000 large objects of 1 to 4 blocks and 1000 of 16
+// blocks.  Each of them is either a hit or goes the slow path, and since a
+// miss fetches a batch of groups most of the small ones must be hits.
+static void checkBlockCache (void)
+{
+    uint64_t hits = 0, slow_path = 0;
+    for (int c = 0; c < MAX_CAPS; c++) {
+        hits += cache_hits[c];
+        slow_path += cache_slow_path[c];
+    }
+    printf("block cache counters: %s\n",
+           hits + slow_path >= 41000 && slow_path >= 1000 ? "ok" : "bad");
+    printf("block cache hits: %s\n", hits > 2 * slow_path ? "ok" : "bad");
+}
+
+int main (int argc, char *argv[])
+{
+    if (argc != 3) {
+        fprintf(stderr, "usage: %s async|sample|blockcache <eventlog>\n", argv[0]);
+        return 1;
+    }
+
+    FILE *f = fopen(argv[2], "rb");
+    if (f == NULL) {
+        printf("can't open %s\n", argv[2]);
+        return 1;
+    }
+    fseek(f, 0, SEEK_END);
+    long len = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    unsigned char *buf = malloc(len);
+    if (buf == NULL || fread(buf, 1, len, f) != (size_t)len) {
+        printf("can't read %s\n", argv[2]);
+        return 1;
+    }
+    fclose(f);
+    p = buf;
+    end = buf + len;
+
+    readHeader();
+    readEvents();
+
+    if (strcmp(argv[1], "async") == 0) {
+        checkAsync();
+    } else if (strcmp(argv[1], "sample") == 0) {
+        checkSample();
+    } else if (strcmp(argv[1], "blockcache") == 0) {
+        checkBlockCache();
+    } else {
+        fprintf(stderr, "unknown check %s\n", argv[1]);
+        return 1;
+    }
+    free(buf);
+    return 0;
+}
@@ -0,0 +1,5 @@
+import Control.Monad
+import Debug.Trace
+
+main :: IO ()
+main = forM_ [1 .. 200000 :: Int] $ \i -> traceEventIO ("event " ++ show i)
@@ -0,0 +1,165 @@
+// Decompress an eventlog written with +RTS --eventlog-compress and compare
+// it with the eventlog of the same run written without compression.
+//
+// The two eventlogs must be the same byte for byte, except for what differs
+// from one run to the next: the timestamps, the end times of the blocks, and
+// the process ids and wall clock time.  So the headers are compared as they
+// are, and then the events one by one, skipping those fields.
+
+#include "Rts.h"
+#include "rts/EventLogFormat.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef struct {
+    const char *name;
+    const unsigned char *p, *end;
+} Log;
+
+static int16_t event_size[NUM_GHC_EVENT_TAGS];
+
+static void readLog (Log *log, const char *path)
+{
+    FILE *f = fopen(path, "rb");
+    if (f == NULL) {
+        printf("can't open %s\n", path);
+        exit(1);
+    }
+    fseek(f, 0, SEEK_END);
+    long len = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    unsigned char *buf = malloc(len);
+    if (buf == NULL || fread(buf, 1, len, f) != (size_t)len) {
+        printf("can't read %s\n", path);
+        exit(1);
+    }
+    fclose(f);
+    log->name = path;
+    log->p = buf;
+    log->end = buf + len;
+}
+
+static uint64_t getN (Log *log, int n)
+{
+    uint64_t v = 0;
+    if (log->end - log->p < n) {
+        printf("truncated eventlog %s\n", log->name);
+        exit(1);
+    }
+    for (int i = 0; i < n; i++) {
+        v = (v << 8) | *log->p++;
+    }
+    return v;
+}
+
+#define get16(log) ((uint16_t)getN(log, 2))
+#define get32(log) ((uint32_t)getN(log, 4))
+
+// Step over the header, noting the sizes of the event types.
+static void readHeader (Log *log)
+{
+    for (int i = 0; i < NUM_GHC_EVENT_TAGS; i++) {
+        event_size[i] = -2; // not declared
+    }
+    (void)get32(log); // EVENT_HEADER_BEGIN
+    (void)get32(log); // EVENT_HET_BEGIN
+    while (get32(log) == EVENT_ET_BEGIN) {
+        uint16_t num = get16(log);
+        int16_t size = (int16_t)get16(log);
+        log->p += get32(log); // description
+        log->p += get32(log); // extensions
+        (void)get32(log);     // EVENT_ET_END
+        if (num < NUM_GHC_EVENT_TAGS) {
+            event_size[num] = size;
+        }
+    }
+    (void)get32(log); // EVENT_HEADER_END
+    (void)get32(log); // EVENT_DATA_BEGIN
+}
+
+// Compare the events of a and b, up to the end of data marker.
+static bool sameEvents (Log *a, Log *b)
+{
+    uint64_t n = 0;
+
+    for (;; n++) {
+        uint16_t tag = get16(a);
+        if (get16(b) != tag) {
+            printf("event %" FMT_Word64 ": different events\n", n);
+            return false;
+        }
+        if (tag == EVENT_DATA_END) {
+            return a->p == a->end && b->p == b->end;
+        }
+        a->p += sizeof(EventTimestamp);
+        b->p += sizeof(EventTimestamp);
+        if (tag >= NUM_GHC_EVENT_TAGS || event_size[tag] == -2) {
+            printf("bad eventlog: undeclared event %d\n", tag);
+            exit(1);
+        }
+        uint32_t size = event_size[tag];
+        if (event_size[tag] == -1) {
+            size = get16(a);
+            if (get16(b) != size) {
+                printf("event %" FMT_Word64 ": different sizes\n", n);
+                return false;
+            }
+        }
+        if ((size_t)(a->end - a->p) < size || (size_t)(b->end - b->p) < size) {
+            printf("truncated eventlog\n");
+            exit(1);
+        }
+
+        switch (tag) {
+        case EVENT_OSPROCESS_PID:
+        case EVENT_OSPROCESS_PPID:
+        case EVENT_WALL_CLOCK_TIME:
+            break;
+        case EVENT_BLOCK_MARKER:
+            // (block size, end time, cap): skip the end time
+            if (memcmp(a->p, b->p, 4) != 0
+                || memcmp(a->p + 12, b->p + 12, size - 12) != 0) {
+                printf("event %" FMT_Word64 ": different blocks\n", n);
+                return false;
+            }
+            break;
+        default:
+            if (memcmp(a->p, b->p, size) != 0) {
+                printf("event %" FMT_Word64 ": different payloads\n", n);
+                return false;
+            }
+        }
+        a->p += size;
+        b->p += size;
+    }
+}
+
+int main (int argc, char *argv[])
+{
+    if (argc != 4) {
+        fprintf(stderr, "usage: %s <compressed> <out> <uncompressed>\n",
+                argv[0]);
+        return 1;
+    }
+    if (!decompressEventLogFile(argv[1], argv[2])) {
+        return 1;
+    }
+
+    Log a, b;
+    readLog(&a, argv[2]);
+    readLog(&b, argv[3]);
+
+    const unsigned char *a_begin = a.p, *b_begin = b.p;
+    readHeader(&a);
+    readHeader(&b);
+    bool same_header = a.p - a_begin == b.p - b_begin
+        && memcmp(a_begin, b_begin, a.p - a_begin) == 0;
+    printf("header: %s\n", same_header ? "ok" : "bad");
+    if (!same_header) {
+        return 0;
+    }
+    printf("events: %s\n", sameEvents(&a, &b) ? "ok" : "bad");
+    return 0;
+}
@@ -0,0 +1,6 @@
+import Control.Monad
+import Debug.Trace
+
+-- Enough events to go round a 8MB ring a few times
+main :: IO ()
+main = forM_ [1 .. 1000000 :: Int] $ \i -> traceEventIO ("event " ++ show i)
@@ -0,0 +1,141 @@
+// Read the eventlog ring buffer left behind by EventlogRing, run with
+// +RTS --eventlog-ring, and check that it starts with the eventlog header
+// and ends with the end of data marker.
+//
+// The program posts many more events than fit in the ring, so the reader
+// starts off overrun.  It must resynchronise by returning the header again
+// followed by whole blocks, which must hold the last of the program's user
+// messages, "event 1" to "event 1000000", in order.
+
+#include "Rts.h"
+#include "rts/EventLogFormat.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define LAST_EVENT 1000000
+
+static int16_t event_size[NUM_GHC_EVENT_TAGS];
+
+static uint64_t getN (const unsigned char **p, int n)
+{
+    uint64_t v = 0;
+    for (int i = 0; i < n; i++) {
+        v = (v << 8) | *(*p)++;
+    }
+    return v;
+}
+
+// Note the sizes of the event types declared in a header chunk.
+static void readHeader (const unsigned char *p)
+{
+    for (int i = 0; i < NUM_GHC_EVENT_TAGS; i++) {
+        event_size[i] = -2; // not declared
+    }
+    p += 8; // EVENT_HEADER_BEGIN, EVENT_HET_BEGIN
+    while (getN(&p, 4) == EVENT_ET_BEGIN) {
+        uint16_t num = getN(&p, 2);
+        int16_t size = (int16_t)getN(&p, 2);
+        p += getN(&p, 4); // description
+        p += getN(&p, 4); // extensions
+        p += 4;           // EVENT_ET_END
+        if (num < NUM_GHC_EVENT_TAGS) {
+            event_size[num] = size;
+        }
+    }
+}
+
+static uint64_t msgs = 0;       // user messages since the last header
+static uint64_t last_msg = 0;   // the number of the last one
+static bool in_order = true;
+
+static void readBlock (const unsigned char *p, size_t len)
+{
+    const unsigned char *end = p + len;
+
+    while (end - p >= 2) {
+        uint16_t tag = getN(&p, 2);
+        if (tag == EVENT_DATA_END) {
+            break;
+        }
+        p += sizeof(EventTimestamp);
+        if (tag >= NUM_GHC_EVENT_TAGS || event_size[tag] == -2) {
+            printf("bad eventlog: undeclared event %d\n", tag);
+            exit(1);
+        }
+        uint32_t size = event_size[tag] == -1 ? (uint32_t)getN(&p, 2)
+                                                : (uint32_t)event_size[tag];
+        if (tag == EVENT_USER_MSG) {
+            char buf[32];
+            if (size >= sizeof(buf) || size <= 6) {
+                in_order = false;
+            } else {
+                memcpy(buf, p, size);
+                buf[size] = '\0';
+                uint64_t n = strtoull(buf + 6, NULL, 10);
+                if (msgs > 0 && n != last_msg + 1) {
+                    in_order = false;
+                }
+                last_msg = n;
+                msgs++;
+            }
+        }
+        p += size;
+    }
+}
+
+int main (int argc, char *argv[])
+{
+    if (argc != 2) {
+        fprintf(stderr, "usage: %s <ring>\n", argv[0]);
+        return 1;
+    }
+    EventLogRingReader *reader = openEventLogRing(argv[1]);
+    if (reader == NULL) {
+        printf("can't open ring\n");
+        return 1;
+    }
+
+    size_t len;
+    const unsigned char *chunk = readEventLogRing(reader, &len);
+    if (chunk == NULL || len < 4 || memcmp(chunk, "hdrb", 4) != 0) {
+        printf("header: bad\n");
+        return 1;
+    }
+    printf("header: ok\n");
+    readHeader(chunk);
+
+    // the last chunk of a finished eventlog is the end of data marker
+    unsigned char last[2] = { 0, 0 };
+    int headers = 1;
+    bool after_header = false, resync_on_block = false;
+    while ((chunk = readEventLogRing(reader, &len)) != NULL) {
+        if (len >= 4 && memcmp(chunk, "hdrb", 4) == 0) {
+            readHeader(chunk);
+            headers++;
+            after_header = true;
+            msgs = 0;
+            in_order = true;
+            continue;
+        }
+        if (after_header) {
+            const unsigned char *p = chunk;
+            resync_on_block = len >= 2 && getN(&p, 2) == EVENT_BLOCK_MARKER;
+            after_header = false;
+        }
+        readBlock(chunk, len);
+        if (len >= 2) {
+            memcpy(last, chunk + len - 2, 2);
+        }
+    }
+    printf("end: %s\n", last[0] == 0xff && last[1] == 0xff ? "ok" : "bad");
+    printf("resynchronised: %s\n",
+           headers >= 2 && resync_on_block ? "ok" : "bad");
+    printf("last events: %s\n",
+           msgs >= 100000 && in_order && last_msg == LAST_EVENT
+           ? "ok" : "bad");
+
+    closeEventLogRing(reader);
+    return 0;
+}
@@ -0,0 +1,58 @@
+-- A benchmark for awaitEvent in the non-threaded RTS (rts/posix/Select.c).
+-- 10000 threads block reading fds of their own (dups of a pipe that never
+-- gets any data), while two threads play ping-pong over two other pipes, so
+-- every round trip goes through awaitEvent.  With select() each call took
+-- time proportional to the number of blocked fds; with epoll it shouldn't.
+-- If the fd limit is too low for 10000 fds we use as many as we can.
+-- The timing goes to stderr.
+
+import Control.Concurrent
+import Control.Monad
+import Foreign
+import GHC.Clock
+import System.IO
+import System.Posix.IO
+import System.Posix.Resource
+import System.Posix.Types
+
+maxIdlers, rounds :: Int
+maxIdlers = 10000
+rounds = 10000
+
+-- Raise the soft limit on open files as far as we may, and return how many
+-- idle fds that leaves room for.
+idleFds :: IO Int
+idleFds = do
+  lim <- getResourceLimit ResourceOpenFiles
+  let hard = hardLimit lim
+  setResourceLimit ResourceOpenFiles lim { softLimit = hard }
+  return $ case hard of
+    ResourceLimit n -> max 0 (min maxIdlers (fromIntegral n - 100))
+    _ -> maxIdlers
+
+send :: Fd -> IO ()
+send fd = with (0 :: Word8) $ \p -> void (fdWriteBuf fd p 1)
+
+recv :: Fd -> IO ()
+recv fd = do
+  threadWaitRead fd
+  allocaBytes 1 $ \p -> void (fdReadBuf fd p 1)
+
+main :: IO ()
+main = do
+  idlers <- idleFds
+  (quiet, _) <- createPipe
+  replicateM_ idlers $ do
+    fd <- dup quiet
+    forkIO $ threadWaitRead fd
+  (pingR, pingW) <- createPipe
+  (pongR, pongW) <- createPipe
+  _ <- forkIO $ replicateM_ rounds (recv pingR >> send pongW)
+  yield -- let the other threads block
+  t0 <- getMonotonicTimeNSec
+  replicateM_ rounds (send pingW >> recv pongR)
+  t1 <- getMonotonicTimeNSec
+  putStrLn "done"
+  hPutStrLn stderr $ show idlers ++ " blocked fds: "
+    ++ show (fromIntegral (t1 - t0) / fromIntegral rounds / 1000 :: Double)
+    ++ " us/round trip"
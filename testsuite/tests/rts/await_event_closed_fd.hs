@@ -0,0 +1,19 @@
+-- A thread blocked reading an fd that another thread closes gets
+-- blockedOnBadFD, rather than hanging, in the non-threaded RTS
+-- (see Note [awaitEvent with epoll] in rts/posix/Select.c).
+
+import Control.Concurrent
+import Control.Exception
+import System.Posix.IO
+
+main :: IO ()
+main = do
+  (r, _w) <- createPipe
+  result <- newEmptyMVar
+  _ <- forkIO $ do
+    res <- try (threadWaitRead r)
+    putMVar result (res :: Either IOException ())
+  yield -- let the thread block
+  closeFd r
+  res <- takeMVar result
+  putStrLn $ either (const "blockedOnBadFD") (const "woken") res
@@ -0,0 +1,27 @@
+-- A thread blocked reading an fd whose number is reused by a new pipe, and
+-- a thread that then blocks reading the new pipe, are both woken when the
+-- new pipe gets data, as with select(), in the non-threaded RTS (see
+-- Note [awaitEvent with epoll] in rts/posix/Select.c).
+
+import Control.Concurrent
+import Control.Monad
+import Foreign
+import System.Posix.IO
+
+main :: IO ()
+main = do
+  (r1, _w1) <- createPipe
+  a <- newEmptyMVar
+  _ <- forkIO $ threadWaitRead r1 >> putMVar a ()
+  yield -- let the thread block
+  closeFd r1
+  (r2, w2) <- createPipe
+  print (r2 == r1)
+  b <- newEmptyMVar
+  _ <- forkIO $ threadWaitRead r2 >> putMVar b ()
+  yield -- let the thread block
+  with (0 :: Word8) $ \p -> void (fdWriteBuf w2 p 1)
+  takeMVar a
+  putStrLn "first thread woken"
+  takeMVar b
+  putStrLn "second thread woken"
@@ -0,0 +1,19 @@
+{-# LANGUAGE MagicHash, UnboxedTuples #-}
+-- Allocate many large objects of 1 to 4 blocks, which are served from the
+-- capability's block cache, and some of 16 blocks, which are too big for
+-- it.  EventlogCheck then checks the BLOCK_CACHE_COUNTERS events.
+
+import Control.Monad
+import GHC.Exts
+import GHC.IO
+import System.Mem
+
+newBytes :: Int -> IO ()
+newBytes (I# n) = IO $ \s -> case newByteArray# n s of (# s', _ #) -> (# s', () #)
+
+main :: IO ()
+main = do
+  forM_ [1 .. 40000 :: Int] $ \i -> newBytes ((i `mod` 4 + 1) * 4096 - 64)
+  forM_ [1 .. 1000 :: Int] $ \_ -> newBytes (16 * 4096 - 64)
+  performMajorGC
+  putStrLn "done"
@@ -0,0 +1,20 @@
+-- Fill several capabilities' eventlog buffers many times over, with the
+-- eventlog written by the asynchronous writer thread.  EventlogCheck then
+-- checks that each of the 400000 events was either written or counted as
+-- dropped.
+
+import Control.Concurrent
+import Control.Monad
+import Debug.Trace
+
+main :: IO ()
+main = do
+  dones <- forM [1 .. 4 :: Int] $ \t -> do
+    done <- newEmptyMVar
+    _ <- forkOn t $ do
+      forM_ [1 .. 100000 :: Int] $ \i ->
+        traceEventIO ("event " ++ show t ++ " " ++ show i)
+      putMVar done ()
+    return done
+  mapM_ takeMVar dones
+  putStrLn "done"
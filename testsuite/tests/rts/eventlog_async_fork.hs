@@ -0,0 +1,16 @@
+-- forkProcess with the asynchronous eventlog writer running: the child must
+-- be able to restart event logging, write its own events and exit.
+
+import Control.Monad
+import Debug.Trace
+import System.Posix.Process
+
+main :: IO ()
+main = do
+  forM_ [1 .. 10000 :: Int] $ \i -> traceEventIO ("parent " ++ show i)
+  pid <- forkProcess $
+    forM_ [1 .. 10000 :: Int] $ \i -> traceEventIO ("child " ++ show i)
+  status <- getProcessStatus True False pid
+  print status
+  forM_ [1 .. 10000 :: Int] $ \i -> traceEventIO ("parent " ++ show i)
+  putStrLn "done"
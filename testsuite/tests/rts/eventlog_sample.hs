@@ -0,0 +1,20 @@
+-- Switch threads and create sparks at a high rate with sampled scheduler
+-- and spark events.  EventlogCheck then checks the sampled eventlog
+-- against the counters in it.
+
+import Control.Concurrent
+import Control.Monad
+import GHC.Conc
+
+main :: IO ()
+main = do
+  dones <- forM [1 .. 4 :: Int] $ \t -> do
+    done <- newEmptyMVar
+    _ <- forkIO $ do
+      forM_ [1 .. 100000 :: Int] $ \i -> do
+        when (i `mod` 10 == 0) $ (t * i) `par` return ()
+        yield
+      putMVar done ()
+    return done
+  mapM_ takeMVar dones
+  putStrLn "done"
@@ -0,0 +1,39 @@
+{-# LANGUAGE BangPatterns #-}
+-- Keep a large tree of small objects live across a number of major GCs.
+-- The Makefile runs this without and with +RTS --gc-prefetch, checks that
+-- both runs agree and reports the GC time of each.
+
+import Control.Monad
+import Data.List (foldl')
+import System.Mem
+
+data Tree = Leaf | Node !Tree {-# UNPACK #-} !Int !Tree
+
+insert :: Int -> Tree -> Tree
+insert !k Leaf = Node Leaf k Leaf
+insert !k t@(Node l x r)
+  | k < x     = Node (insert k l) x r
+  | k > x     = Node l x (insert k r)
+  | otherwise = t
+
+size :: Tree -> Int
+size Leaf = 0
+size (Node l _ r) = size l + 1 + size r
+
+total :: Tree -> Int
+total = go 0
+  where
+    go !acc Leaf = acc
+    go !acc (Node l x r) = go (go (acc + x) l) r
+
+-- distinct pseudo-random keys, so that the tree is reasonably balanced
+keys :: Int -> [Int]
+keys n = take n (tail (iterate next 1))
+  where next x = (1103515245 * x + 12345) `mod` 2147483648
+
+main :: IO ()
+main = do
+  let !t = foldl' (flip insert) Leaf (keys 500000)
+  forM_ [1 .. 5 :: Int] $ \_ -> do
+    performMajorGC
+    print (size t, total t)
@@ -0,0 +1,219 @@
+// A microbenchmark for rts/Hash.c: time insertion, lookup, removal and
+// iteration for word and string keys, for the RTS's open addressing tables
+// and for the linear hash tables it used before (hash_table_bench_chained.c).
+// Timings go to stderr; stdout only reports whether the tables gave the
+// right answers, so the test can check them.
+//
+// Both string tables use the same string hash, built on the table's
+// hashWord, so that they only differ in the table itself.
+
+#include "Rts.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// From rts/Hash.h
+typedef struct hashtable HashTable;
+typedef int HashFunction(const HashTable *table, StgWord key);
+typedef int CompareFunction(StgWord key1, StgWord key2);
+typedef void (*MapHashFn)(void *data, StgWord key, const void *value);
+extern HashTable *allocHashTable(void);
+extern HashTable *allocHashTable_(HashFunction *hash, CompareFunction *compare);
+extern int hashWord(const HashTable *table, StgWord key);
+extern void insertHashTable(HashTable *table, StgWord key, const void *data);
+extern void *lookupHashTable(const HashTable *table, StgWord key);
+extern void *removeHashTable(HashTable *table, StgWord key, const void *data);
+extern void mapHashTable(HashTable *table, void *data, MapHashFn fn);
+extern int keyCountHashTable(HashTable *table);
+extern void freeHashTable(HashTable *table, void (*freeDataFun)(void *));
+
+// From hash_table_bench_chained.c
+extern HashTable *chainedAllocHashTable(void);
+extern HashTable *chainedAllocHashTable_(HashFunction *hash,
+                                         CompareFunction *compare);
+extern int chainedHashWord(const HashTable *table, StgWord key);
+extern void chainedInsertHashTable(HashTable *table, StgWord key,
+                                   const void *data);
+extern void *chainedLookupHashTable(const HashTable *table, StgWord key);
+extern void *chainedRemoveHashTable(HashTable *table, StgWord key,
+                                    const void *data);
+extern void chainedMapHashTable(HashTable *table, void *data, MapHashFn fn);
+extern int chainedKeyCountHashTable(HashTable *table);
+extern void chainedFreeHashTable(HashTable *table,
+                                 void (*freeDataFun)(void *));
+
+#define N        (1 << 20)
+#define ROUNDS   4
+
+// FNV-1a
+static StgWord strHash(StgWord key)
+{
+    StgWord64 h = 14695981039346656037ULL;
+    for (const char *s = (const char *)key; *s != '\0'; s++) {
+        h = (h ^ (unsigned char)*s) * 1099511628211ULL;
+    }
+    return (StgWord)h;
+}
+
+static int compareStr(StgWord key1, StgWord key2)
+{
+    return strcmp((const char *)key1, (const char *)key2) == 0;
+}
+
+static int hashStr(const HashTable *table, StgWord key)
+{
+    return hashWord(table, strHash(key));
+}
+
+static int chainedHashStr(const HashTable *table, StgWord key)
+{
+    return chainedHashWord(table, strHash(key));
+}
+
+static HashTable *allocStrTable(void)
+{
+    return allocHashTable_(hashStr, compareStr);
+}
+
+static HashTable *chainedAllocStrTable(void)
+{
+    return chainedAllocHashTable_(chainedHashStr, compareStr);
+}
+
+typedef struct {
+    const char *name;
+    HashTable *(*alloc_word)(void);
+    HashTable *(*alloc_str)(void);
+    void (*insert)(HashTable *table, StgWord key, const void *data);
+    void *(*lookup)(const HashTable *table, StgWord key);
+    void *(*remove)(HashTable *table, StgWord key, const void *data);
+    void (*map)(HashTable *table, void *data, MapHashFn fn);
+    int (*key_count)(HashTable *table);
+    void (*free)(HashTable *table, void (*freeDataFun)(void *));
+} Impl;
+
+static const Impl impls[] = {
+    { "open", allocHashTable, allocStrTable,
+      insertHashTable, lookupHashTable, removeHashTable,
+      mapHashTable, keyCountHashTable, freeHashTable },
+    { "chained", chainedAllocHashTable, chainedAllocStrTable,
+      chainedInsertHashTable, chainedLookupHashTable, chainedRemoveHashTable,
+      chainedMapHashTable, chainedKeyCountHashTable, chainedFreeHashTable },
+};
+
+static StgWord word_keys[N], word_misses[N];
+static StgWord str_keys[N], str_misses[N];
+static char strs[2 * N][16];
+
+static StgWord64 start_ns;
+
+static void start(void)
+{
+    start_ns = getMonotonicNSec();
+}
+
+static void stop(const Impl *impl, const char *keys, const char *what)
+{
+    StgWord64 ns = getMonotonicNSec() - start_ns;
+    fprintf(stderr, "%-8s %-7s %-8s %8.2f ns/op\n", impl->name, keys, what,
+            (double)ns / ((double)N * ROUNDS));
+}
+
+static void count_entry(void *data, StgWord key STG_UNUSED,
+                        const void *value STG_UNUSED)
+{
+    (*(StgWord *)data)++;
+}
+
+static void bench(const Impl *impl, const char *name,
+                  HashTable *(*alloc)(void),
+                  StgWord keys[], StgWord misses[])
+{
+    bool ok = true;
+    StgWord found = 0;
+    HashTable *tables[ROUNDS];
+
+    start();
+    for (int r = 0; r < ROUNDS; r++) {
+        tables[r] = alloc();
+        for (int i = 0; i < N; i++) {
+            impl->insert(tables[r], keys[i], (void *)(keys[i] + r));
+        }
+    }
+    stop(impl, name, "insert");
+
+    start();
+    for (int r = 0; r < ROUNDS; r++) {
+        // look up in a different order from the insertions
+        for (int i = 0; i < N; i++) {
+            StgWord k = keys[((StgWord)i * 7919) & (N - 1)];
+            ok = ok && impl->lookup(tables[r], k) == (void *)(k + r);
+        }
+    }
+    stop(impl, name, "lookup");
+
+    start();
+    for (int r = 0; r < ROUNDS; r++) {
+        for (int i = 0; i < N; i++) {
+            found += impl->lookup(tables[r], misses[i]) != NULL;
+        }
+    }
+    stop(impl, name, "miss");
+
+    start();
+    for (int r = 0; r < ROUNDS; r++) {
+        impl->map(tables[r], &found, count_entry);
+    }
+    stop(impl, name, "iterate");
+    ok = ok && found == (StgWord)N * ROUNDS;
+
+    start();
+    for (int r = 0; r < ROUNDS; r++) {
+        for (int i = 0; i < N; i++) {
+            StgWord k = keys[((StgWord)i * 7919) & (N - 1)];
+            ok = ok && impl->remove(tables[r], k, NULL) == (void *)(k + r);
+        }
+        ok = ok && impl->key_count(tables[r]) == 0;
+        impl->free(tables[r], NULL);
+    }
+    stop(impl, name, "remove");
+
+    printf("%s %s: %s\n", impl->name, name, ok ? "ok" : "FAILED");
+}
+
+int main (int argc, char *argv[])
+{
+    StgWord *heap;
+
+    {
+        RtsConfig conf = defaultRtsConfig;
+        conf.rts_opts_enabled = RtsOptsAll;
+        hs_init_ghc(&argc, &argv, conf);
+    }
+
+    // Word keys that look like pointers to scattered two-word heap
+    // objects, and pointers in between them that are not in the table
+    heap = malloc(N * 4 * sizeof(StgWord));
+    for (int i = 0; i < N; i++) {
+        StgWord j = ((StgWord)i * 40503) & (N - 1);
+        word_keys[i] = (StgWord)&heap[j * 4];
+        word_misses[i] = (StgWord)&heap[j * 4 + 2];
+    }
+
+    for (int i = 0; i < N; i++) {
+        snprintf(strs[i], sizeof(strs[i]), "sym%d", i);
+        snprintf(strs[N + i], sizeof(strs[N + i]), "missing%d", i);
+        str_keys[i] = (StgWord)strs[i];
+        str_misses[i] = (StgWord)strs[N + i];
+    }
+
+    for (unsigned int i = 0; i < sizeof(impls) / sizeof(impls[0]); i++) {
+        bench(&impls[i], "word", impls[i].alloc_word, word_keys, word_misses);
+        bench(&impls[i], "string", impls[i].alloc_str, str_keys, str_misses);
+    }
+
+    free(heap);
+    hs_exit();
+    return 0;
+}
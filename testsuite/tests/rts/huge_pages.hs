@@ -0,0 +1,12 @@
+-- Exercise the megablock allocator with +RTS --huge-pages: grow and shrink
+-- the heap a few times so that megablocks are committed, returned to the
+-- OS and reused in whole huge pages. The Makefile checks the -Dg trace.
+
+import Control.Monad
+import System.Mem
+
+main :: IO ()
+main = forM_ [1..4 :: Int] $ \r -> do
+  let xs = [1 .. r * 500000]
+  print (sum xs + length xs)
+  performMajorGC
@@ -0,0 +1,17 @@
+-- Exercise the parallel and lazy sweep of the non-moving collector: keep
+-- half of a set of lists alive across major collections while allocating
+-- enough for the mutator to sweep segments itself.
+
+import Control.Monad
+import Data.IORef
+import System.Mem
+
+main :: IO ()
+main = do
+  refs <- forM [1..64 :: Int] $ \i -> newIORef [i .. i + 1000]
+  forM_ [1..6 :: Int] $ \r -> do
+    forM_ (zip [1..] refs) $ \(i, ref) ->
+      when (even (i + r)) $ writeIORef ref [i + r .. i + r + 1000]
+    performMajorGC
+    total <- sum <$> mapM (fmap sum . readIORef) refs
+    print total
@@ -0,0 +1,15 @@
+-- Replace a large live list a few times, so that the non-moving collector
+-- frees whole segments, which are returned to the capabilities' magazines
+-- and allocated from again by the next round.
+
+import Control.Monad
+import Data.IORef
+import System.Mem
+
+main :: IO ()
+main = do
+  ref <- newIORef []
+  forM_ [1 .. 10 :: Int] $ \r -> do
+    writeIORef ref [r .. r + 200000]
+    print . sum =<< readIORef ref
+    performMajorGC
@@ -0,0 +1,28 @@
+-- Exercise the parallel mark of the non-moving collector: build trees which
+-- survive into the non-moving heap and check they remain intact across
+-- major collections.
+
+import Control.Monad
+import Data.IORef
+import System.Mem
+
+data Tree = Leaf | Node Tree !Int Tree
+
+build :: Int -> Int -> Tree
+build lo hi
+  | lo > hi   = Leaf
+  | otherwise = Node (build lo (mid - 1)) mid (build (mid + 1) hi)
+  where mid = (lo + hi) `div` 2
+
+sumTree :: Tree -> Int
+sumTree Leaf         = 0
+sumTree (Node l x r) = sumTree l + x + sumTree r
+
+main :: IO ()
+main = do
+  ref <- newIORef Leaf
+  forM_ [1..8] $ \i -> do
+    let t = build 1 (8000 * i)
+    sumTree t `seq` writeIORef ref t
+    performMajorGC
+    readIORef ref >>= print . sumTree
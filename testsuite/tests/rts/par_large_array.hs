@@ -0,0 +1,41 @@
+{-# LANGUAGE MagicHash, UnboxedTuples #-}
+-- Exercise the parallel scavenging of large arrays: keep a large boxed
+-- array and a large SmallArray# alive across several parallel GCs, pointing
+-- them at freshly allocated values each time so that the chunks have work
+-- to do and the card table matters.
+
+import Control.Monad
+import Data.Array.IO
+import GHC.Exts
+import GHC.IO
+import System.Mem
+
+data SmallArr a = SmallArr (SmallMutableArray# RealWorld a)
+
+newSmallArr :: Int -> a -> IO (SmallArr a)
+newSmallArr (I# n) x = IO $ \s -> case newSmallArray# n x s of
+  (# s', arr #) -> (# s', SmallArr arr #)
+
+writeSmallArr :: SmallArr a -> Int -> a -> IO ()
+writeSmallArr (SmallArr arr) (I# i) x =
+  IO $ \s -> (# writeSmallArray# arr i x s, () #)
+
+readSmallArr :: SmallArr a -> Int -> IO a
+readSmallArr (SmallArr arr) (I# i) = IO $ readSmallArray# arr i
+
+size :: Int
+size = 200000
+
+main :: IO ()
+main = do
+  arr <- newArray (0, size - 1) 0 :: IO (IOArray Int Integer)
+  small <- newSmallArr size (0 :: Integer)
+  forM_ [1..4] $ \r -> do
+    forM_ [0, 3 .. size - 1] $ \i -> do
+      writeArray arr i (fromIntegral (i * r))
+      writeSmallArr small i (fromIntegral (i + r))
+    performMajorGC
+    performGC
+    a <- foldM (\acc i -> (acc +) <$> readArray arr i) 0 [0 .. size - 1]
+    b <- foldM (\acc i -> (acc +) <$> readSmallArr small i) 0 [0 .. size - 1]
+    print (a, b)
@@ -0,0 +1,33 @@
+-- Exercise +RTS --return-memory-rate: build up a large heap, drop it, and
+-- keep collecting (and idling) so that the surplus is returned to the OS a
+-- little at a time. Check that the memory in use ends up well below its
+-- peak; without the flag none of it would be returned.
+
+import Control.Concurrent
+import Control.Monad
+import Data.Word
+import GHC.Stats
+import System.Mem
+
+main :: IO ()
+main = do
+  let xs = [1 .. 2000000 :: Int]
+  print (sum xs + length xs)
+  forM_ [1..5 :: Int] $ \i -> do
+    performMajorGC
+    threadDelay 10000
+    print (sum [1 .. i * 1000])
+  peak <- max_mem_in_use_bytes <$> getRTSStats
+  returned <- waitForReturn peak 100
+  putStrLn ("memory returned: " ++ if returned then "ok" else "bad")
+
+-- gcdetails_mem_in_use_bytes is measured at the end of each GC, so it
+-- reflects what was returned after the GCs before it.
+waitForReturn :: Word64 -> Int -> IO Bool
+waitForReturn _ 0 = return False
+waitForReturn peak n = do
+  performMajorGC
+  inUse <- gcdetails_mem_in_use_bytes . gc <$> getRTSStats
+  if inUse * 2 < peak
+    then return True
+    else threadDelay 10000 >> waitForReturn peak (n - 1)
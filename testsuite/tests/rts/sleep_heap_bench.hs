@@ -0,0 +1,36 @@
+-- A benchmark for threadDelay in the non-threaded RTS (rts/posix/Select.c).
+-- Many threads sleep at once, with wake-up times in no particular order,
+-- and then many 'timeout's start a delay only to cancel it.  With the
+-- sleeping threads in a sorted list each delay took time proportional to
+-- the number of sleeping threads; with the heap it shouldn't.
+-- The timings go to stderr.
+
+import Control.Concurrent
+import Control.Monad
+import GHC.Clock
+import System.IO
+import System.Timeout
+
+sleepers, timeouts :: Int
+sleepers = 20000
+timeouts = 20000
+
+main :: IO ()
+main = do
+  done <- newEmptyMVar
+  t0 <- getMonotonicTimeNSec
+  forM_ [1 .. sleepers] $ \i -> forkIO $ do
+    threadDelay ((i * 7919) `mod` 100000)
+    putMVar done ()
+  replicateM_ sleepers (takeMVar done)
+  t1 <- getMonotonicTimeNSec
+  -- a long-lived sleeper, so that the heap isn't empty
+  _ <- forkIO $ threadDelay 100000000
+  n <- foldM (\acc i -> maybe acc (+ acc) <$> timeout 10000000 (return i))
+             0 [1 .. timeouts]
+  t2 <- getMonotonicTimeNSec
+  print n
+  hPutStrLn stderr $ show sleepers ++ " sleepers: "
+    ++ show (fromIntegral (t1 - t0) / 1e6 :: Double) ++ " ms"
+  hPutStrLn stderr $ show timeouts ++ " timeouts: "
+    ++ show (fromIntegral (t2 - t1) / 1e6 :: Double) ++ " ms"
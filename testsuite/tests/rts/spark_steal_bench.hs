@@ -0,0 +1,29 @@
+-- A benchmark for spark stealing (findSpark in rts/Capability.c).  A single
+-- thread sparks lots of small computations, so the other capabilities get
+-- all their work by stealing from its pool.  The test runs it with the
+-- default stealing and with the old round-robin stealing (-qs), and checks
+-- the spark counters of both runs.  The timing goes to stderr.
+
+import Control.Monad
+import Data.List (foldl')
+import GHC.Clock
+import GHC.Conc
+import System.IO
+
+fib :: Int -> Int
+fib n = if n < 2 then n else fib (n - 1) + fib (n - 2)
+
+-- Spark every element, then sum them on this thread.  Sparks that have not
+-- been stolen by the time the sum gets to them fizzle.
+round_ :: Int -> Int
+round_ r = foldr par () xs `pseq` foldl' (+) 0 xs
+  where xs = [ fib (12 + (r + i) `mod` 8) | i <- [1 .. 2000] ]
+
+main :: IO ()
+main = do
+  t0 <- getMonotonicTimeNSec
+  total <- foldM (\acc r -> return $! acc + round_ r) 0 [1 .. 200]
+  t1 <- getMonotonicTimeNSec
+  print total
+  hPutStrLn stderr $ show numCapabilities ++ " capabilities: "
+    ++ show (fromIntegral (t1 - t0) / 1e6 :: Double) ++ " ms"
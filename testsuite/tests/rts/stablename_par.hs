@@ -0,0 +1,28 @@
+-- Make StableNames for the same objects from several threads at once,
+-- with minor and major GCs in between, and check that each object always
+-- gets the same StableName.
+
+import Control.Concurrent
+import Control.Monad
+import System.Mem
+import System.Mem.StableName
+
+main :: IO ()
+main = do
+  let xs = [ [i] | i <- [1 .. 20000 :: Int] ]
+  mapM_ (`seq` return ()) xs
+  names <- mapM makeStableName xs
+  dones <- forM [1 .. 4 :: Int] $ \t -> do
+    done <- newEmptyMVar
+    _ <- forkIO $ do
+      oks <- forM [1 .. 5 :: Int] $ \r -> do
+        when (r == t) performMajorGC
+        names' <- mapM makeStableName xs
+        performMinorGC
+        return (names' == names)
+      putMVar done (and oks)
+    return done
+  oks <- mapM takeMVar dones
+  print (and oks)
+  names' <- mapM makeStableName xs
+  print (map hashStableName names' == map hashStableName names)
@@ -0,0 +1,63 @@
+-- Create and free StablePtrs from several capabilities at once, in single
+-- calls and in bulk, with GCs in between, and check that every StablePtr
+-- still dereferences to its own object.  Then drop to one capability and
+-- check that the entries cached by the others went back to the global free
+-- list.
+
+import Control.Concurrent
+import Control.Monad
+import Foreign
+import System.Mem
+
+foreign import ccall unsafe "freeStablePtrs"
+  freeStablePtrs :: Ptr (StablePtr a) -> Word32 -> IO ()
+
+foreign import ccall unsafe "dupStablePtrs"
+  dupStablePtrs :: Ptr (StablePtr a) -> Ptr (StablePtr a) -> Word32 -> IO ()
+
+foreign import ccall unsafe "countCachedStablePtrs"
+  countCachedStablePtrs :: Ptr (StablePtr a) -> Word32 -> IO Word32
+
+-- SP_CACHE_SIZE in rts/StablePtr.h
+spCacheSize :: Int
+spCacheSize = 64
+
+-- Returns whether all went well, and the StablePtrs it freed
+worker :: Int -> IO (Bool, [StablePtr [Int]])
+worker t = fmap (\rs -> (and (map fst rs), concatMap snd rs)) $
+  forM [1 .. 20 :: Int] $ \r -> do
+    let xs = [ [t, r, i] | i <- [1 .. 1000] ]
+    sps <- mapM newStablePtr xs
+    when (r `mod` 5 == t) performMinorGC
+    -- bulk allocation, in requests both smaller and larger than a batch
+    let n = 1 + r * 3
+    dups <- withArrayLen (take n sps) $ \len arr ->
+      allocaArray len $ \out -> do
+        dupStablePtrs arr out (fromIntegral len)
+        peekArray len out
+    ys <- mapM deRefStablePtr sps
+    zs <- mapM deRefStablePtr dups
+    let (single, bulk) = splitAt 300 (sps ++ dups)
+    mapM_ freeStablePtr single
+    withArrayLen bulk $ \len arr -> freeStablePtrs arr (fromIntegral len)
+    return (ys == xs && zs == take n xs, sps ++ dups)
+
+main :: IO ()
+main = do
+  kept <- mapM newStablePtr [1 .. 5000 :: Int]
+  dones <- forM [1 .. 4] $ \t -> do
+    done <- newEmptyMVar
+    _ <- forkOn t $ worker t >>= putMVar done
+    return done
+  (oks, freed) <- unzip <$> mapM takeMVar dones
+  print (and oks)
+  performMajorGC
+  ys <- mapM deRefStablePtr kept
+  print (ys == [1 .. 5000])
+  mapM_ freeStablePtr kept
+  -- capabilities 1 to 3 must give their cached entries back, so only the
+  -- cache of capability 0 and the end of the free list can be left
+  setNumCapabilities 1
+  cached <- withArrayLen (concat freed) $ \len arr ->
+    countCachedStablePtrs arr (fromIntegral len)
+  print (fromIntegral cached <= spCacheSize + 1)
@@ -0,0 +1,40 @@
+#include "Rts.h"
+
+#include <stdlib.h>
+
+// Make new stable pointers to the objects of the n stable pointers in sps,
+// with a single call to getStablePtrs.  Called with an unsafe foreign call,
+// so the objects can't move in the meantime.
+void dupStablePtrs(StgStablePtr sps[], StgStablePtr new_sps[], uint32_t n)
+{
+    StgPtr *ps = malloc(n * sizeof(StgPtr));
+    for (uint32_t i = 0; i < n; i++) {
+        ps[i] = deRefStablePtr(sps[i]);
+    }
+    getStablePtrs(ps, new_sps, n);
+    free(ps);
+}
+
+static int compareStablePtrs(const void *a, const void *b)
+{
+    StgWord x = (StgWord)*(const StgStablePtr *)a;
+    StgWord y = (StgWord)*(const StgStablePtr *)b;
+    return x < y ? -1 : x > y;
+}
+
+// How many distinct entries among the given free stable pointer table
+// entries have a NULL addr.  An entry on the global free list points to the
+// next one, except for the last, while an entry in a capability's cache is
+// NULL.  Sorts sps.
+uint32_t countCachedStablePtrs(StgStablePtr sps[], uint32_t n)
+{
+    uint32_t count = 0;
+    qsort(sps, n, sizeof(StgStablePtr), compareStablePtrs);
+    for (uint32_t i = 0; i < n; i++) {
+        if ((i == 0 || sps[i] != sps[i-1])
+            && stable_ptr_table[(StgWord)sps[i]].addr == NULL) {
+            count++;
+        }
+    }
+    return count;
+}
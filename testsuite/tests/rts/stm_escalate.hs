@@ -0,0 +1,42 @@
+-- A long transaction that reads many TVars competes with threads that keep
+-- updating them.  Each attempt waits inside the transaction until a writer
+-- has committed, so it keeps failing until +RTS --stm-escalate-after runs it
+-- serialised and the writers can't commit any more.  Check that it finishes
+-- with consistent sums and that the STM counters show it was serialised.
+
+import Control.Concurrent
+import Control.Monad
+import Data.IORef
+import GHC.Conc
+import GHC.Stats
+
+main :: IO ()
+main = do
+  tvs <- replicateM 200 (newTVarIO (0 :: Int))
+  commits <- newIORef (0 :: Int)
+  writers <- forM [1 .. 3 :: Int] $ \_ -> forkIO $ forever $
+    -- each transaction moves one unit between two TVars, so the sum of
+    -- all the TVars is always zero
+    forM_ (zip tvs (tail tvs)) $ \(a, b) -> do
+      atomically $ do
+        readTVar a >>= writeTVar a . subtract 1
+        readTVar b >>= writeTVar b . (+ 1)
+      atomicModifyIORef' commits (\n -> (n + 1, ()))
+  sums <- forM [1 .. 20 :: Int] $ \_ -> atomically $ do
+    xs <- mapM readTVar tvs
+    -- wait for a writer to commit, which invalidates this attempt, or for
+    -- about 10ms if the writers are held back because we run serialised
+    unsafeIOToSTM $ do
+      n0 <- readIORef commits
+      let wait :: Int -> IO ()
+          wait 0 = return ()
+          wait k = do
+            n <- readIORef commits
+            when (n == n0) $ threadDelay 100 >> wait (k - 1)
+      wait 100
+    return $! sum xs
+  mapM_ killThread writers
+  print (all (== 0) sums)
+  s <- getSTMStats
+  print (stm_aborts s > 0)
+  print (stm_serialised s > 0)
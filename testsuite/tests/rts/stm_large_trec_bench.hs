@@ -0,0 +1,34 @@
+-- A benchmark for STM transactions that touch many TVars, whose TVar
+-- lookups used to take time linear in the size of the transaction (see
+-- Note [TRec indexes] in rts/STM.c).  The timings go to stderr.  The
+-- arguments are the numbers of TVars to try.
+
+import Control.Monad
+import GHC.Clock
+import GHC.Conc
+import System.Environment
+import System.IO
+import System.Mem
+
+bench :: Int -> IO ()
+bench n = do
+  tvs <- mapM newTVarIO [1 .. n]
+  t0 <- getMonotonicTimeNSec
+  -- every access after the first one to a TVar looks up its entry, and the
+  -- GC in the middle invalidates the index
+  s1 <- atomically $ do
+    forM_ tvs $ \tv -> readTVar tv >>= writeTVar tv . (* 2)
+    unsafeIOToSTM performMajorGC
+    sum <$> mapM readTVar tvs
+  -- the same in a nested transaction, whose entries are then merged into
+  -- the enclosing one
+  s2 <- atomically $ (do
+    forM_ tvs $ \tv -> readTVar tv >>= writeTVar tv . subtract 1
+    sum <$> mapM readTVar tvs) `orElse` return 0
+  t1 <- getMonotonicTimeNSec
+  print (s1 == n * (n + 1), s2 == n * n)
+  hPutStrLn stderr $
+    show n ++ " TVars: " ++ show ((t1 - t0) `div` 1000000) ++ " ms"
+
+main :: IO ()
+main = getArgs >>= mapM_ (bench . read)
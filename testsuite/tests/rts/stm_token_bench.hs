@@ -0,0 +1,43 @@
+-- A scalability benchmark for starting STM transactions: every thread runs
+-- short transactions on a TVar of its own, so the only shared state they
+-- touch is the global commit token counter (getTokenBatch in rts/STM.c).
+-- The timings go to stderr.
+--
+-- In the testsuite it runs a few thousand transactions on up to 4
+-- capabilities.  To measure scalability, give the number of transactions
+-- per thread and the capability counts as arguments, e.g.
+--
+--   ./stm_token_bench 200000 1 2 4 8 16 32 64 +RTS -N64
+
+import Control.Concurrent
+import Control.Monad
+import GHC.Clock
+import GHC.Conc
+import System.Environment
+import System.IO
+
+bench :: Int -> Int -> IO ()
+bench transactions caps = do
+  setNumCapabilities caps
+  t0 <- getMonotonicTimeNSec
+  dones <- forM [0 .. caps - 1] $ \i -> do
+    done <- newEmptyMVar
+    tv <- newTVarIO (0 :: Int)
+    _ <- forkOn i $ do
+      replicateM_ transactions $
+        atomically $ readTVar tv >>= \x -> writeTVar tv $! x + 1
+      readTVarIO tv >>= putMVar done
+    return done
+  counts <- mapM takeMVar dones
+  t1 <- getMonotonicTimeNSec
+  print (all (== transactions) counts)
+  let ns = fromIntegral (t1 - t0) / fromIntegral (caps * transactions)
+  hPutStrLn stderr $
+    show caps ++ " capabilities: " ++ show (ns :: Double) ++ " ns/transaction"
+
+main :: IO ()
+main = do
+  args <- map read <$> getArgs
+  case args of
+    transactions : caps@(_ : _) -> mapM_ (bench transactions) caps
+    _ -> mapM_ (bench 5000) [1, 2, 4]
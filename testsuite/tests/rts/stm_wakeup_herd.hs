@@ -0,0 +1,30 @@
+-- Many threads block in retry on the same TVars while other threads keep
+-- committing to them, so each blocked thread is woken by several commits
+-- at once.  Check that no wakeup is lost: every thread must finish.
+
+import Control.Concurrent
+import Control.Monad
+import GHC.Conc
+
+main :: IO ()
+main = do
+  clock <- newTVarIO (0 :: Int)
+  other <- newTVarIO (0 :: Int)
+  finished <- newTVarIO (0 :: Int)
+  let n = 2000
+  forM_ [1 .. n] $ \i -> forkIO $ atomically $ do
+    t <- readTVar clock
+    _ <- readTVar other
+    when (t < i) retry
+    modifyTVar finished (+ 1)
+  -- each tick updates both TVars the waiters read
+  ticker <- forkIO $ forM_ [1 .. n] $ \_ -> do
+    atomically $ do
+      modifyTVar clock (+ 1)
+      modifyTVar other (+ 1)
+    yield
+  atomically $ readTVar finished >>= \f -> when (f < n) retry
+  killThread ticker
+  readTVarIO finished >>= print
+  where
+    modifyTVar tv f = readTVar tv >>= writeTVar tv . f
@@ -0,0 +1,27 @@
+-- +RTS -qp: threads forked on one capability must still all run to
+-- completion when it only gives threads to idle capabilities that ask for
+-- them, and threads pinned with forkOn must stay where they were put.
+
+import Control.Concurrent
+import Control.Exception
+import Control.Monad
+
+spin :: Int -> Int
+spin n = go n 0
+  where go 0 acc = acc
+        go k acc = go (k - 1) $! (acc * 31 + k) `mod` 1000003
+
+main :: IO ()
+main = do
+  done <- newEmptyMVar
+  -- start everything from capability 0, so that the others have to ask
+  _ <- forkOn 0 $ do
+    forM_ [1 .. 200] $ \i -> forkIO $ do
+      r <- evaluate (spin (20000 + i))
+      putMVar done (r `seq` True)
+    forM_ [1 .. 20] $ \_ -> forkOn 0 $ do
+      _ <- evaluate (spin 20000)
+      (cap, _) <- threadCapability =<< myThreadId
+      putMVar done (cap == 0)
+  oks <- replicateM 220 (takeMVar done)
+  print (length (filter id oks))